@@ -34,11 +34,16 @@ extern "C" {
 #define ENVIDEO_RC_MOD_SYSTEM 0
 #define ENVIDEO_RC_MOD_RM     1
 #define ENVIDEO_RC_MOD_ENGINE 2
+#define ENVIDEO_RC_MOD_LIBRARY 3
 
 #define ENVIDEO_MKRC(res, mod) (-((res) | ((mod) << 28)))
 #define ENVIDEO_RC_SYSTEM(res) ENVIDEO_MKRC(res, ENVIDEO_RC_MOD_SYSTEM)
 #define ENVIDEO_RC_RM(res)     ENVIDEO_MKRC(res, ENVIDEO_RC_MOD_RM)
 #define ENVIDEO_RC_ENGINE(res) ENVIDEO_MKRC(res, ENVIDEO_RC_MOD_ENGINE)
+#define ENVIDEO_RC_LIBRARY(res) ENVIDEO_MKRC(res, ENVIDEO_RC_MOD_LIBRARY)
+
+// Returned when an allocation would exceed the memory budget of the device
+#define ENVIDEO_RC_BUDGET_EXCEEDED ENVIDEO_RC_LIBRARY(1)
 
 #define ENVIDEO_RC_MOD(rc) (((rc) >> 29) & 3)
 #define ENVIDEO_RC_RES(rc) ((rc) & ((1 << 29) - 1))
@@ -49,6 +54,9 @@ extern "C" {
  */
 #define ENVIDEO_MAP_ALIGN (1 << 8)
 
+// Size of the pages backing host memory allocated with EnvideoMap_HugePages
+#define ENVIDEO_HUGE_PAGE_SIZE (1 << 21)
+
 /*
  * GOBs are 64B wide.
  */
@@ -117,16 +125,23 @@ typedef enum {
     EnvideoMap_UsageEngine      = 2 << 12,
     EnvideoMap_UsageCmdbuf      = 3 << 12,
 
+    // Hints, these can be combined freely
+    EnvideoMap_CpuLazy          = ENVIDEO_BIT(16), // Defer the cpu mapping until its first use
+    EnvideoMap_HugePages        = ENVIDEO_BIT(17), // Back the memory with large pages where supported
+    EnvideoMap_AnyNode          = ENVIDEO_BIT(18), // Don't place host memory on the numa node of the device
+
     EnvideoMap_CpuMask          = 0x000f,
     EnvideoMap_GpuMask          = 0x00f0,
     EnvideoMap_LocationMask     = 0x0f00,
     EnvideoMap_UsageMask        = 0xf000,
+    EnvideoMap_HintMask         = 0x7fff0000,
 } EnvideoMapFlags;
 
 #define ENVIDEO_MAP_GET_CPU_FLAGS(f)      ((EnvideoMapFlags)((f) & EnvideoMap_CpuMask))
 #define ENVIDEO_MAP_GET_GPU_FLAGS(f)      ((EnvideoMapFlags)((f) & EnvideoMap_GpuMask))
 #define ENVIDEO_MAP_GET_LOCATION_FLAGS(f) ((EnvideoMapFlags)((f) & EnvideoMap_LocationMask))
 #define ENVIDEO_MAP_GET_USAGE_FLAGS(f)    ((EnvideoMapFlags)((f) & EnvideoMap_UsageMask))
+#define ENVIDEO_MAP_GET_HINT_FLAGS(f)     ((EnvideoMapFlags)((f) & EnvideoMap_HintMask))
 
 typedef enum {
     EnvideoCache_Writeback  = ENVIDEO_BIT(0),
@@ -153,16 +168,22 @@ typedef struct EnvideoDevice  EnvideoDevice;
 typedef struct EnvideoMap     EnvideoMap;
 typedef struct EnvideoChannel EnvideoChannel;
 typedef struct EnvideoCmdbuf  EnvideoCmdbuf;
+typedef struct EnvideoHeap    EnvideoHeap;
+typedef struct EnvideoSurfacePool EnvideoSurfacePool;
+typedef struct EnvideoCopyGroup EnvideoCopyGroup;
+typedef struct EnvideoReadback EnvideoReadback;
 typedef uint64_t              EnvideoFence;
 
 typedef struct {
     bool     tegra_layout;
+    int32_t  numa_node;     // Numa node the device is attached to, -1 if unknown
     uint64_t reserved[3];
 } EnvideoDeviceInfo;
 
 int envideo_device_create(EnvideoDevice **device);
 int envideo_device_destroy(EnvideoDevice *device);
 EnvideoDeviceInfo envideo_device_get_info(EnvideoDevice *device);
+int envideo_device_get_copy_instances(EnvideoDevice *device, uint32_t *count);
 
 int envideo_fence_wait(EnvideoDevice *device, EnvideoFence fence, uint64_t timeout_us);
 int envideo_fence_poll(EnvideoDevice *device, EnvideoFence fence, bool *is_done);
@@ -170,20 +191,148 @@ int envideo_fence_poll(EnvideoDevice *device, EnvideoFence fence, bool *is_done)
 int envideo_map_create(EnvideoDevice *device, EnvideoMap **map, size_t size, size_t align, EnvideoMapFlags flags);
 int envideo_map_from_va(EnvideoDevice *device, EnvideoMap **map, void *mem, size_t size, size_t align, EnvideoMapFlags flags);
 int envideo_map_destroy(EnvideoMap *map);
+/*
+ * Queues the object for destruction once fence has signaled, without blocking. Retired objects are released
+ * when submitting, polling or waiting on fences, and at the latest along with the device.
+ * Channels are released once no retired map or command buffer is left. A zero fence destroys immediately.
+ * Failures to release retired objects along the way are not reported, those objects are retried later.
+ */
+int envideo_map_destroy_deferred(EnvideoMap *map, EnvideoFence fence);
+/*
+ * Imports a dma-buf (or a file-backed buffer such as a memfd) as a host map. A size of zero imports the whole buffer.
+ * The caller keeps ownership of fd. When the driver cannot import a file-backed buffer directly, its cpu mapping
+ * is imported instead. Exporting returns a new descriptor owned by the caller, sub-allocated maps cannot be exported.
+ * The nvidia backend supports neither: dma-bufs are rejected with ENOSYS (only file-backed buffers can be imported),
+ * and exporting returns ENOSYS.
+ */
+int envideo_map_import_dmabuf(EnvideoDevice *device, int fd, size_t size, EnvideoMapFlags flags, EnvideoMap **map);
+int envideo_map_export_dmabuf(EnvideoMap *map, int *fd);
+// Migrates the contents through the cpu, maps created with EnvideoMap_CpuUnmapped are rejected with EINVAL,
+// as are maps backing command buffers, with either function
 int envideo_map_realloc(EnvideoMap *map, size_t size, size_t align);
+/*
+ * Migrates the contents using the copy engine, recording into cmdbuf (which is cleared first) and submitting it
+ * to channel. The previous allocation is released once the returned fence has signaled. Without a channel,
+ * this behaves like envideo_map_realloc and the fence is zero. Maps grow by at least a factor of two.
+ */
+int envideo_map_realloc_async(EnvideoMap *map, size_t size, size_t align, EnvideoChannel *channel,
+                              EnvideoCmdbuf *cmdbuf, EnvideoFence *fence);
 int envideo_map_pin(EnvideoMap *map, EnvideoChannel *channel);
+/*
+ * Batched variants of envideo_map_create and envideo_map_pin, meant for stream setup. Maps are aligned to the
+ * device page size, and creation is all or nothing. Every map is pinned to every channel, in as few driver calls
+ * as the kernel allows, else spread across a few threads.
+ */
+int envideo_map_create_many(EnvideoDevice *device, size_t count, const size_t *sizes, EnvideoMapFlags flags,
+                            EnvideoMap **maps);
+int envideo_map_pin_many(EnvideoMap **maps, size_t num_maps, EnvideoChannel **channels, size_t num_channels);
 int envideo_map_cache_op(EnvideoMap *map, size_t offset, size_t len, EnvideoCacheFlags flags);
+// Fails with EBUSY while the map is the memory of a command buffer
+int envideo_map_unmap_cpu(EnvideoMap *map);
+
+/*
+ * Cpu writes to cacheable maps can be recorded as dirty ranges, either explicitly or through envideo_map_write.
+ * Dirty ranges of the maps referenced by a command buffer are written back when it is submitted,
+ * coalesced into as few cache operations as possible.
+ */
+int envideo_map_mark_dirty(EnvideoMap *map, size_t offset, size_t len);
+int envideo_map_write(EnvideoMap *map, size_t offset, const void *data, size_t len);
 size_t   envideo_map_get_size    (EnvideoMap *map);
 uint32_t envideo_map_get_handle  (EnvideoMap *map);
 void    *envideo_map_get_cpu_addr(EnvideoMap *map);
 uint64_t envideo_map_get_gpu_addr(EnvideoMap *map);
+size_t   envideo_map_get_page_size(EnvideoMap *map);
+
+/*
+ * Allocates page-aligned host memory, to be imported with envideo_map_from_va. With EnvideoMap_HugePages,
+ * the memory is backed by hugetlbfs pages if available, else it is advised for transparent huge pages.
+ * size is rounded up to the allocated size, which must be passed back to envideo_host_free.
+ * page_size receives the size of the pages the allocation is guaranteed to be backed with.
+ */
+int envideo_host_alloc(EnvideoDevice *device, void **mem, size_t *size, EnvideoMapFlags flags, size_t *page_size);
+int envideo_host_free(EnvideoDevice *device, void *mem, size_t size);
+
+typedef struct {
+    uint64_t hits, misses, evictions;
+    size_t   cached_bytes, cached_maps;
+    uint64_t hit_time_ns, miss_time_ns;
+} EnvideoMapCacheStats;
+
+/*
+ * When enabled, destroyed maps are kept alive (still mapped and pinned) and handed back by envideo_map_create
+ * when called with the same size class, alignment and flags. Contents of recycled maps are undefined.
+ * The cache is disabled by default, setting a limit of zero disables it and releases all cached maps.
+ */
+int envideo_map_cache_set_limit(EnvideoDevice *device, size_t max_bytes);
+int envideo_map_cache_trim(EnvideoDevice *device, size_t max_bytes);
+EnvideoMapCacheStats envideo_map_cache_get_stats(EnvideoDevice *device);
+
+/*
+ * When enabled, ranges imported with envideo_map_from_va stay registered with the driver after their maps
+ * are destroyed, and importing the same range with the same flags hands back the existing map.
+ * Maps are shared and refcounted, every envideo_map_from_va must be balanced by an envideo_map_destroy.
+ * Least recently used idle ranges are dropped once the registered bytes exceed the limit, zero disables the cache.
+ * Ranges must be unregistered before the memory backing them is unmapped or reused.
+ */
+int envideo_va_cache_set_limit(EnvideoDevice *device, size_t max_bytes);
+int envideo_map_unregister_va(EnvideoDevice *device, void *mem, size_t size);
+
+typedef struct {
+    uint64_t bytes, peak_bytes;
+    uint64_t count, peak_count;
+} EnvideoMemoryCounter;
+
+typedef struct {
+    EnvideoMemoryCounter total;
+    EnvideoMemoryCounter location[2];   // Indexed by ENVIDEO_MAP_GET_LOCATION_FLAGS(flags) >> 8
+    EnvideoMemoryCounter usage[4];      // Indexed by ENVIDEO_MAP_GET_USAGE_FLAGS(flags)    >> 12
+    EnvideoMemoryCounter cpu[4];        // Indexed by ENVIDEO_MAP_GET_CPU_FLAGS(flags)
+    EnvideoMemoryCounter gpu[3];        // Indexed by ENVIDEO_MAP_GET_GPU_FLAGS(flags)      >> 4
+    uint64_t budget;                    // Zero if unlimited
+    uint64_t vram_total, vram_free;     // Zero if unknown, or if the device has no dedicated memory
+    uint64_t va_total, va_used;         // Gpu address space managed by the library, zero if managed by the driver
+    uint64_t va_largest_free;           // Largest contiguous free range, a measure of fragmentation
+} EnvideoMemoryStats;
+
+/*
+ * Accounts for the memory of maps created with envideo_map_create, including heap blocks, pool surfaces
+ * and maps held by the map cache. Imported memory and internal allocations are not accounted for.
+ * With a budget set, envideo_map_create fails with ENVIDEO_RC_BUDGET_EXCEEDED instead of allocating past it,
+ * after having released cached maps. A budget of zero removes the limit.
+ */
+int envideo_device_get_memory_stats(EnvideoDevice *device, EnvideoMemoryStats *stats);
+int envideo_device_set_memory_budget(EnvideoDevice *device, size_t budget);
+
+/*
+ * Groups gpu mapping operations, so that the translation caches are only invalidated once at the end.
+ * Maps created within a batch must not be used by the gpu before the batch has ended. Batches can be nested.
+ */
+int envideo_device_begin_map_batch(EnvideoDevice *device);
+int envideo_device_end_map_batch(EnvideoDevice *device);
+
+/*
+ * Heaps carve maps out of larger driver allocations ("blocks"), to amortize the cost of creating many small maps.
+ * Sub-allocated maps can be used like any other map, and must be released with envideo_map_destroy
+ * before the heap itself is destroyed. Allocations are aligned to at least ENVIDEO_MAP_ALIGN.
+ */
+int envideo_heap_create(EnvideoDevice *device, EnvideoHeap **heap, size_t block_size, EnvideoMapFlags flags);
+int envideo_heap_destroy(EnvideoHeap *heap);
+int envideo_heap_alloc(EnvideoHeap *heap, EnvideoMap **map, size_t size, size_t align);
 
 int envideo_channel_create(EnvideoDevice *device, EnvideoChannel **channel, EnvideoEngine engine);
+// Binds the channel to a given engine instance, copy instances being counted among asynchronous ones only
+int envideo_channel_create_instance(EnvideoDevice *device, EnvideoChannel **channel, EnvideoEngine engine,
+                                    uint32_t instance);
+// Waits for retired maps pinned to the channel and its retired command buffers first,
+// failing with the channel left alive if one of them can't be waited on
 int envideo_channel_destroy(EnvideoChannel *channel);
+int envideo_channel_destroy_deferred(EnvideoChannel *channel, EnvideoFence fence);
 int envideo_channel_submit(EnvideoChannel *channel, EnvideoCmdbuf *cmdbuf, EnvideoFence *fence);
 
 int envideo_cmdbuf_create(EnvideoChannel *channel, EnvideoCmdbuf **cmdbuf);
 int envideo_cmdbuf_destroy(EnvideoCmdbuf *cmdbuf);
+int envideo_cmdbuf_destroy_deferred(EnvideoCmdbuf *cmdbuf, EnvideoFence fence);
+// The map must outlive the command buffer, and keeps its cpu mapping until then
 int envideo_cmdbuf_add_memory(EnvideoCmdbuf *cmdbuf, const EnvideoMap *map, uint32_t offset, uint32_t size);
 int envideo_cmdbuf_clear(EnvideoCmdbuf *cmdbuf);
 int envideo_cmdbuf_begin(EnvideoCmdbuf *cmdbuf, EnvideoEngine engine);
@@ -195,6 +344,24 @@ int envideo_cmdbuf_push_reloc(EnvideoCmdbuf *cmdbuf, uint32_t offset, const Envi
 int envideo_cmdbuf_wait_fence(EnvideoCmdbuf *cmdbuf, EnvideoFence fence);
 int envideo_cmdbuf_cache_op(EnvideoCmdbuf *cmdbuf, EnvideoCacheFlags flags);
 
+/*
+ * Records a range written by an engine (copy helpers and surface transfers do so automatically).
+ * Once the submission has completed, envideo_cmdbuf_invalidate_written invalidates the cpu caches over
+ * the recorded ranges of cacheable maps. The records are dropped when the command buffer is cleared.
+ */
+int envideo_cmdbuf_mark_written(EnvideoCmdbuf *cmdbuf, const EnvideoMap *map, size_t offset, size_t len);
+int envideo_cmdbuf_invalidate_written(EnvideoCmdbuf *cmdbuf);
+
+/*
+ * Copy engine helpers, recording a complete command sequence (begin/end included).
+ * Fills repeat the low pattern_size bytes (1, 2 or 4) of pattern, the offset and length must be multiples of it.
+ * Ranges of any size are split into multi-line launches, but must start below 4GiB into the map.
+ */
+int envideo_cmdbuf_fill(EnvideoCmdbuf *cmdbuf, const EnvideoMap *map, size_t offset, size_t len,
+                        uint32_t pattern, uint32_t pattern_size);
+int envideo_cmdbuf_copy(EnvideoCmdbuf *cmdbuf, const EnvideoMap *dst, size_t dst_offset,
+                        const EnvideoMap *src, size_t src_offset, size_t len);
+
 int envideo_dfs_initialize(EnvideoChannel *channel, float framerate);
 int envideo_dfs_finalize(EnvideoChannel *channel);
 int envideo_dfs_set_damping(EnvideoChannel *channel, double damping);
@@ -209,10 +376,226 @@ typedef struct {
     uint32_t    stride;
     bool        tiled;
     uint8_t     gob_height;
+    uint32_t    x, y;           // Origin of the width x height rectangle to transfer, x in bytes
 } EnvideoSurfaceInfo;
 
 int envideo_surface_transfer(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceInfo *src, EnvideoSurfaceInfo *dst);
 
+typedef struct {
+    EnvideoSurfaceInfo src, dst;
+} EnvideoSurfaceTransfer;
+
+/*
+ * Records many transfers in a single copy engine sequence, suited to small surfaces.
+ * Launches overlap, except those reading a map written earlier in the batch, and engine writes are flushed
+ * once after the last one. Registers unchanged from the previous launch are not written again.
+ * Fails without recording anything if the sequence might not fit in the remaining space of the cmdbuf.
+ */
+int envideo_surface_transfer_batch(EnvideoCmdbuf *cmdbuf, const EnvideoSurfaceTransfer *transfers,
+                                   uint32_t num_transfers);
+
+typedef enum {
+    EnvideoSurfaceFormat_Gray,  // Luma only
+    EnvideoSurfaceFormat_Nv12,  // Luma, and interleaved UV subsampled 2x2 (P010/P016 at higher depths)
+    EnvideoSurfaceFormat_Nv16,  // Luma, and interleaved UV subsampled horizontally
+    EnvideoSurfaceFormat_Nv24,  // Luma, and interleaved UV at full resolution
+    EnvideoSurfaceFormat_I420,  // Luma, U and V planes subsampled 2x2
+    EnvideoSurfaceFormat_I422,  // Luma, U and V planes subsampled horizontally
+    EnvideoSurfaceFormat_I444,  // Luma, U and V planes at full resolution
+} EnvideoSurfaceFormat;
+
+#define ENVIDEO_MAX_PLANES 3
+
+typedef struct {
+    size_t   offset;
+    uint32_t width, height;     // Visible dimensions, the width in bytes
+    uint32_t stride;
+    uint32_t alloc_height;      // Rows allocated, including the padding of block-linear planes
+} EnvideoPlaneLayout;
+
+typedef struct {
+    uint32_t           num_planes;
+    EnvideoPlaneLayout planes[ENVIDEO_MAX_PLANES];
+    bool               tiled;
+    bool               tegra_layout;    // Gob arrangement expected by the engines, as in EnvideoDeviceInfo
+    uint8_t            gob_height;
+    size_t             size;
+    size_t             alignment;       // Of the allocation backing the surface
+} EnvideoSurfaceLayout;
+
+/*
+ * Places the planes of a frame in a single allocation, following the requirements of the engines of the device.
+ * Block-linear planes are padded to whole blocks of 2 gobs, plane offsets and the total size are aligned to
+ * ENVIDEO_MAP_ALIGN, and strides to a gob width.
+ */
+int envideo_surface_compute_layout(EnvideoDevice *device, EnvideoSurfaceFormat format, int depth,
+                                   uint32_t width, uint32_t height, bool tiled, EnvideoSurfaceLayout *layout);
+
+/*
+ * Transfers all planes of a frame in a single copy engine sequence, flushing once after the last plane.
+ * Samples are 8-bit at a depth of 8, and 16-bit words otherwise (10, 12 or 16).
+ * The width and height of the plane descriptors are ignored, and derived from the frame dimensions instead.
+ * Their origins are honored, so a crop is expressed with the origin of each plane and the cropped dimensions.
+ */
+int envideo_surface_transfer_frame(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat format, int depth,
+                                   uint32_t width, uint32_t height,
+                                   const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes);
+
+/*
+ * Transfers a frame while converting its format with the component remapping of the copy engine.
+ * Chroma is split out of, or interleaved into, semi-planar formats with the same subsampling,
+ * and a gray destination only receives the luma plane.
+ * Samples wider than 8 bits are narrowed by keeping their most significant byte when dst_depth is 8,
+ * which matches the msb-aligned storage of P010/P016.
+ */
+int envideo_surface_convert_frame(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat src_format, int src_depth,
+                                  EnvideoSurfaceFormat dst_format, int dst_depth, uint32_t width, uint32_t height,
+                                  const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes);
+
+typedef struct {
+    uint32_t step_x, step_y;    // One pixel kept out of step_x in each row, and one row out of step_y
+    bool     luma_only;         // Only the first plane is transferred
+} EnvideoSubsampleParams;
+
+/*
+ * Transfers a decimated frame, e.g. for analysis, reading only the kept rows.
+ * Each plane is reduced to ceil(w / step_x) x ceil(h / step_y) pixels, a pixel holding all the
+ * components of an interleaved plane. Columns are skipped through component remapping, for up to
+ * 4 components per group of step_x pixels. Rows are skipped by reading pitch sources with a multiple of their stride.
+ * Returns ENVIDEO_RC_SYSTEM(ENOTSUP) for subsamplings the engine cannot express, notably skipping rows of
+ * block-linear sources, which envideo_surface_deswizzle_subsampled handles on the cpu.
+ */
+int envideo_surface_subsample_frame(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat format, int depth,
+                                    uint32_t width, uint32_t height, const EnvideoSubsampleParams *params,
+                                    const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes);
+
+/*
+ * Downloads a frame straight into caller memory, sparing the copy out of an intermediate host map.
+ * The planes of dst are imported with envideo_map_from_va over the pages they span, enabling the cache
+ * of envideo_va_cache_set_limit keeps them registered across calls.
+ * The copy engine writes the rows within the ENVIDEO_MAP_ALIGN-aligned interior of each plane, the remaining
+ * rows at its start and end are staged in a bounce map, and written by the cpu after completion.
+ * cmdbuf is cleared and recorded on, the call returns once the download has completed.
+ * Past timeout_us, the call waits up to 5 more seconds for the engine to be done writing into dst, and returns
+ * the timeout error with dst partially written. Should the engine still be busy, the imported pages are left pinned.
+ */
+int envideo_surface_download_to(EnvideoChannel *channel, EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat format,
+                                int depth, uint32_t width, uint32_t height, const EnvideoSurfaceInfo *src_planes,
+                                void *const *dst, const uint32_t *dst_linesizes, uint64_t timeout_us);
+
+/*
+ * Channels on several copy engine instances, splitting transfers in horizontal bands submitted concurrently.
+ * Bands of block-linear surfaces start on block boundaries. Engine writes are flushed before the returned
+ * fence signals, which happens once all bands have completed.
+ * A num_channels of zero opens one channel per asynchronous instance. Transfers are split across all of them,
+ * until envideo_copy_group_tune or envideo_copy_group_set_splits select another count.
+ */
+int envideo_copy_group_create(EnvideoDevice *device, EnvideoCopyGroup **group, uint32_t num_channels);
+int envideo_copy_group_destroy(EnvideoCopyGroup *group);
+int envideo_copy_group_transfer(EnvideoCopyGroup *group, const EnvideoSurfaceInfo *src, const EnvideoSurfaceInfo *dst,
+                                EnvideoFence *fence);
+// Times a 4K readback with every split count, and keeps the fastest
+int envideo_copy_group_tune(EnvideoCopyGroup *group, uint32_t *num_splits);
+int envideo_copy_group_set_splits(EnvideoCopyGroup *group, uint32_t num_splits);
+
+typedef enum {
+    EnvideoSwizzleKernel_Auto,      // Fastest kernel supported by the cpu
+    EnvideoSwizzleKernel_Scalar,    // Reference implementation, one byte at a time
+    EnvideoSwizzleKernel_Sse4,
+    EnvideoSwizzleKernel_Avx2,
+    EnvideoSwizzleKernel_Neon,
+} EnvideoSwizzleKernel;
+
+typedef struct {
+    uint32_t             width, height;  // Converted region, starting at the origin of both surfaces. Width in bytes
+    uint32_t             tiled_stride;   // Width of the block-linear surface in bytes, a multiple of 64
+    uint32_t             linear_stride;
+    uint8_t              gob_height;     // Block height in gobs: 1, 2, 4, 8, 16 or 32
+    uint32_t             num_threads;    // Row bands converted concurrently, 0 to pick automatically
+    EnvideoSwizzleKernel kernel;
+} EnvideoSwizzleParams;
+
+/*
+ * Cpu conversion between block-linear (64Bx8 gobs, stacked gob_height high into blocks) and pitch layouts,
+ * without going through the copy engine.
+ * The gpu and Tegra (see EnvideoDeviceInfo::tegra_layout) variants share the same gob arrangement as seen
+ * from the cpu, both are handled here.
+ * Returns ENVIDEO_RC_SYSTEM(ENOTSUP) if the requested kernel cannot run on this cpu.
+ */
+int envideo_surface_swizzle  (void *tiled, const void *linear, const EnvideoSwizzleParams *params);
+int envideo_surface_deswizzle(void *linear, const void *tiled, const EnvideoSwizzleParams *params);
+
+/*
+ * Deswizzles one pixel of pixel_size bytes (a power of two up to 16) out of step_x, in one row out of step_y,
+ * of the region described by params. The linear output is ceil(width / pixel_size / step_x) pixels wide
+ * and ceil(height / step_y) rows high. Pixels are gathered one at a time, the kernel of params is ignored.
+ */
+int envideo_surface_deswizzle_subsampled(void *linear, const void *tiled, const EnvideoSwizzleParams *params,
+                                         uint32_t pixel_size, uint32_t step_x, uint32_t step_y);
+bool envideo_swizzle_kernel_supported(EnvideoSwizzleKernel kernel);
+
+typedef struct {
+    EnvideoCodec       codec;
+    EnvideoPixelFormat subsample;
+    int                depth;
+    uint32_t           width, height;
+    uint32_t           num_surfaces;
+    EnvideoMapFlags    flags;        // Usage is forced to EnvideoMap_UsageFramebuffer
+    EnvideoChannel   **channels;     // Channels surfaces get pinned to
+    uint32_t           num_channels;
+} EnvideoSurfacePoolParams;
+
+typedef struct {
+    uint32_t           index;
+    EnvideoMap        *map;
+    EnvideoSurfaceInfo luma, chroma; // Tiled, chroma is semi-planar (unused for monochrome)
+} EnvideoPoolSurface;
+
+/*
+ * Pool of tiled framebuffers, with reference counting and release fences.
+ * Surfaces are handed out with a reference count of one, and are only reused once all references
+ * have been released and all release fences have signaled. envideo_surface_pool_acquire never blocks,
+ * and returns ENVIDEO_RC_SYSTEM(EAGAIN) when no surface is available.
+ * On resize, surfaces with a different layout are destroyed as they retire, and replaced on demand.
+ */
+int envideo_surface_pool_create(EnvideoDevice *device, EnvideoSurfacePool **pool, const EnvideoSurfacePoolParams *params);
+// Surfaces with pending release fences are only freed once those have signaled
+int envideo_surface_pool_destroy(EnvideoSurfacePool *pool);
+int envideo_surface_pool_acquire(EnvideoSurfacePool *pool, EnvideoPoolSurface *surface);
+int envideo_surface_pool_ref(EnvideoSurfacePool *pool, uint32_t index);
+int envideo_surface_pool_release(EnvideoSurfacePool *pool, uint32_t index, EnvideoFence fence);
+int envideo_surface_pool_resize(EnvideoSurfacePool *pool, uint32_t width, uint32_t height, uint32_t num_surfaces);
+
+typedef struct {
+    EnvideoSurfaceFormat format;
+    int                  depth;
+    uint32_t             width, height;
+    uint32_t             min_slots, max_slots;  // Bounds of the ring, zero selects 2 and 8
+} EnvideoReadbackParams;
+
+typedef struct {
+    uint32_t       index;
+    EnvideoMap    *map;
+    const uint8_t *data[ENVIDEO_MAX_PLANES];
+    uint32_t       linesizes[ENVIDEO_MAX_PLANES];
+} EnvideoReadbackFrame;
+
+/*
+ * Ring of host staging maps frames are read back into, so that copies overlap with their consumption.
+ * envideo_readback_submit transfers a frame into a free slot on the copy channel, after the fence, if any.
+ * envideo_readback_acquire waits for the oldest submitted frame and invalidates the cpu caches over its slot,
+ * which is then handed to the consumer until released.
+ * The ring grows and shrinks between its bounds, from the measured latency of copies and duration of consumption.
+ * envideo_readback_submit never blocks, and returns ENVIDEO_RC_SYSTEM(EAGAIN) when no slot is available.
+ */
+int envideo_readback_create(EnvideoDevice *device, EnvideoChannel *channel, EnvideoReadback **readback,
+                            const EnvideoReadbackParams *params);
+int envideo_readback_destroy(EnvideoReadback *readback);
+int envideo_readback_submit(EnvideoReadback *readback, const EnvideoSurfaceInfo *src_planes, EnvideoFence fence);
+int envideo_readback_acquire(EnvideoReadback *readback, EnvideoReadbackFrame *frame, uint64_t timeout_us);
+int envideo_readback_release(EnvideoReadback *readback, uint32_t index);
+uint32_t envideo_readback_get_num_slots(EnvideoReadback *readback);
+
 typedef struct {
     EnvideoCodec codec;
     EnvideoPixelFormat subsample;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+namespace {
+
+constexpr std::size_t max_workers        = 4;
+constexpr std::size_t min_parallel_items = 4;
+
+// Runs fn over [0, count) on a few threads, returning the first error encountered.
+// Driver calls dominate, spawning threads is cheap in comparison.
+template <typename F>
+int parallel_for(std::size_t count, F &&fn) {
+    auto num_workers = std::min({ std::size_t(std::max(std::thread::hardware_concurrency(), 1u)), max_workers, count });
+    if (count < min_parallel_items || num_workers < 2) {
+        for (std::size_t i = 0; i < count; ++i)
+            ENVID_CHECK(fn(i));
+        return 0;
+    }
+
+    std::atomic_size_t next = 0;
+    std::atomic_int    rc   = 0;
+
+    auto worker = [&] {
+        for (std::size_t i; (i = next.fetch_add(1)) < count && rc.load(std::memory_order_relaxed) == 0;) {
+            if (auto res = fn(i); res) {
+                int expected = 0;
+                rc.compare_exchange_strong(expected, res);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_workers - 1);
+    for (std::size_t i = 0; i < num_workers - 1; ++i)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (auto &t: threads)
+        t.join();
+
+    return rc;
+}
+
+} // namespace
+
+int Device::pin_batch(const std::vector<Map *> &maps, const std::vector<Channel *> &channels) {
+    // Pins are recorded per map, distributing maps across workers avoids contention
+    return parallel_for(maps.size(), [&maps, &channels](std::size_t i) {
+        for (auto *c: channels) {
+            if (!maps[i]->find_pin(c))
+                ENVID_CHECK(maps[i]->pin(c));
+        }
+        return 0;
+    });
+}
+
+int create_maps(Device &device, std::size_t count, const std::size_t *sizes, EnvideoMapFlags flags, EnvideoMap **maps) {
+    std::fill_n(maps, count, nullptr);
+
+    // Invalidate the gpu translation caches once for the whole group
+    ENVID_CHECK(device.begin_map_batch());
+    auto rc = parallel_for(count, [&device, sizes, flags, maps](std::size_t i) {
+        return envideo_map_create(reinterpret_cast<EnvideoDevice *>(&device), &maps[i],
+                                  sizes[i], device.page_size, flags);
+    });
+
+    if (auto res = device.end_map_batch(); res && !rc)
+        rc = res;
+
+    // Creation is all or nothing
+    if (rc) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (maps[i])
+                envideo_map_destroy(maps[i]);
+            maps[i] = nullptr;
+        }
+    }
+
+    return rc;
+}
+
+} // namespace envid
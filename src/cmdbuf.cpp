@@ -63,6 +63,14 @@ int Cmdbuf::add_memory(const envid::Map *map, std::uint32_t offset, std::uint32_
     if (offset + size > map->size)
         return ENVIDEO_RC_SYSTEM(EINVAL);
 
+    // Command words are written through the cpu mapping
+    void *addr;
+    ENVID_CHECK(const_cast<envid::Map *>(map)->get_cpu_addr(addr));
+
+    // Keep the mapping in place for as long as words are written through it
+    const_cast<envid::Map *>(map)->ref_cmdbuf();
+    this->release_memory();
+
     this->map        = map;
     this->mem_offset = offset;
     this->mem_size   = size;
@@ -79,6 +87,7 @@ int GpfifoCmdbuf::finalize() {
 
 int GpfifoCmdbuf::clear() {
     this->cur_word  = this->words();
+    this->reset_tracking();
 
     this->entries.clear();
     return 0;
@@ -129,6 +138,8 @@ int GpfifoCmdbuf::push_value(std::uint32_t offset, std::uint32_t value) {
 int GpfifoCmdbuf::push_reloc(std::uint32_t offset, const envid::Map *target, std::uint32_t target_offset,
                              EnvideoRelocType reloc_type, int shift)
 {
+    this->add_reference(target);
+
     auto gpu_addr    = (reloc_type != EnvideoRelocType_Tiled) ? target->gpu_addr_pitch : target->gpu_addr_block;
     auto target_addr = (gpu_addr + target_offset) >> shift;
 
@@ -243,6 +254,7 @@ int Host1xCmdbuf::clear() {
 #endif
 
     this->cur_word = this->words();
+    this->reset_tracking();
     return 0;
 }
 
@@ -252,7 +264,8 @@ int Host1xCmdbuf::begin(EnvideoEngine engine) {
     auto class_id = engine_to_host1x_class_id(engine);
 
 #ifndef CONFIG_TEGRA_DRM
-    this->cmdbufs    .emplace_back(this->map->handle, this->num_words() * sizeof(std::uint32_t));
+    this->cmdbufs    .emplace_back(this->map->handle,
+        this->map->handle_offset + this->num_words() * sizeof(std::uint32_t));
     this->cmdbuf_exts.emplace_back(-1);
     this->class_ids  .emplace_back(class_id);
 #else
@@ -305,14 +318,17 @@ int Host1xCmdbuf::push_value(std::uint32_t offset, std::uint32_t value) {
 int Host1xCmdbuf::push_reloc(std::uint32_t offset, const envid::Map *target, std::uint32_t target_offset,
                              EnvideoRelocType reloc_type, int shift)
 {
+    this->add_reference(target);
+
 #ifndef CONFIG_TEGRA_DRM
     if (auto iova = target->find_pin(this->cur_engine); iova != 0) {
-        ENVID_CHECK(this->push_value(offset, (iova + target_offset) >> shift));
+        ENVID_CHECK(this->push_value(offset, (iova + target->handle_offset + target_offset) >> shift));
     } else if (auto type = reloc_type_to_host1x(reloc_type); type != UINT32_MAX) {
         ENVID_CHECK(this->push_value(offset, 0xdeadbeef));
 
         this->relocs.emplace_back(this->map->handle,
-            (this->num_words() - 1) * sizeof(std::uint32_t), target->handle, target_offset);
+            this->map->handle_offset + (this->num_words() - 1) * sizeof(std::uint32_t),
+            target->handle, target->handle_offset + target_offset);
 
         this->reloc_types .emplace_back(type);
         this->reloc_shifts.emplace_back(shift);
@@ -326,7 +342,7 @@ int Host1xCmdbuf::push_reloc(std::uint32_t offset, const envid::Map *target, std
         this->bufs.emplace_back(drm_tegra_submit_buf{
             .mapping                 = static_cast<std::uint32_t>(id),
             .reloc = {
-                .target_offset       = target_offset,
+                .target_offset       = static_cast<std::uint32_t>(target->handle_offset + target_offset),
                 .gather_offset_words = static_cast<std::uint32_t>(this->num_words() - 1),
                 .shift               = static_cast<std::uint32_t>(shift),
             },
@@ -20,7 +20,12 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <list>
+#include <mutex>
 #include <vector>
 #include <utility>
 
@@ -28,6 +33,8 @@
 
 #include <host1x.h>
 
+#include "util.hpp"
+
 namespace envid {
 
 enum class NvdecVersion {
@@ -53,6 +60,7 @@ class Device;
 class Channel;
 class Map;
 class Cmdbuf;
+class Heap;
 
 using Fence = EnvideoFence;
 
@@ -68,6 +76,171 @@ constexpr std::uint32_t fence_id(Fence fence) {
     return fence >> 32;
 }
 
+// Range of a map subject to cache maintenance
+struct CacheRange {
+    Map        *map;
+    std::size_t offset, len;
+};
+
+// Recycles destroyed maps for later creations with matching parameters,
+// avoiding a round-trip through the driver
+class MapCache {
+    public:
+        MapCache() = default;
+        MapCache(const MapCache &) = delete;
+        MapCache &operator =(const MapCache &) = delete;
+
+        static std::size_t size_class(std::size_t size, std::size_t page_size);
+
+        Map *acquire(std::size_t size, std::size_t align, EnvideoMapFlags flags);
+        bool release(Map *map);
+        int  trim(std::size_t max_bytes);
+        void remove_channel(Channel *channel);
+
+        int  set_limit(std::size_t max_bytes);
+        void account(bool hit, std::chrono::steady_clock::duration time);
+        EnvideoMapCacheStats get_stats();
+
+        bool enabled() const {
+            return this->limit != 0;
+        }
+
+    private:
+        int trim_locked(std::size_t max_bytes);
+
+    private:
+        std::mutex lock;
+
+        // Most recently released maps are at the front
+        std::list<Map *> maps;
+
+        std::atomic_size_t limit = 0;
+        std::size_t   bytes = 0;
+        std::uint64_t hits = 0, misses = 0, evictions = 0;
+        std::chrono::steady_clock::duration hit_time = {}, miss_time = {};
+};
+
+// Keeps imported host ranges registered with the driver, for callers that repeatedly
+// import the same buffers. Maps are shared between users of a range, and refcounted.
+class VaCache {
+    public:
+        VaCache() = default;
+        VaCache(const VaCache &) = delete;
+        VaCache &operator =(const VaCache &) = delete;
+
+        Map *acquire(void *mem, std::size_t size, std::size_t align, EnvideoMapFlags flags);
+        void insert(Map *map, void *mem, std::size_t size, std::size_t align);
+        bool release(Map *map);
+        int  unregister(void *mem, std::size_t size);
+
+        int  set_limit(std::size_t max_bytes);
+
+        bool enabled() const {
+            return this->limit != 0;
+        }
+
+    private:
+        struct Entry {
+            Map            *map;
+            std::uintptr_t  start;
+            std::size_t     size, align;
+            EnvideoMapFlags flags;
+        };
+
+        int trim_locked(std::size_t max_bytes);
+        static int destroy(Map *map);
+
+    private:
+        std::mutex lock;
+
+        // Most recently used ranges are at the front
+        std::list<Entry> entries;
+
+        std::atomic_size_t limit = 0;
+        std::size_t        bytes = 0;
+};
+
+// Objects whose destruction is deferred until the gpu is done accessing them
+class RetireList {
+    public:
+        constexpr static std::uint64_t wait_timeout_us = 1'000'000;
+
+        struct Entry {
+            enum class Kind {
+                Map,
+                Cmdbuf,
+                Channel,
+            };
+
+            Kind  kind;
+            void *object;
+            Fence fence;
+        };
+
+    public:
+        void add(Map     *map,     Fence fence);
+        void add(Cmdbuf  *cmdbuf,  Fence fence);
+        void add(Channel *channel, Fence fence);
+
+        // Releases the entries whose fence has signaled
+        int  reap(Device &device);
+        // Waits for the entries depending on channel, those whose wait fails are kept
+        int  reap_channel(Device &device, Channel *channel);
+        // Waits for all entries, and releases them regardless of the outcome
+        int  drain(Device &device);
+
+        bool empty() const {
+            return this->count == 0;
+        }
+
+    private:
+        enum class Mode {
+            Poll,
+            Wait,
+            Drain,
+        };
+
+        void add(Entry::Kind kind, void *object, Fence fence);
+        int collect(Device &device, Mode mode, const std::function<bool(const Entry &)> &pred);
+        int destroy(const Entry &entry);
+
+    private:
+        std::mutex lock;
+        std::vector<Entry> entries;
+        std::size_t        busy  = 0;    // Entries taken out of the list while their fence is checked
+        std::atomic_size_t count = 0;
+};
+
+// Live allocations of a device, and the budget they are subject to
+class MemoryTracker {
+    public:
+        MemoryTracker() = default;
+        MemoryTracker(const MemoryTracker &) = delete;
+        MemoryTracker &operator =(const MemoryTracker &) = delete;
+
+        // Returns false if the allocation would exceed the budget
+        bool charge(std::size_t size, EnvideoMapFlags flags);
+        void uncharge(std::size_t size, EnvideoMapFlags flags);
+        void uncharge(const Map &map);
+        // Corrects a charge once the actual size of the allocation is known
+        void recharge(std::size_t charged, std::size_t size, EnvideoMapFlags flags);
+
+        // Amount by which an allocation of the given size would exceed the budget
+        std::size_t excess(std::size_t size);
+
+        void set_budget(std::size_t budget);
+        EnvideoMemoryStats get_stats();
+
+    private:
+        void update(std::int64_t size, std::int64_t count, EnvideoMapFlags flags);
+
+    private:
+        std::mutex lock;
+
+        std::size_t        budget = 0;
+        EnvideoMemoryStats stats  = {};
+};
+
 class Device {
     public:
         virtual    ~Device()                                           = default;
@@ -78,6 +251,28 @@ class Device {
 
         virtual const Map *get_semaphore_map() const = 0;
 
+        // Performs cache maintenance over several ranges, in as few driver calls as possible
+        virtual int cache_op_batch(const std::vector<CacheRange> &ranges, EnvideoCacheFlags flags);
+
+        // Pins every map to every channel, batching driver calls where possible
+        virtual int pin_batch(const std::vector<Map *> &maps, const std::vector<Channel *> &channels);
+
+        // Dedicated memory of the device in bytes, zero if there is none
+        virtual int get_vram_info(std::uint64_t &total, std::uint64_t &free);
+
+        // Asynchronous copy engine instances channels can be bound to
+        virtual int get_copy_instances(std::uint32_t &count) {
+            count = 1;
+            return 0;
+        }
+
+        // Gpu address space allocated by the library, zero if the driver manages it
+        virtual int get_va_info(std::uint64_t &total, std::uint64_t &used, std::uint64_t &largest_free);
+
+        // Defers translation cache invalidations until the outermost batch ends
+        virtual int begin_map_batch() { return 0; }
+        virtual int end_map_batch()   { return 0; }
+
     public:
         std::uint32_t page_size = 0;
 
@@ -87,8 +282,14 @@ class Device {
         NvjpgVersion nvjpg_version = NvjpgVersion::None;
 
         bool tegra_layout = false;
+        int  numa_node    = -1;
         bool vp8_unsupported = false, vp9_unsupported  = false, vp9_high_depth_unsupported = false,
             h264_unsupported = false, hevc_unsupported = false, av1_unsupported            = false;
+
+        MapCache      map_cache;
+        VaCache       va_cache;
+        RetireList    retired;
+        MemoryTracker memory;
 };
 
 class Channel {
@@ -114,6 +315,7 @@ class Channel {
         Device       *device = nullptr;
         EnvideoEngine engine;
         Type          type;
+        std::uint32_t instance = 0;     // Among the asynchronous instances of the engine
 
         float         dfs_framerate         = 0.0;
         double        dfs_decode_cycles_ema = 0.0;
@@ -135,8 +337,55 @@ class Map {
         virtual int pin(envid::Channel *channel)                                   = 0;
         virtual int cache_op(std::size_t offset, std::size_t len,
                              EnvideoCacheFlags flags)                              = 0;
+        virtual int map_cpu()                                                      = 0;
+        virtual int unmap_cpu()                                                    = 0;
+        virtual int import_dmabuf(int fd, std::size_t size)                        = 0;
+        virtual int export_dmabuf(int &fd)                                         = 0;
 
     public:
+        // Returns the cpu address, establishing the mapping if it was deferred or dropped
+        int get_cpu_addr(void *&addr) {
+            addr = std::atomic_ref(this->cpu_addr).load(std::memory_order_acquire);
+            if (addr || ENVIDEO_MAP_GET_CPU_FLAGS(this->flags) == EnvideoMap_CpuUnmapped)
+                return 0;
+
+            std::scoped_lock lk(this->cpu_lock);
+            if (!this->cpu_addr)
+                ENVID_CHECK(this->map_cpu());
+
+            addr = this->cpu_addr;
+            return 0;
+        }
+
+        // Command buffers write through the mapping, it can't be dropped while one of them uses the map
+        int drop_cpu_addr() {
+            std::scoped_lock lk(this->cpu_lock);
+            if (this->cmdbuf_refs)
+                return ENVIDEO_RC_SYSTEM(EBUSY);
+
+            return this->cpu_addr ? this->unmap_cpu() : 0;
+        }
+
+        void ref_cmdbuf() {
+            std::scoped_lock lk(this->cpu_lock);
+            ++this->cmdbuf_refs;
+        }
+
+        void unref_cmdbuf() {
+            std::scoped_lock lk(this->cpu_lock);
+            --this->cmdbuf_refs;
+        }
+
+        bool has_cmdbuf_refs() {
+            std::scoped_lock lk(this->cpu_lock);
+            return this->cmdbuf_refs != 0;
+        }
+
+        // Dirty ranges are only tracked for cpu-cacheable maps
+        void mark_dirty(std::size_t offset, std::size_t len);
+        void clear_dirty(std::size_t offset, std::size_t len);
+        void take_dirty(std::vector<CacheRange> &ranges);
+
         std::uint64_t find_pin(Channel *channel) const {
             auto res = std::ranges::find_if(this->pins,
                 [channel](auto &p) { return p.first == channel; });
@@ -156,11 +405,48 @@ class Map {
         bool          own_mem  = true;
         std::uint32_t handle   = 0;
         std::size_t   size     = 0;
+
+        // Parent allocation for sub-allocated maps, and offset of this map
+        // within the memory object referenced by the handle
+        Map          *parent        = nullptr;
+        std::size_t   handle_offset = 0;
+
+        // Parameters the map was created with, zero if it can't be recycled
+        std::size_t   alloc_size  = 0,
+                      alloc_align = 0;
+
+        // Users of a map shared through the va cache, zero if it isn't
+        std::uint32_t va_refs = 0;
+
         void         *cpu_addr = nullptr;
         std::uint64_t gpu_addr_pitch = 0,
             gpu_addr_block = 0;
 
+        // Size of the gpu pages backing the allocation, zero if unknown
+        std::size_t   page_size = 0;
+
+        // Cpu mapping of an imported buffer, when it was imported through it
+        void         *import_addr = nullptr;
+        std::size_t   import_size = 0;
+
         std::vector<std::pair<envid::Channel *, std::uint64_t>> pins;
+
+    protected:
+        // Backends publish the mapping through this, get_cpu_addr reading it without the lock
+        void set_cpu_addr(void *addr) {
+            std::atomic_ref(this->cpu_addr).store(addr, std::memory_order_release);
+        }
+
+    private:
+        constexpr static std::size_t max_dirty_ranges = 16;
+
+        util::CopyableMutex cpu_lock, dirty_lock;
+
+        // Command buffers the map was added to as memory
+        std::uint32_t cmdbuf_refs = 0;
+
+        // Cpu-written ranges pending writeback, as sorted and disjoint [begin, end) intervals
+        std::vector<std::pair<std::size_t, std::size_t>> dirty;
 };
 
 class Cmdbuf {
@@ -190,11 +476,54 @@ class Cmdbuf {
             return this->cur_word - this->words();
         }
 
+        std::size_t free_words() const {
+            return this->mem_size / sizeof(std::uint32_t) - this->num_words();
+        }
+
+        void add_reference(const Map *map) {
+            if (std::ranges::find(this->references, map) == this->references.end())
+                this->references.emplace_back(map);
+        }
+
+        void mark_written(const Map *map, std::size_t offset, std::size_t len) {
+            this->written.emplace_back(const_cast<Map *>(map), offset, len);
+        }
+
+        // Moves tracking from one map object to another, e.g. once its storage was handed over
+        void retarget(const Map *from, const Map *to) {
+            std::ranges::replace(this->references, from, to);
+            for (auto &w: this->written) {
+                if (w.map == from)
+                    w.map = const_cast<Map *>(to);
+            }
+        }
+
+        void reset_tracking() {
+            this->references.clear();
+            this->written.clear();
+        }
+
+        // Lets the cpu mapping of the memory be dropped again, maps must outlive the command buffers using them
+        void release_memory() {
+            if (this->map)
+                const_cast<Map *>(this->map)->unref_cmdbuf();
+            this->map = nullptr;
+        }
+
+        // Writes back the dirty ranges of referenced maps, and invalidates ranges written by engines
+        int flush_dirty();
+        int invalidate_written();
+
     public:
+        Channel       *channel    = nullptr;    // Channel the command buffer was created on
         const Map     *map        = nullptr;
         std::uint32_t  mem_offset = 0,
                        mem_size   = 0;
 
+        // Maps referenced by relocations, and ranges engines were declared to write to
+        std::vector<const Map *> references;
+        std::vector<CacheRange>  written;
+
     protected:
         EnvideoEngine  cur_engine;
         std::uint32_t *cur_word   = 0;
@@ -227,6 +556,33 @@ constexpr inline std::uint32_t engine_to_host1x_class_id(EnvideoEngine engine) {
     }
 }
 
+int host_alloc(Device &device, void *&mem, std::size_t &size, EnvideoMapFlags flags, std::size_t &page_size);
+int host_free(Device &device, void *mem, std::size_t size);
+
+// Releases a channel without waiting on retired objects
+int destroy_channel(Channel *channel);
+
+int create_maps(Device &device, std::size_t count, const std::size_t *sizes, EnvideoMapFlags flags, EnvideoMap **maps);
+
+// Numa node of a pci device, or -1 if unknown
+int get_pci_numa_node(std::uint32_t domain, std::uint32_t bus, std::uint32_t slot, std::uint32_t function);
+int bind_numa_node(void *mem, std::size_t size, int node);
+
+// Steers the kernel allocations of the calling thread towards a numa node, for the lifetime of the object
+class NumaScope {
+    public:
+        NumaScope(int node);
+        ~NumaScope();
+
+        NumaScope(const NumaScope &) = delete;
+        NumaScope &operator =(const NumaScope &) = delete;
+
+    private:
+        bool          active = false;
+        int           prev_mode = 0;
+        unsigned long prev_mask[16] = {};
+};
+
 NvdecVersion get_nvdec_version(int cl);
 int get_decode_constraints(EnvideoDevice *device, EnvideoDecodeConstraints *constraints);
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <errno.h>
+
+#include <nvmisc.h>
+#include <clc7b5.h>
+
+#include "util.hpp"
+#include "copy.hpp"
+
+namespace envid {
+
+namespace {
+
+// Length of the lines of 2D launches, in elements.
+// Large ranges are covered by a single multi-line launch, side-stepping the 32-bit line length.
+constexpr std::size_t line_elements = util::bit(std::size_t(16));
+
+struct Segment {
+    std::size_t   dst_offset, src_offset;
+    std::size_t   count;
+    std::uint32_t elem_size;
+};
+
+// Splits a run of elements into whole lines and a remainder
+void split_lines(std::vector<Segment> &segments, std::size_t dst_offset, std::size_t src_offset,
+                 std::size_t count, std::uint32_t elem_size)
+{
+    if (auto lines = count / line_elements; lines) {
+        auto len = lines * line_elements;
+        segments.emplace_back(dst_offset, src_offset, len, elem_size);
+        dst_offset += len * elem_size, src_offset += len * elem_size, count -= len;
+    }
+
+    if (count)
+        segments.emplace_back(dst_offset, src_offset, count, elem_size);
+}
+
+constexpr std::uint32_t remap_component_size(std::uint32_t size) {
+    switch (size) {
+        case 1:  return DRF_DEF(C7B5, _SET_REMAP_COMPONENTS, _COMPONENT_SIZE, _ONE);
+        case 2:  return DRF_DEF(C7B5, _SET_REMAP_COMPONENTS, _COMPONENT_SIZE, _TWO);
+        default: return DRF_DEF(C7B5, _SET_REMAP_COMPONENTS, _COMPONENT_SIZE, _FOUR);
+    }
+}
+
+std::size_t segment_lines(const Segment &s) {
+    return std::max(s.count / line_elements, std::size_t(1));
+}
+
+// Relocation offsets and line counts are 32-bit. Checked for all segments before anything is recorded,
+// so that a rejected range never leaves the command buffer with a partial entry.
+bool is_valid_segments(const std::vector<Segment> &segments) {
+    return std::ranges::all_of(segments, [](auto &s) {
+        return s.dst_offset <= UINT32_MAX && s.src_offset <= UINT32_MAX && segment_lines(s) <= UINT32_MAX;
+    });
+}
+
+// Only the first launch waits for previous work, and only the last one flushes.
+// Without a source, the destination is filled with the low bytes of the constant.
+int launch(Cmdbuf &cmdbuf, const Map *dst, const Map *src, const std::vector<Segment> &segments,
+           std::uint32_t constant = 0)
+{
+    for (std::size_t i = 0; i < segments.size(); ++i) {
+        auto &s = segments[i];
+
+        auto lines = segment_lines(s);
+        auto len   = (lines > 1) ? line_elements : s.count;
+        auto pitch = len * s.elem_size;
+
+        if (src)
+            ENVID_CHECK(cmdbuf.push_reloc(NVC7B5_OFFSET_IN_UPPER, src, s.src_offset, EnvideoRelocType_Pitch, 0));
+        ENVID_CHECK(cmdbuf.push_reloc(NVC7B5_OFFSET_OUT_UPPER, dst, s.dst_offset, EnvideoRelocType_Pitch, 0));
+
+        if (!src) {
+            ENVID_CHECK(cmdbuf.push_value(NVC7B5_SET_REMAP_CONST_A, constant));
+            ENVID_CHECK(cmdbuf.push_value(NVC7B5_SET_REMAP_COMPONENTS,
+                DRF_DEF(C7B5, _SET_REMAP_COMPONENTS, _DST_X,              _CONST_A) |
+                DRF_DEF(C7B5, _SET_REMAP_COMPONENTS, _NUM_DST_COMPONENTS, _ONE)     |
+                remap_component_size(s.elem_size)));
+        }
+
+        if (lines > 1) {
+            ENVID_CHECK(cmdbuf.push_value(NVC7B5_PITCH_IN,  pitch));
+            ENVID_CHECK(cmdbuf.push_value(NVC7B5_PITCH_OUT, pitch));
+            ENVID_CHECK(cmdbuf.push_value(NVC7B5_LINE_COUNT, lines));
+        }
+
+        ENVID_CHECK(cmdbuf.push_value(NVC7B5_LINE_LENGTH_IN, len));
+
+        ENVID_CHECK(cmdbuf.push_value(NVC7B5_LAUNCH_DMA,
+            ((i == 0)                   ? DRF_DEF(C7B5, _LAUNCH_DMA, _DATA_TRANSFER_TYPE, _NON_PIPELINED) :
+                                          DRF_DEF(C7B5, _LAUNCH_DMA, _DATA_TRANSFER_TYPE, _PIPELINED))    |
+            ((i == segments.size() - 1) ? DRF_DEF(C7B5, _LAUNCH_DMA, _FLUSH_ENABLE,       _TRUE)          :
+                                          DRF_DEF(C7B5, _LAUNCH_DMA, _FLUSH_ENABLE,       _FALSE))        |
+            ((lines > 1)                ? DRF_DEF(C7B5, _LAUNCH_DMA, _MULTI_LINE_ENABLE,  _TRUE)          :
+                                          DRF_DEF(C7B5, _LAUNCH_DMA, _MULTI_LINE_ENABLE,  _FALSE))        |
+            (!src                       ? DRF_DEF(C7B5, _LAUNCH_DMA, _REMAP_ENABLE,       _TRUE)          :
+                                          DRF_DEF(C7B5, _LAUNCH_DMA, _REMAP_ENABLE,       _FALSE))        |
+            DRF_DEF(C7B5, _LAUNCH_DMA, _SRC_MEMORY_LAYOUT, _PITCH)                                        |
+            DRF_DEF(C7B5, _LAUNCH_DMA, _DST_MEMORY_LAYOUT, _PITCH)                                        |
+            DRF_DEF(C7B5, _LAUNCH_DMA, _SRC_TYPE,          _VIRTUAL)                                      |
+            DRF_DEF(C7B5, _LAUNCH_DMA, _DST_TYPE,          _VIRTUAL)));
+    }
+
+    return 0;
+}
+
+} // namespace
+
+int copy_linear(Cmdbuf &cmdbuf, const Map *dst, std::size_t dst_offset,
+                const Map *src, std::size_t src_offset, std::size_t len)
+{
+    if (!dst || !src || !len || dst_offset + len > dst->size || src_offset + len > src->size)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    std::vector<Segment> segments;
+    split_lines(segments, dst_offset, src_offset, len, 1);
+    if (!is_valid_segments(segments))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    ENVID_CHECK(launch(cmdbuf, dst, src, segments));
+    ENVID_CHECK(cmdbuf.end());
+
+    // Only declared once recorded, a failed launch leaves no written range behind
+    cmdbuf.mark_written(dst, dst_offset, len);
+    return 0;
+}
+
+int fill_linear(Cmdbuf &cmdbuf, const Map *dst, std::size_t dst_offset, std::size_t len,
+                std::uint32_t pattern, std::uint32_t pattern_size)
+{
+    if (!dst || !len || dst_offset + len > dst->size)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // The range must hold whole patterns, so that every element receives the same value
+    if ((pattern_size != 1 && pattern_size != 2 && pattern_size != 4) ||
+            (dst_offset % pattern_size) || (len % pattern_size))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // Replicate the pattern over 32 bits
+    for (auto size = pattern_size; size < 4; size *= 2)
+        pattern = (pattern & util::mask(size * 8)) | (pattern << (size * 8));
+
+    // Use the pattern size for the unaligned head and tail, and 4-byte components for the body
+    auto start = dst_offset, end = dst_offset + len;
+    auto body_start = std::min(util::align_up  (start, std::size_t(4)), end),
+         body_end   = std::max(util::align_down(end,   std::size_t(4)), body_start);
+
+    std::vector<Segment> segments;
+    if (body_start > start)
+        segments.emplace_back(start, 0, (body_start - start) / pattern_size, pattern_size);
+    if (body_end > body_start)
+        split_lines(segments, body_start, 0, (body_end - body_start) / 4, 4);
+    if (end > body_end)
+        segments.emplace_back(body_end, 0, (end - body_end) / pattern_size, pattern_size);
+
+    if (!is_valid_segments(segments))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    ENVID_CHECK(launch(cmdbuf, dst, nullptr, segments, pattern));
+    ENVID_CHECK(cmdbuf.end());
+
+    // Only declared once recorded, a failed launch leaves no written range behind
+    cmdbuf.mark_written(dst, dst_offset, len);
+    return 0;
+}
+
+} // namespace envid
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <envideo.h>
+
+#include "common.hpp"
+
+namespace envid {
+
+// Records a linear copy of len bytes between two maps on the copy engine
+int copy_linear(Cmdbuf &cmdbuf, const Map *dst, std::size_t dst_offset,
+                const Map *src, std::size_t src_offset, std::size_t len);
+
+// Records a fill of len bytes with a repeating 1, 2 or 4-byte pattern on the copy engine
+int fill_linear(Cmdbuf &cmdbuf, const Map *dst, std::size_t dst_offset, std::size_t len,
+                std::uint32_t pattern, std::uint32_t pattern_size);
+
+} // namespace envid
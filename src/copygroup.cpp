@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include <errno.h>
+
+#include "util.hpp"
+#include "transfer.hpp"
+
+namespace envid {
+
+namespace {
+
+constexpr std::uint64_t lane_timeout_us = 5'000'000;
+constexpr std::uint32_t cmdbuf_size     = 0x4000;
+
+// Bands of block-linear surfaces must start on a block boundary
+std::uint32_t band_alignment(const EnvideoSurfaceInfo &s) {
+    return s.tiled ? 8u * s.gob_height : 1u;
+}
+
+// A block row spans stride * block height bytes, so aligned rows are located the same way in both layouts
+EnvideoSurfaceInfo make_band(const EnvideoSurfaceInfo &s, std::uint32_t y, std::uint32_t rows) {
+    auto band = s;
+    band.map_offset += y * s.stride;
+    band.height      = rows;
+    return band;
+}
+
+} // namespace
+
+int CopyGroup::initialize(std::uint32_t num_channels) {
+    std::scoped_lock lk(this->lock);
+
+    auto *dev = reinterpret_cast<EnvideoDevice *>(this->device);
+
+    std::uint32_t num_instances;
+    ENVID_CHECK(this->device->get_copy_instances(num_instances));
+
+    if (!num_channels)
+        num_channels = num_instances;
+    if (num_channels > num_instances)
+        return ENVIDEO_RC_SYSTEM(ENODEV);
+
+    for (std::uint32_t i = 0; i < num_channels; ++i) {
+        auto &lane = this->lanes.emplace_back();
+        ENVID_CHECK(envideo_channel_create_instance(dev, &lane.channel, EnvideoEngine_Copy, i));
+        ENVID_CHECK(envideo_map_create(dev, &lane.cmdbuf_map, cmdbuf_size, this->device->page_size,
+            static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuUncacheable |
+                                         EnvideoMap_LocationHost    | EnvideoMap_UsageCmdbuf)));
+        ENVID_CHECK(envideo_map_pin(lane.cmdbuf_map, lane.channel));
+        ENVID_CHECK(envideo_cmdbuf_create(lane.channel, &lane.cmdbuf));
+        ENVID_CHECK(envideo_cmdbuf_add_memory(lane.cmdbuf, lane.cmdbuf_map, 0, cmdbuf_size));
+    }
+
+    this->num_splits = num_channels;
+    return 0;
+}
+
+int CopyGroup::finalize() {
+    std::scoped_lock lk(this->lock);
+
+    int rc = 0;
+    auto check = [&rc](int res) {
+        if (res && !rc)
+            rc = res;
+    };
+
+    for (auto &lane: this->lanes) {
+        if (lane.fence)
+            check(this->device->wait(lane.fence, lane_timeout_us));
+        if (lane.cmdbuf)
+            check(envideo_cmdbuf_destroy(lane.cmdbuf));
+        if (lane.cmdbuf_map)
+            check(envideo_map_destroy(lane.cmdbuf_map));
+        if (lane.channel)
+            check(envideo_channel_destroy(lane.channel));
+    }
+
+    this->lanes.clear();
+    return rc;
+}
+
+int CopyGroup::set_splits(std::uint32_t num_splits) {
+    std::scoped_lock lk(this->lock);
+
+    if (!num_splits || num_splits > this->lanes.size())
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    this->num_splits = num_splits;
+    return 0;
+}
+
+int CopyGroup::transfer(const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst, Fence &fence) {
+    std::scoped_lock lk(this->lock);
+    return this->transfer_locked(src, dst, fence);
+}
+
+int CopyGroup::prepare(Lane &lane, const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst) {
+    // The cmdbuf of the lane is only recycled once its previous submission has retired
+    if (lane.fence) {
+        ENVID_CHECK(this->device->wait(lane.fence, lane_timeout_us));
+        lane.fence = 0;
+    }
+
+    ENVID_CHECK(envideo_cmdbuf_clear(lane.cmdbuf));
+    ENVID_CHECK(envideo_map_pin(src.map, lane.channel));
+    return envideo_map_pin(dst.map, lane.channel);
+}
+
+int CopyGroup::transfer_locked(const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst, Fence &fence) {
+    // Validated upfront, band sizes are derived from the row count
+    if (!is_valid_surface(src) || !is_valid_surface(dst))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto rows  = std::min(src.height, dst.height);
+    if (!rows)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto align = std::max(band_alignment(src), band_alignment(dst));
+
+    // Split in bands of whole blocks, there might be fewer bands than requested for short surfaces
+    auto band_rows = util::align_up((rows + this->num_splits - 1) / this->num_splits, align);
+    auto num_bands = std::max((rows + band_rows - 1) / band_rows, 1u);
+
+    // Submit all bands but the first, which then waits for the others to produce the combined fence
+    std::vector<Fence> fences;
+    for (std::uint32_t i = 1; i < num_bands; ++i) {
+        auto &lane = this->lanes[i];
+        auto *cmdbuf = reinterpret_cast<Cmdbuf *>(lane.cmdbuf);
+
+        auto y = i * band_rows, h = std::min(band_rows, rows - y);
+
+        ENVID_CHECK(this->prepare(lane, src, dst));
+        ENVID_CHECK(transfer_surface(*cmdbuf, make_band(src, y, h), make_band(dst, y, h)));
+        ENVID_CHECK(cmdbuf->begin(EnvideoEngine_Host));
+        ENVID_CHECK(cmdbuf->cache_op(EnvideoCache_Writeback));
+        ENVID_CHECK(cmdbuf->end());
+
+        ENVID_CHECK(envideo_channel_submit(lane.channel, lane.cmdbuf, &lane.fence));
+        fences.emplace_back(lane.fence);
+    }
+
+    auto &lane = this->lanes[0];
+    auto *cmdbuf = reinterpret_cast<Cmdbuf *>(lane.cmdbuf);
+
+    ENVID_CHECK(this->prepare(lane, src, dst));
+    ENVID_CHECK(transfer_surface(*cmdbuf, make_band(src, 0, std::min(band_rows, rows)),
+                                          make_band(dst, 0, std::min(band_rows, rows))));
+    ENVID_CHECK(cmdbuf->begin(EnvideoEngine_Host));
+    ENVID_CHECK(cmdbuf->cache_op(EnvideoCache_Writeback));
+    for (auto f: fences)
+        ENVID_CHECK(cmdbuf->wait_fence(f));
+    ENVID_CHECK(cmdbuf->end());
+
+    ENVID_CHECK(envideo_channel_submit(lane.channel, lane.cmdbuf, &lane.fence));
+    fence = lane.fence;
+
+    return 0;
+}
+
+int CopyGroup::tune(std::uint32_t &num_splits) {
+    std::scoped_lock lk(this->lock);
+
+    auto *dev = reinterpret_cast<EnvideoDevice *>(this->device);
+
+    // Readback of a decoded frame: block-linear in device memory, to pitch in host memory
+    auto size = std::size_t(CopyGroup::tune_width) * CopyGroup::tune_height;
+
+    EnvideoMap *src, *dst;
+    ENVID_CHECK(envideo_map_create(dev, &src, size, this->device->page_size,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuUnmapped    | EnvideoMap_GpuCacheable |
+                                     EnvideoMap_LocationDevice | EnvideoMap_UsageFramebuffer)));
+    ENVID_SCOPEGUARD([src] { envideo_map_destroy(src); });
+
+    ENVID_CHECK(envideo_map_create(dev, &dst, size, this->device->page_size,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable   | EnvideoMap_GpuCacheable |
+                                     EnvideoMap_LocationHost   | EnvideoMap_UsageFramebuffer)));
+    ENVID_SCOPEGUARD([dst] { envideo_map_destroy(dst); });
+
+    EnvideoSurfaceInfo src_info = {
+        .map        = src,
+        .width      = CopyGroup::tune_width,
+        .height     = CopyGroup::tune_height,
+        .stride     = CopyGroup::tune_width,
+        .tiled      = true,
+        .gob_height = 2,
+    }, dst_info = {
+        .map        = dst,
+        .width      = CopyGroup::tune_width,
+        .height     = CopyGroup::tune_height,
+        .stride     = CopyGroup::tune_width,
+    };
+
+    auto best_splits = 1u;
+    auto best_time   = std::chrono::steady_clock::duration::max();
+
+    for (std::uint32_t splits = 1; splits <= this->lanes.size(); ++splits) {
+        this->num_splits = splits;
+
+        // The first iteration warms up the pins and the engines
+        Fence fence;
+        ENVID_CHECK(this->transfer_locked(src_info, dst_info, fence));
+        ENVID_CHECK(this->device->wait(fence, lane_timeout_us));
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::uint32_t i = 0; i < CopyGroup::tune_iterations; ++i) {
+            ENVID_CHECK(this->transfer_locked(src_info, dst_info, fence));
+            ENVID_CHECK(this->device->wait(fence, lane_timeout_us));
+        }
+
+        if (auto time = std::chrono::steady_clock::now() - start; time < best_time)
+            best_splits = splits, best_time = time;
+    }
+
+    // Lanes must be idle before the maps go away
+    for (auto &lane: this->lanes) {
+        if (lane.fence)
+            ENVID_CHECK(this->device->wait(lane.fence, lane_timeout_us));
+        lane.fence = 0;
+    }
+
+    num_splits = this->num_splits = best_splits;
+    return 0;
+}
+
+} // namespace envid
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iterator>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+int Device::cache_op_batch(const std::vector<CacheRange> &ranges, EnvideoCacheFlags flags) {
+    for (auto &r: ranges) {
+        // Cache maintenance goes through the cpu mapping on some platforms
+        void *addr;
+        ENVID_CHECK(r.map->get_cpu_addr(addr));
+        ENVID_CHECK(r.map->cache_op(r.offset, r.len, flags));
+    }
+
+    return 0;
+}
+
+void Map::mark_dirty(std::size_t offset, std::size_t len) {
+    if (ENVIDEO_MAP_GET_CPU_FLAGS(this->flags) != EnvideoMap_CpuCacheable || offset >= this->size || !len)
+        return;
+
+    auto begin = offset, end = offset + std::min(len, this->size - offset);
+
+    std::scoped_lock lk(this->dirty_lock);
+
+    // Absorb all intervals overlapping or adjacent to the new one
+    auto first = std::ranges::lower_bound(this->dirty, begin, {}, [](auto &r) { return r.second; });
+    auto last  = std::upper_bound(first, this->dirty.end(), end, [](auto v, auto &r) { return v < r.first; });
+    if (first != last) {
+        begin = std::min(begin, first->first);
+        end   = std::max(end, std::prev(last)->second);
+    }
+
+    auto it = this->dirty.erase(first, last);
+    this->dirty.emplace(it, begin, end);
+
+    // Bound the bookkeeping by merging the intervals separated by the smallest gap
+    while (this->dirty.size() > Map::max_dirty_ranges) {
+        auto best = this->dirty.begin();
+        for (auto i = this->dirty.begin(); i + 1 != this->dirty.end(); ++i) {
+            if ((i + 1)->first - i->second < (best + 1)->first - best->second)
+                best = i;
+        }
+
+        best->second = (best + 1)->second;
+        this->dirty.erase(best + 1);
+    }
+}
+
+void Map::clear_dirty(std::size_t offset, std::size_t len) {
+    if (!len)
+        return;
+
+    auto begin = offset, end = offset + std::min(len, SIZE_MAX - offset);
+
+    std::scoped_lock lk(this->dirty_lock);
+
+    decltype(this->dirty) res;
+    for (auto [b, e]: this->dirty) {
+        if (e <= begin || b >= end) {
+            res.emplace_back(b, e);
+            continue;
+        }
+
+        if (b < begin)
+            res.emplace_back(b, begin);
+        if (e > end)
+            res.emplace_back(end, e);
+    }
+
+    this->dirty = std::move(res);
+}
+
+void Map::take_dirty(std::vector<CacheRange> &ranges) {
+    std::scoped_lock lk(this->dirty_lock);
+
+    for (auto [b, e]: this->dirty)
+        ranges.emplace_back(this, b, e - b);
+
+    this->dirty.clear();
+}
+
+int Cmdbuf::flush_dirty() {
+    std::vector<CacheRange> ranges;
+    for (auto *map: this->references)
+        const_cast<Map *>(map)->take_dirty(ranges);
+
+    if (ranges.empty())
+        return 0;
+
+    auto rc = ranges.front().map->device->cache_op_batch(ranges, EnvideoCache_Writeback);
+    if (rc) {
+        // Keep the ranges around for a later attempt
+        for (auto &r: ranges)
+            r.map->mark_dirty(r.offset, r.len);
+    }
+
+    return rc;
+}
+
+int Cmdbuf::invalidate_written() {
+    std::vector<CacheRange> ranges;
+    for (auto &w: this->written) {
+        if (ENVIDEO_MAP_GET_CPU_FLAGS(w.map->flags) == EnvideoMap_CpuCacheable && w.len)
+            ranges.emplace_back(w);
+    }
+
+    // Coalesce overlapping and adjacent ranges of the same map
+    std::ranges::sort(ranges, [](auto &a, auto &b) {
+        return (a.map != b.map) ? std::less{}(a.map, b.map) : a.offset < b.offset;
+    });
+
+    std::vector<CacheRange> merged;
+    for (auto &r: ranges) {
+        if (!merged.empty()) {
+            auto &last = merged.back();
+            if (last.map == r.map && r.offset <= last.offset + last.len) {
+                last.len = std::max(last.offset + last.len, r.offset + r.len) - last.offset;
+                continue;
+            }
+        }
+
+        merged.emplace_back(r);
+    }
+
+    if (!merged.empty())
+        ENVID_CHECK(merged.front().map->device->cache_op_batch(merged, EnvideoCache_Invalidate));
+
+    this->written.clear();
+    return 0;
+}
+
+} // namespace envid
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <errno.h>
+
+#include "util.hpp"
+#include "surface.hpp"
+#include "transfer.hpp"
+
+namespace envid {
+
+namespace {
+
+// Interval at which completion is checked once the timeout has expired, and how long to keep checking
+constexpr std::uint64_t wait_slice_us = 100'000;
+constexpr std::uint32_t max_slices    = 50;
+
+constexpr auto download_map_flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                                                 EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+// Rows of a plane staged through the bounce map, and copied to their destination by the cpu
+struct Fixup {
+    std::uint8_t  *dst;
+    std::uint32_t  linesize;
+    std::size_t    bounce_offset;
+    std::uint32_t  bounce_stride;
+    std::uint32_t  width, rows;
+};
+
+} // namespace
+
+int download_frame(Channel &channel, Cmdbuf &cmdbuf, EnvideoSurfaceFormat format, int depth,
+                   std::uint32_t width, std::uint32_t height, const EnvideoSurfaceInfo *src_planes,
+                   void *const *dst, const std::uint32_t *dst_linesizes, std::uint64_t timeout_us)
+{
+    auto desc = get_format_desc(format);
+    if (!desc.num_planes || !is_valid_depth(depth) || !width || !height)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto *dev  = reinterpret_cast<EnvideoDevice  *>(channel.device);
+    auto *chan = reinterpret_cast<EnvideoChannel *>(&channel);
+    auto page_size = std::uintptr_t(channel.device->page_size);
+
+    // Maps are only released once the engine is done with them
+    Fence fence = 0;
+    std::vector<EnvideoMap *> maps;
+    auto guard = util::ScopeGuard([&] {
+        for (auto *m: maps)
+            envideo_map_destroy_deferred(m, fence);
+    });
+
+    EnvideoSurfaceTransfer transfers[ENVIDEO_MAX_PLANES * 3];
+    std::uint32_t num_transfers = 0;
+
+    Fixup fixups[ENVIDEO_MAX_PLANES * 2];
+    std::uint32_t num_fixups = 0;
+    std::size_t bounce_size = 0;
+
+    for (std::uint32_t i = 0; i < desc.num_planes; ++i) {
+        auto src = src_planes[i];
+        get_plane_size(desc.planes[i], depth, width, height, src.width, src.height);
+
+        auto linesize = dst_linesizes[i];
+        if (!dst[i] || linesize < src.width)
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+
+        // The engine writes the rows lying within the aligned interior of the plane, the cpu takes the others
+        auto base  = reinterpret_cast<std::uintptr_t>(dst[i]);
+        auto end   = base + std::uintptr_t(linesize) * (src.height - 1) + src.width;
+        auto lo    = util::align_up  (base, std::uintptr_t(ENVIDEO_MAP_ALIGN));
+        auto hi    = util::align_down(end,  std::uintptr_t(ENVIDEO_MAP_ALIGN));
+
+        auto first = std::min<std::uintptr_t>((lo - base + linesize - 1) / linesize, src.height);
+        auto last  = (hi >= base + src.width) ? std::min<std::uintptr_t>((hi - base - src.width) / linesize + 1,
+                                                                          src.height) : 0;
+        if (last < first)
+            last = first;
+
+        auto add_fixup = [&](std::uint32_t y, std::uint32_t rows) {
+            if (!rows)
+                return;
+
+            auto stride = util::align_up(src.width, 64u);
+            fixups[num_fixups++] = {
+                .dst           = reinterpret_cast<std::uint8_t *>(base + std::uintptr_t(linesize) * y),
+                .linesize      = linesize,
+                .bounce_offset = bounce_size,
+                .bounce_stride = stride,
+                .width         = src.width,
+                .rows          = rows,
+            };
+
+            auto s = src;
+            s.y += y, s.height = rows;
+            transfers[num_transfers++] = {
+                .src = s,
+                .dst = {
+                    .map_offset = static_cast<std::uint32_t>(bounce_size),
+                    .width      = src.width,
+                    .height     = rows,
+                    .stride     = stride,
+                },
+            };
+
+            bounce_size = util::align_up(bounce_size + std::size_t(stride) * rows, std::size_t(ENVIDEO_MAP_ALIGN));
+        };
+
+        add_fixup(0, first);
+
+        if (first < last) {
+            // Imports span whole pages, the same ones from a call to the next so that registrations get reused
+            auto start     = base + std::uintptr_t(linesize) * first,
+                 stop      = base + std::uintptr_t(linesize) * (last - 1) + src.width;
+            auto reg_start = util::align_down(start, page_size),
+                 reg_end   = util::align_up  (stop,  page_size);
+
+            EnvideoMap *map;
+            ENVID_CHECK(envideo_map_from_va(dev, &map, reinterpret_cast<void *>(reg_start), reg_end - reg_start,
+                                            page_size, download_map_flags));
+            maps.emplace_back(map);
+
+            ENVID_CHECK(envideo_map_pin(map, chan));
+
+            // Write back cpu lines over the range, which could otherwise be evicted on top of the engine writes
+            ENVID_CHECK(envideo_map_mark_dirty(map, start - reg_start, stop - start));
+
+            auto s = src;
+            s.y += first, s.height = last - first;
+            transfers[num_transfers++] = {
+                .src = s,
+                .dst = {
+                    .map        = map,
+                    .map_offset = static_cast<std::uint32_t>(start - reg_start),
+                    .width      = src.width,
+                    .height     = s.height,
+                    .stride     = linesize,
+                },
+            };
+        }
+
+        add_fixup(last, src.height - last);
+    }
+
+    EnvideoMap *bounce = nullptr;
+    if (bounce_size) {
+        ENVID_CHECK(envideo_map_create(dev, &bounce, bounce_size, page_size, download_map_flags));
+        maps.emplace_back(bounce);
+
+        ENVID_CHECK(envideo_map_pin(bounce, chan));
+
+        for (std::uint32_t i = 0; i < num_transfers; ++i) {
+            if (!transfers[i].dst.map)
+                transfers[i].dst.map = bounce;
+        }
+    }
+
+    // Written ranges stop at the end of the last row, invalidations do not reach past the end of the caller buffer
+    ENVID_CHECK(cmdbuf.clear());
+    ENVID_CHECK(transfer_batch(cmdbuf, transfers, num_transfers));
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Host));
+    ENVID_CHECK(cmdbuf.cache_op(EnvideoCache_Writeback));
+    ENVID_CHECK(cmdbuf.end());
+
+    ENVID_CHECK(envideo_channel_submit(chan, reinterpret_cast<EnvideoCmdbuf *>(&cmdbuf), &fence));
+
+    // The engine writes into caller memory, which must not be handed back while it may still be written to.
+    // Past the timeout, the download is given a bounded grace period and the timeout reported. If it has not
+    // completed by then, the imports are leaked so that their pages stay pinned under the engine.
+    if (auto rc = channel.device->wait(fence, timeout_us); rc) {
+        bool done = false;
+        for (std::uint32_t i = 0; i < max_slices && channel.device->poll(fence, done) == 0 && !done; ++i)
+            channel.device->wait(fence, wait_slice_us);
+
+        if (!done)
+            channel.device->poll(fence, done);
+
+        if (done)
+            fence = 0;
+        else
+            guard.cancel();
+
+        return rc;
+    }
+
+    fence = 0;
+
+    ENVID_CHECK(cmdbuf.invalidate_written());
+
+    void *bounce_addr = nullptr;
+    if (bounce)
+        ENVID_CHECK(bounce->get_cpu_addr(bounce_addr));
+
+    for (std::uint32_t i = 0; i < num_fixups; ++i) {
+        auto &f = fixups[i];
+        auto *src = static_cast<const std::uint8_t *>(bounce_addr) + f.bounce_offset;
+        for (std::uint32_t y = 0; y < f.rows; ++y)
+            std::memcpy(f.dst + std::size_t(f.linesize) * y, src + std::size_t(f.bounce_stride) * y, f.width);
+    }
+
+    return 0;
+}
+
+} // namespace envid
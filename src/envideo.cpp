@@ -20,18 +20,27 @@
 #include <cstring>
 #include <cmath>
 #include <algorithm>
-#include <bit>
 
 #include <unistd.h>
 #include <errno.h>
 #include <sys/stat.h>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 #include <envideo.h>
 
 #include <config.h>
 
 #include "common.hpp"
 #include "util.hpp"
+#include "heap.hpp"
+#include "surface.hpp"
+#include "copy.hpp"
+#include "swizzle.hpp"
+#include "transfer.hpp"
+#include "readback.hpp"
 
 #ifdef CONFIG_NVIDIA
 #include "nvidia/context.hpp"
@@ -40,8 +49,123 @@
 #include "nvgpu/context.hpp"
 #endif
 
-#include <nvmisc.h>
-#include <clc7b5.h>
+namespace {
+
+// Instantiates an uninitialized map of the backend of the device
+envid::Map *new_map(envid::Device *device, EnvideoMapFlags flags) {
+    switch (ENVIDEO_PLATFORM_GET_DRIVER(device->platform)) {
+#ifdef CONFIG_NVIDIA
+        case EnvideoPlatform_Nvidia:
+            return new envid::nvidia::Map(device, flags);
+#endif
+#ifdef CONFIG_NVGPU
+        case EnvideoPlatform_Nvgpu:
+            return new envid::nvgpu::Map(device, flags);
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+int register_va(envid::Device *device, void *mem, std::size_t size, std::size_t align, EnvideoMapFlags flags,
+                envid::Map *&map)
+{
+    auto *m = new_map(device, flags);
+    if (!m)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    auto guard = envid::util::ScopeGuard([m] { m->finalize(); delete m; });
+
+#if defined(__linux__)
+    // Ask for transparent huge pages over the fully covered part of the range, before the driver pins it.
+    // Only new registrations pay for the syscall, ranges handed back by the va cache are already advised
+    if (flags & EnvideoMap_HugePages) {
+        auto start = envid::util::align_up  (reinterpret_cast<std::uintptr_t>(mem),        ENVIDEO_HUGE_PAGE_SIZE);
+        auto end   = envid::util::align_down(reinterpret_cast<std::uintptr_t>(mem) + size, ENVIDEO_HUGE_PAGE_SIZE);
+        if (start < end)
+            ::madvise(reinterpret_cast<void *>(start), end - start, MADV_HUGEPAGE);
+    }
+#endif
+
+    ENVID_CHECK(m->initialize(mem, size, align));
+
+    map = m;
+    guard.cancel();
+
+    return 0;
+}
+
+#if defined(__linux__)
+// Size of the buffer behind a file descriptor, and whether it is backed by a regular file (eg. a memfd)
+int get_fd_size(int fd, std::size_t &size, bool &is_file) {
+    struct stat st;
+    ENVID_CHECK_ERRNO(::fstat(fd, &st));
+
+    is_file = S_ISREG(st.st_mode);
+    if (is_file) {
+        size = st.st_size;
+        return 0;
+    }
+
+    // dma-bufs report their size through seeking
+    auto end = ::lseek(fd, 0, SEEK_END);
+    ENVID_CHECK_ERRNO(end);
+    ENVID_CHECK_ERRNO(::lseek(fd, 0, SEEK_SET));
+
+    size = end;
+    return 0;
+}
+#endif
+
+// Grow geometrically, so that repeated reallocations are amortized
+std::size_t realloc_size(const envid::Map *map, std::size_t size) {
+    return std::max(size, map->size * 2);
+}
+
+// Allocates storage to replace that of a map, pinned to the same channels
+int create_replacement(envid::Map *map, std::size_t size, std::size_t align, envid::Map *&replacement) {
+    EnvideoMap *m;
+    if (map->parent)
+        ENVID_CHECK(envideo_heap_alloc(reinterpret_cast<EnvideoHeap *>(static_cast<envid::SubMap *>(map)->heap),
+                                       &m, size, align));
+    else
+        ENVID_CHECK(envideo_map_create(reinterpret_cast<EnvideoDevice *>(map->device), &m, size, align, map->flags));
+
+    auto guard = envid::util::ScopeGuard([m] { envideo_map_destroy(m); });
+
+    for (auto &&[c, _]: map->pins)
+        ENVID_CHECK(envideo_map_pin(m, reinterpret_cast<EnvideoChannel *>(c)));
+
+    replacement = m;
+    guard.cancel();
+
+    return 0;
+}
+
+// Exchanges the storage of two maps of the same kind
+void swap_maps(envid::Map *a, envid::Map *b) {
+    if (a->parent) {
+        std::swap(*static_cast<envid::SubMap *>(a), *static_cast<envid::SubMap *>(b));
+        return;
+    }
+
+    switch (ENVIDEO_PLATFORM_GET_DRIVER(a->device->platform)) {
+#ifdef CONFIG_NVIDIA
+        case EnvideoPlatform_Nvidia:
+            std::swap(*static_cast<envid::nvidia::Map *>(a), *static_cast<envid::nvidia::Map *>(b));
+            break;
+#endif
+#ifdef CONFIG_NVGPU
+        case EnvideoPlatform_Nvgpu:
+            std::swap(*static_cast<envid::nvgpu::Map *>(a), *static_cast<envid::nvgpu::Map *>(b));
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+} // namespace
 
 int envideo_device_create(EnvideoDevice **device) {
     if (!device) return ENVIDEO_RC_SYSTEM(EINVAL);
@@ -94,26 +218,40 @@ int envideo_device_create(EnvideoDevice **device) {
 int envideo_device_destroy(EnvideoDevice *device) {
     if (!device) return ENVIDEO_RC_SYSTEM(EINVAL);
     ENVID_SCOPEGUARD([device] { delete device; });
+    device->retired.drain(*device);
+    device->va_cache.set_limit(0);
+    device->map_cache.set_limit(0);
     return device->finalize();
 }
 
 EnvideoDeviceInfo envideo_device_get_info(EnvideoDevice *device) {
-    if (!device) return {};
+    if (!device) return { .numa_node = -1 };
 
     return {
         .tegra_layout = device->tegra_layout,
+        .numa_node    = device->numa_node,
     };
 }
 
 int envideo_fence_wait(EnvideoDevice *device, EnvideoFence fence, std::uint64_t timeout_us) {
-    return device ? device->wait(fence, timeout_us) : ENVIDEO_RC_SYSTEM(EINVAL);
+    if (!device) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    ENVID_CHECK(device->wait(fence, timeout_us));
+
+    // Housekeeping is best-effort, the fence has signaled either way
+    device->retired.reap(*device);
+    return 0;
 }
 
 int envideo_fence_poll(EnvideoDevice *device, EnvideoFence fence, bool *is_done) {
     if (!device || !is_done) return ENVIDEO_RC_SYSTEM(EINVAL);
 
     *is_done = false;
-    return device->poll(fence, *is_done);
+    ENVID_CHECK(device->poll(fence, *is_done));
+
+    if (*is_done)
+        device->retired.reap(*device);
+    return 0;
 }
 
 int envideo_map_create(EnvideoDevice *device, EnvideoMap **map,
@@ -132,31 +270,56 @@ int envideo_map_create(EnvideoDevice *device, EnvideoMap **map,
         flags = static_cast<EnvideoMapFlags>((flags & ~EnvideoMap_CpuMask) | cpu_flags);
     }
 
-    envid::Map *m = nullptr;
-    switch (ENVIDEO_PLATFORM_GET_DRIVER(device->platform)) {
-#ifdef CONFIG_NVIDIA
-        case EnvideoPlatform_Nvidia:
-            m = new envid::nvidia::Map(device, flags);
-            break;
-#endif
-#ifdef CONFIG_NVGPU
-        case EnvideoPlatform_Nvgpu:
-            m = new envid::nvgpu::Map(device, flags);
-            break;
-#endif
-        default:
-            break;
+    auto &cache = device->map_cache;
+    auto  start = std::chrono::steady_clock::now();
+    if (cache.enabled()) {
+        size = cache.size_class(size, device->page_size);
+
+        if (auto *m = cache.acquire(size, align, flags); m) {
+            *map = reinterpret_cast<EnvideoMap *>(m);
+            cache.account(true, std::chrono::steady_clock::now() - start);
+            return 0;
+        }
+    }
+
+    // Cached maps count towards the budget, release enough of them before giving up
+    auto &memory = device->memory;
+    if (!memory.charge(size, flags)) {
+        if (auto excess = memory.excess(size), cached = cache.get_stats().cached_bytes; excess && cached)
+            ENVID_CHECK(cache.trim(cached > excess ? cached - excess : 0));
+
+        if (!memory.charge(size, flags))
+            return ENVIDEO_RC_BUDGET_EXCEEDED;
     }
 
+    auto charge_guard = envid::util::ScopeGuard([&memory, size, flags] { memory.uncharge(size, flags); });
+
+    auto *m = new_map(device, flags);
     if (!m)
         return ENVIDEO_RC_SYSTEM(ENOMEM);
 
     auto guard = envid::util::ScopeGuard([m] { m->finalize(); delete m; });
 
-    ENVID_CHECK(m->initialize(size, align));
+    {
+        // Drivers allocate system memory on behalf of the calling thread, following its memory policy
+        bool bind = ENVIDEO_MAP_GET_LOCATION_FLAGS(flags) == EnvideoMap_LocationHost && !(flags & EnvideoMap_AnyNode);
+        envid::NumaScope numa(bind ? device->numa_node : -1);
+
+        ENVID_CHECK(m->initialize(size, align));
+    }
+
+    m->alloc_size  = size;
+    m->alloc_align = align;
+
+    // Drivers round allocations up, account for what was actually allocated
+    memory.recharge(size, m->size, flags);
 
     *map = reinterpret_cast<EnvideoMap *>(m);
     guard.cancel();
+    charge_guard.cancel();
+
+    if (cache.enabled())
+        cache.account(false, std::chrono::steady_clock::now() - start);
 
     return 0;
 }
@@ -171,73 +334,200 @@ int envideo_map_from_va(EnvideoDevice *device, EnvideoMap **map, void *mem,
     // Pre-allocated memory is always on the host side
     flags = static_cast<EnvideoMapFlags>((flags & ~EnvideoMap_LocationHost) | EnvideoMap_LocationHost);
 
-    envid::Map *m = nullptr;
-    switch (ENVIDEO_PLATFORM_GET_DRIVER(device->platform)) {
-#ifdef CONFIG_NVIDIA
-        case EnvideoPlatform_Nvidia:
-            m = new envid::nvidia::Map(device, flags);
-            break;
-#endif
-#ifdef CONFIG_NVGPU
-        case EnvideoPlatform_Nvgpu:
-            m = new envid::nvgpu::Map(device, flags);
-            break;
-#endif
-        default:
-            break;
+    // Recurring ranges are still registered with the driver
+    auto &cache = device->va_cache;
+    if (cache.enabled()) {
+        if (auto *m = cache.acquire(mem, size, align, flags); m) {
+            *map = reinterpret_cast<EnvideoMap *>(m);
+            return 0;
+        }
     }
 
+    envid::Map *m;
+    ENVID_CHECK(register_va(device, mem, size, align, flags, m));
+
+    if (cache.enabled())
+        cache.insert(m, mem, size, align);
+
+    *map = reinterpret_cast<EnvideoMap *>(m);
+    return 0;
+}
+
+int envideo_map_destroy(EnvideoMap *map) {
+    if (!map) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // Shared maps are kept registered until their range is evicted or unregistered
+    if (map->va_refs && map->device->va_cache.release(map))
+        return 0;
+
+    // Park the map for later reuse if possible
+    if (map->device->map_cache.release(map))
+        return 0;
+
+    map->device->memory.uncharge(*map);
+
+    ENVID_SCOPEGUARD([map] { delete map; });
+    int rc = map->finalize();
+
+#if defined(__linux__)
+    // Drop the mapping through which a buffer was imported, after the gpu stopped referencing it
+    if (map->import_addr)
+        ::munmap(map->import_addr, map->import_size);
+#endif
+
+    return rc;
+}
+
+int envideo_map_destroy_deferred(EnvideoMap *map, EnvideoFence fence) {
+    if (!map) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!fence)
+        return envideo_map_destroy(map);
+
+    auto &device = *map->device;
+    device.retired.add(static_cast<envid::Map *>(map), fence);
+    device.retired.reap(device);
+    return 0;
+}
+
+int envideo_map_import_dmabuf(EnvideoDevice *device, int fd, std::size_t size, EnvideoMapFlags flags,
+                              EnvideoMap **map)
+{
+    if (!device || !map || fd < 0) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *map = nullptr;
+
+#if defined(__linux__)
+    std::size_t buf_size = 0;
+    bool is_file;
+    ENVID_CHECK(get_fd_size(fd, buf_size, is_file));
+
+    if (!size)
+        size = buf_size;
+
+    if (!size || size > buf_size)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // Foreign memory is always on the host side
+    flags = static_cast<EnvideoMapFlags>((flags & ~EnvideoMap_LocationMask) | EnvideoMap_LocationHost);
+
+    auto *m = new_map(device, flags);
     if (!m)
         return ENVIDEO_RC_SYSTEM(ENOMEM);
 
-    auto guard = envid::util::ScopeGuard([m] { m->finalize(); delete m; });
+    int rc;
+    {
+        auto guard = envid::util::ScopeGuard([m] { m->finalize(); delete m; });
 
-    ENVID_CHECK(m->initialize(mem, size, align));
+        if (rc = m->import_dmabuf(fd, size); rc == 0) {
+            *map = reinterpret_cast<EnvideoMap *>(m);
+            guard.cancel();
+            return 0;
+        }
+    }
 
-    *map = reinterpret_cast<EnvideoMap *>(m);
+    // Fall back to importing the cpu mapping of the buffer. Only file-backed memory has pages behind its mapping,
+    // the mapping of a dma-buf is usually made of raw pfns which cannot be pinned for the gpu
+    if (!is_file)
+        return rc;
+
+    auto *mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+        return rc;
+
+    auto guard = envid::util::ScopeGuard([mem, size] { ::munmap(mem, size); });
+
+    // The mapping is private to this import, bypass the va cache
+    envid::Map *im;
+    ENVID_CHECK(register_va(device, mem, size, device->page_size, flags, im));
+
+    im->import_addr = mem;
+    im->import_size = size;
+
+    *map = reinterpret_cast<EnvideoMap *>(im);
     guard.cancel();
 
     return 0;
+#else
+    return ENVIDEO_RC_SYSTEM(ENOSYS);
+#endif
 }
 
-int envideo_map_destroy(EnvideoMap *map) {
-    if (!map) return ENVIDEO_RC_SYSTEM(EINVAL);
-    ENVID_SCOPEGUARD([map] { delete map; });
-    return map->finalize();
+int envideo_map_export_dmabuf(EnvideoMap *map, int *fd) {
+    if (!map || !fd) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *fd = -1;
+    return map->export_dmabuf(*fd);
 }
 
 int envideo_map_realloc(EnvideoMap *map, std::size_t size, std::size_t align) {
-    if (!map || map->size >= size) return ENVIDEO_RC_SYSTEM(EINVAL);
+    if (!map || map->size >= size || map->va_refs) return ENVIDEO_RC_SYSTEM(EINVAL);
 
-    EnvideoMap *m;
-    ENVID_CHECK(envideo_map_create(reinterpret_cast<EnvideoDevice *>(map->device), &m, size, align, map->flags));
+    // Command buffers write through the cpu mapping of their memory, which would move along with the storage
+    if (map->has_cmdbuf_refs())
+        return ENVIDEO_RC_SYSTEM(EINVAL);
 
-    auto guard = envid::util::ScopeGuard([m] { envideo_map_destroy(m); });
+    // Contents are migrated through the cpu, maps without a cpu mapping go through envideo_map_realloc_async
+    if (ENVIDEO_MAP_GET_CPU_FLAGS(map->flags) == EnvideoMap_CpuUnmapped)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
 
-    for (auto &&[c, _]: map->pins)
-        ENVID_CHECK(m->pin(c));
+    envid::Map *m;
+    ENVID_CHECK(create_replacement(map, realloc_size(map, size), align, m));
 
-    std::memcpy(m->cpu_addr, map->cpu_addr, std::min(m->size, map->size));
-    ENVID_CHECK(map->finalize());
+    auto guard = envid::util::ScopeGuard([m] { envideo_map_destroy(reinterpret_cast<EnvideoMap *>(m)); });
 
-    switch (ENVIDEO_PLATFORM_GET_DRIVER(map->device->platform)) {
-#ifdef CONFIG_NVIDIA
-        case EnvideoPlatform_Nvidia:
-            *reinterpret_cast<envid::nvidia::Map *>(map) = *reinterpret_cast<envid::nvidia::Map *>(m);
-            break;
-#endif
-#ifdef CONFIG_NVGPU
-        case EnvideoPlatform_Nvgpu:
-            *reinterpret_cast<envid::nvgpu::Map *>(map) = *reinterpret_cast<envid::nvgpu::Map *>(m);
-            break;
-#endif
-        default:
-            break;
-    }
+    void *src, *dst;
+    ENVID_CHECK(map->get_cpu_addr(src));
+    ENVID_CHECK(m->get_cpu_addr(dst));
+    if (!src || !dst)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    std::memcpy(dst, src, std::min(m->size, map->size));
 
     guard.cancel();
 
-    delete m;
+    // The previous storage ends up in the replacement map
+    swap_maps(map, m);
+    return envideo_map_destroy(reinterpret_cast<EnvideoMap *>(m));
+}
+
+int envideo_map_realloc_async(EnvideoMap *map, std::size_t size, std::size_t align, EnvideoChannel *channel,
+                              EnvideoCmdbuf *cmdbuf, EnvideoFence *fence)
+{
+    if (!map || !fence || map->size >= size || map->va_refs) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *fence = 0;
+
+    if (!channel)
+        return envideo_map_realloc(map, size, align);
+
+    if (!cmdbuf || channel->engine != EnvideoEngine_Copy || map->has_cmdbuf_refs())
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto *device = map->device;
+    device->retired.reap(*device);
+
+    // Make cpu writes visible to the copy engine
+    ENVID_CHECK(envideo_map_cache_op(map, 0, map->size, EnvideoCache_Writeback));
+    ENVID_CHECK(envideo_map_pin(map, channel));
+
+    envid::Map *m;
+    ENVID_CHECK(create_replacement(map, realloc_size(map, size), align, m));
+
+    auto guard = envid::util::ScopeGuard([m] { envideo_map_destroy(reinterpret_cast<EnvideoMap *>(m)); });
+
+    ENVID_CHECK(cmdbuf->clear());
+    ENVID_CHECK(envid::copy_linear(*cmdbuf, m, 0, map, 0, map->size));
+    ENVID_CHECK(envideo_channel_submit(channel, cmdbuf, fence));
+
+    guard.cancel();
+
+    // The previous storage is released once the copy has completed.
+    // The copy was recorded against the replacement, which now holds that storage
+    swap_maps(map, m);
+    cmdbuf->retarget(m, map);
+    device->retired.add(m, *fence);
+
     return 0;
 }
 
@@ -251,6 +541,35 @@ int envideo_map_pin(EnvideoMap *map, EnvideoChannel *channel) {
     return map->pin(channel);
 }
 
+int envideo_map_create_many(EnvideoDevice *device, std::size_t count, const std::size_t *sizes, EnvideoMapFlags flags,
+                            EnvideoMap **maps)
+{
+    if (!device || !sizes || !maps) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return envid::create_maps(*device, count, sizes, flags, maps);
+}
+
+int envideo_map_pin_many(EnvideoMap **maps, std::size_t num_maps, EnvideoChannel **channels, std::size_t num_channels) {
+    if (!maps || !channels) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!num_maps || !num_channels)
+        return 0;
+
+    std::vector<envid::Map *> m(maps, maps + num_maps);
+    std::vector<envid::Channel *> c(channels, channels + num_channels);
+
+    if (std::ranges::find(m, nullptr) != m.end() || std::ranges::find(c, nullptr) != c.end())
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // All maps and channels must belong to the same device
+    auto *device = m.front()->device;
+    if (!std::ranges::all_of(m, [device](auto *x) { return x->device == device; }) ||
+            !std::ranges::all_of(c, [device](auto *x) { return x->device == device; }))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return device->pin_batch(m, c);
+}
+
 int envideo_map_cache_op(EnvideoMap *map, std::size_t offset, std::size_t len,
                          EnvideoCacheFlags flags)
 {
@@ -258,8 +577,16 @@ int envideo_map_cache_op(EnvideoMap *map, std::size_t offset, std::size_t len,
         return ENVIDEO_RC_SYSTEM(EINVAL);
 
     switch (ENVIDEO_MAP_GET_CPU_FLAGS(map->flags)) {
-        case EnvideoMap_CpuCacheable:
-            return map->cache_op(offset, len, flags);
+        case EnvideoMap_CpuCacheable: {
+            // Cache maintenance goes through the cpu mapping on some platforms
+            void *addr;
+            ENVID_CHECK(map->get_cpu_addr(addr));
+            ENVID_CHECK(map->cache_op(offset, len, flags));
+
+            if (flags & EnvideoCache_Writeback)
+                map->clear_dirty(offset, len);
+            return 0;
+        }
         case EnvideoMap_CpuWriteCombine:
             envid::util::write_fence(); // fallthrough
         case EnvideoMap_CpuUncacheable:
@@ -270,6 +597,27 @@ int envideo_map_cache_op(EnvideoMap *map, std::size_t offset, std::size_t len,
     }
 }
 
+int envideo_map_mark_dirty(EnvideoMap *map, std::size_t offset, std::size_t len) {
+    if (!map || offset + len > map->size) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    map->mark_dirty(offset, len);
+    return 0;
+}
+
+int envideo_map_write(EnvideoMap *map, std::size_t offset, const void *data, std::size_t len) {
+    if (!map || !data || offset + len > map->size) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    void *addr;
+    ENVID_CHECK(map->get_cpu_addr(addr));
+    if (!addr)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    std::memcpy(static_cast<std::uint8_t *>(addr) + offset, data, len);
+    map->mark_dirty(offset, len);
+
+    return 0;
+}
+
 std::size_t envideo_map_get_size(EnvideoMap *map) {
     return map ? map->size : 0;
 }
@@ -279,14 +627,142 @@ std::uint32_t envideo_map_get_handle(EnvideoMap *map) {
 }
 
 void *envideo_map_get_cpu_addr(EnvideoMap *map) {
-    return map ? map->cpu_addr : 0;
+    void *addr = nullptr;
+    if (map)
+        map->get_cpu_addr(addr);
+    return addr;
+}
+
+int envideo_map_unmap_cpu(EnvideoMap *map) {
+    // The mapping of imported memory belongs to the caller
+    if (!map || (!map->own_mem && !map->parent))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return map->drop_cpu_addr();
 }
 
 std::uint64_t envideo_map_get_gpu_addr(EnvideoMap *map) {
     return map ? map->gpu_addr_pitch : 0;
 }
 
+std::size_t envideo_map_get_page_size(EnvideoMap *map) {
+    if (!map) return 0;
+    return map->page_size ? map->page_size : map->device->page_size;
+}
+
+int envideo_host_alloc(EnvideoDevice *device, void **mem, std::size_t *size, EnvideoMapFlags flags, std::size_t *page_size) {
+    if (!device || !mem || !size || !page_size) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *mem = nullptr;
+    return envid::host_alloc(*device, *mem, *size, flags, *page_size);
+}
+
+int envideo_host_free(EnvideoDevice *device, void *mem, std::size_t size) {
+    return (device && mem) ? envid::host_free(*device, mem, size) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_map_cache_set_limit(EnvideoDevice *device, std::size_t max_bytes) {
+    return device ? device->map_cache.set_limit(max_bytes) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_map_cache_trim(EnvideoDevice *device, std::size_t max_bytes) {
+    return device ? device->map_cache.trim(max_bytes) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+EnvideoMapCacheStats envideo_map_cache_get_stats(EnvideoDevice *device) {
+    return device ? device->map_cache.get_stats() : EnvideoMapCacheStats{};
+}
+
+int envideo_va_cache_set_limit(EnvideoDevice *device, std::size_t max_bytes) {
+    return device ? device->va_cache.set_limit(max_bytes) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_map_unregister_va(EnvideoDevice *device, void *mem, std::size_t size) {
+    if (!device || !mem) return ENVIDEO_RC_SYSTEM(EINVAL);
+    return device->va_cache.unregister(mem, size);
+}
+
+int envideo_device_get_memory_stats(EnvideoDevice *device, EnvideoMemoryStats *stats) {
+    if (!device || !stats) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *stats = device->memory.get_stats();
+    ENVID_CHECK(device->get_va_info(stats->va_total, stats->va_used, stats->va_largest_free));
+    return device->get_vram_info(stats->vram_total, stats->vram_free);
+}
+
+int envideo_device_begin_map_batch(EnvideoDevice *device) {
+    return device ? device->begin_map_batch() : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_device_end_map_batch(EnvideoDevice *device) {
+    return device ? device->end_map_batch() : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_device_get_copy_instances(EnvideoDevice *device, std::uint32_t *count) {
+    return (device && count) ? device->get_copy_instances(*count) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_device_set_memory_budget(EnvideoDevice *device, std::size_t budget) {
+    if (!device) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    device->memory.set_budget(budget);
+    return 0;
+}
+
+int envideo_heap_create(EnvideoDevice *device, EnvideoHeap **heap, std::size_t block_size, EnvideoMapFlags flags) {
+    if (!device || !heap || !block_size) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *heap = nullptr;
+
+    auto *h = new envid::Heap(device, envid::util::align_up(block_size, std::size_t(device->page_size)), flags);
+    if (!h)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    auto guard = envid::util::ScopeGuard([h] { h->finalize(); delete h; });
+
+    ENVID_CHECK(h->initialize());
+
+    *heap = reinterpret_cast<EnvideoHeap *>(h);
+    guard.cancel();
+
+    return 0;
+}
+
+int envideo_heap_destroy(EnvideoHeap *heap) {
+    if (!heap) return ENVIDEO_RC_SYSTEM(EINVAL);
+    ENVID_SCOPEGUARD([heap] { delete heap; });
+    return heap->finalize();
+}
+
+int envideo_heap_alloc(EnvideoHeap *heap, EnvideoMap **map, std::size_t size, std::size_t align) {
+    if (!heap || !map) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!size || !align || (align & (align - 1)))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *map = nullptr;
+
+    auto *m = new envid::SubMap(heap);
+    if (!m)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    auto guard = envid::util::ScopeGuard([m] { m->finalize(); delete m; });
+
+    ENVID_CHECK(m->initialize(size, align));
+
+    *map = reinterpret_cast<EnvideoMap *>(m);
+    guard.cancel();
+
+    return 0;
+}
+
 int envideo_channel_create(EnvideoDevice *device, EnvideoChannel **channel, EnvideoEngine engine) {
+    return envideo_channel_create_instance(device, channel, engine, 0);
+}
+
+int envideo_channel_create_instance(EnvideoDevice *device, EnvideoChannel **channel, EnvideoEngine engine,
+                                    std::uint32_t instance)
+{
     if (!device || !channel) return ENVIDEO_RC_SYSTEM(EINVAL);
 
     *channel = nullptr;
@@ -315,7 +791,8 @@ int envideo_channel_create(EnvideoDevice *device, EnvideoChannel **channel, Envi
 
     auto guard = envid::util::ScopeGuard([chan] { chan->finalize(); delete chan; });
 
-    chan->engine = engine;
+    chan->engine   = engine;
+    chan->instance = instance;
     ENVID_CHECK(chan->initialize());
 
     *channel = reinterpret_cast<EnvideoChannel *>(chan);
@@ -326,19 +803,42 @@ int envideo_channel_create(EnvideoDevice *device, EnvideoChannel **channel, Envi
 
 int envideo_channel_destroy(EnvideoChannel *channel) {
     if (!channel) return ENVIDEO_RC_SYSTEM(EINVAL);
-    ENVID_SCOPEGUARD([channel] { delete channel; });
-    return channel->finalize();
+
+    // Retired maps might still be pinned to the channel, wait for them to be released.
+    // The channel is kept alive if one of them could not be waited on.
+    ENVID_CHECK(channel->device->retired.reap_channel(*channel->device, static_cast<envid::Channel *>(channel)));
+
+    return envid::destroy_channel(channel);
+}
+
+int envideo_channel_destroy_deferred(EnvideoChannel *channel, EnvideoFence fence) {
+    if (!channel) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!fence)
+        return envideo_channel_destroy(channel);
+
+    auto &device = *channel->device;
+    device.retired.add(static_cast<envid::Channel *>(channel), fence);
+    device.retired.reap(device);
+    return 0;
 }
 
 int envideo_channel_submit(EnvideoChannel *channel, EnvideoCmdbuf *cmdbuf, EnvideoFence *fence) {
     if (!channel || !cmdbuf || !fence) return ENVIDEO_RC_SYSTEM(EINVAL);
 
+    // Write back cpu writes to the memory referenced by the command buffer
+    ENVID_CHECK(cmdbuf->flush_dirty());
+
     // Flush CPU writes to the command buffer
     if (ENVIDEO_MAP_GET_CPU_FLAGS(cmdbuf->map->flags) != EnvideoMap_CpuUncacheable)
         envid::util::write_fence();
 
     *fence = 0;
-    return channel->submit(cmdbuf, fence);
+    ENVID_CHECK(channel->submit(cmdbuf, fence));
+
+    // Opportunistically release objects retired by earlier submissions, the submission went through regardless
+    channel->device->retired.reap(*channel->device);
+    return 0;
 }
 
 int envideo_cmdbuf_create(EnvideoChannel *channel, EnvideoCmdbuf **cmdbuf) {
@@ -350,6 +850,7 @@ int envideo_cmdbuf_create(EnvideoChannel *channel, EnvideoCmdbuf **cmdbuf) {
 
     auto guard = envid::util::ScopeGuard([c] { c->finalize(); delete c; });
 
+    c->channel = channel;
     ENVID_CHECK(c->initialize());
 
     *cmdbuf = reinterpret_cast<EnvideoCmdbuf *>(c);
@@ -360,10 +861,23 @@ int envideo_cmdbuf_create(EnvideoChannel *channel, EnvideoCmdbuf **cmdbuf) {
 
 int envideo_cmdbuf_destroy(EnvideoCmdbuf *cmdbuf) {
     if (!cmdbuf) return ENVIDEO_RC_SYSTEM(EINVAL);
-    ENVID_SCOPEGUARD([cmdbuf] { delete cmdbuf; });
+    ENVID_SCOPEGUARD([cmdbuf] { cmdbuf->release_memory(); delete cmdbuf; });
     return cmdbuf->finalize();
 }
 
+int envideo_cmdbuf_destroy_deferred(EnvideoCmdbuf *cmdbuf, EnvideoFence fence) {
+    if (!cmdbuf) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!fence)
+        return envideo_cmdbuf_destroy(cmdbuf);
+
+    // Command buffers might not have received memory yet, their channel is always set
+    auto &device = *cmdbuf->channel->device;
+    device.retired.add(static_cast<envid::Cmdbuf *>(cmdbuf), fence);
+    device.retired.reap(device);
+    return 0;
+}
+
 int envideo_cmdbuf_add_memory(EnvideoCmdbuf *cmdbuf, const EnvideoMap *map, std::uint32_t offset, std::uint32_t size) {
     return (cmdbuf && map) ? cmdbuf->add_memory(map, offset, size) : ENVIDEO_RC_SYSTEM(EINVAL);
 }
@@ -402,6 +916,29 @@ int envideo_cmdbuf_cache_op(EnvideoCmdbuf *cmdbuf, EnvideoCacheFlags flags) {
     return cmdbuf ? cmdbuf->cache_op(flags) : ENVIDEO_RC_SYSTEM(EINVAL);
 }
 
+int envideo_cmdbuf_mark_written(EnvideoCmdbuf *cmdbuf, const EnvideoMap *map, std::size_t offset, std::size_t len) {
+    if (!cmdbuf || !map || offset + len > map->size) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    cmdbuf->mark_written(map, offset, len);
+    return 0;
+}
+
+int envideo_cmdbuf_invalidate_written(EnvideoCmdbuf *cmdbuf) {
+    return cmdbuf ? cmdbuf->invalidate_written() : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_cmdbuf_fill(EnvideoCmdbuf *cmdbuf, const EnvideoMap *map, std::size_t offset, std::size_t len,
+                        std::uint32_t pattern, std::uint32_t pattern_size)
+{
+    return (cmdbuf && map) ? envid::fill_linear(*cmdbuf, map, offset, len, pattern, pattern_size) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_cmdbuf_copy(EnvideoCmdbuf *cmdbuf, const EnvideoMap *dst, std::size_t dst_offset,
+                        const EnvideoMap *src, std::size_t src_offset, std::size_t len)
+{
+    return (cmdbuf && dst && src) ? envid::copy_linear(*cmdbuf, dst, dst_offset, src, src_offset, len) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
 int envideo_dfs_initialize(EnvideoChannel *channel, float framerate) {
     // Use 10Hz as fallback if no framerate information is available
     channel->dfs_framerate         = (framerate >= 0.1 && std::isfinite(framerate)) ? framerate : 10.0;
@@ -480,57 +1017,225 @@ int envideo_dfs_commit(EnvideoChannel *channel) {
 }
 
 int envideo_surface_transfer(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceInfo *src, EnvideoSurfaceInfo *dst) {
-    auto flags = DRF_DEF(C7B5, _LAUNCH_DMA, _DATA_TRANSFER_TYPE, _NON_PIPELINED) |
-                 DRF_DEF(C7B5, _LAUNCH_DMA, _FLUSH_ENABLE,       _TRUE)          |
-                 DRF_DEF(C7B5, _LAUNCH_DMA, _MULTI_LINE_ENABLE,  _TRUE);
-
-    ENVID_CHECK(cmdbuf->begin(EnvideoEngine_Copy));
-
-    ENVID_CHECK(cmdbuf->push_reloc(NVC7B5_OFFSET_IN_UPPER,  src->map, src->map_offset,
-        !src->tiled ? EnvideoRelocType_Pitch : EnvideoRelocType_Tiled, 0));
-    ENVID_CHECK(cmdbuf->push_reloc(NVC7B5_OFFSET_OUT_UPPER, dst->map, dst->map_offset,
-        !dst->tiled ? EnvideoRelocType_Pitch : EnvideoRelocType_Tiled, 0));
-
-    if (src->tiled) {
-        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _SRC_MEMORY_LAYOUT, _BLOCKLINEAR);
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_SRC_BLOCK_SIZE,
-            DRF_DEF(C7B5, _SET_SRC_BLOCK_SIZE, _WIDTH,      _ONE_GOB)                          |
-            DRF_NUM(C7B5, _SET_SRC_BLOCK_SIZE, _HEIGHT,     std::countr_zero(src->gob_height)) |
-            DRF_DEF(C7B5, _SET_SRC_BLOCK_SIZE, _DEPTH,      _ONE_GOB)                          |
-            DRF_DEF(C7B5, _SET_SRC_BLOCK_SIZE, _GOB_HEIGHT, _GOB_HEIGHT_FERMI_8)));
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_SRC_WIDTH,  src->stride));
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_SRC_HEIGHT, src->height));
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_SRC_DEPTH,  1));
-    } else {
-        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _SRC_MEMORY_LAYOUT, _PITCH);
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_PITCH_IN, src->stride));
-    }
+    return (cmdbuf && src && dst) ? envid::transfer_surface(*cmdbuf, *src, *dst) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
 
-    if (dst->tiled) {
-        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _DST_MEMORY_LAYOUT, _BLOCKLINEAR);
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_DST_BLOCK_SIZE,
-            DRF_DEF(C7B5, _SET_DST_BLOCK_SIZE, _WIDTH,      _ONE_GOB)                          |
-            DRF_NUM(C7B5, _SET_DST_BLOCK_SIZE, _HEIGHT,     std::countr_zero(dst->gob_height)) |
-            DRF_DEF(C7B5, _SET_DST_BLOCK_SIZE, _DEPTH,      _ONE_GOB)                          |
-            DRF_DEF(C7B5, _SET_DST_BLOCK_SIZE, _GOB_HEIGHT, _GOB_HEIGHT_FERMI_8)));
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_DST_WIDTH,  dst->stride));
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_DST_HEIGHT, dst->height));
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_SET_DST_DEPTH,  1));
-    } else {
-        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _DST_MEMORY_LAYOUT, _PITCH);
-        ENVID_CHECK(cmdbuf->push_value(NVC7B5_PITCH_OUT, dst->stride));
-    }
+int envideo_surface_transfer_batch(EnvideoCmdbuf *cmdbuf, const EnvideoSurfaceTransfer *transfers,
+                                   std::uint32_t num_transfers)
+{
+    if (!cmdbuf || (!transfers && num_transfers))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return envid::transfer_batch(*cmdbuf, transfers, num_transfers);
+}
+
+int envideo_surface_compute_layout(EnvideoDevice *device, EnvideoSurfaceFormat format, int depth,
+                                   std::uint32_t width, std::uint32_t height, bool tiled,
+                                   EnvideoSurfaceLayout *layout)
+{
+    if (!device || !layout)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // Block-linear surfaces are mapped with a dedicated kind, on whole pages
+    auto alignment = tiled ? std::max(std::size_t(device->page_size), std::size_t(ENVIDEO_MAP_ALIGN)) :
+                             std::size_t(ENVIDEO_MAP_ALIGN);
+
+    ENVID_CHECK(envid::compute_frame_layout(format, depth, width, height, tiled, alignment, *layout));
+    layout->tegra_layout = device->tegra_layout;
+    return 0;
+}
+
+int envideo_surface_transfer_frame(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat format, int depth,
+                                   std::uint32_t width, std::uint32_t height,
+                                   const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes)
+{
+    if (!cmdbuf || !src_planes || !dst_planes)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return envid::transfer_frame(*cmdbuf, format, depth, width, height, src_planes, dst_planes);
+}
+
+int envideo_surface_convert_frame(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat src_format, int src_depth,
+                                  EnvideoSurfaceFormat dst_format, int dst_depth,
+                                  std::uint32_t width, std::uint32_t height,
+                                  const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes)
+{
+    if (!cmdbuf || !src_planes || !dst_planes)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return envid::convert_frame(*cmdbuf, src_format, src_depth, dst_format, dst_depth, width, height,
+                                src_planes, dst_planes);
+}
+
+int envideo_surface_subsample_frame(EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat format, int depth,
+                                    std::uint32_t width, std::uint32_t height, const EnvideoSubsampleParams *params,
+                                    const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes)
+{
+    if (!cmdbuf || !params || !src_planes || !dst_planes)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return envid::subsample_frame(*cmdbuf, format, depth, width, height, *params, src_planes, dst_planes);
+}
+
+int envideo_surface_download_to(EnvideoChannel *channel, EnvideoCmdbuf *cmdbuf, EnvideoSurfaceFormat format,
+                                int depth, std::uint32_t width, std::uint32_t height,
+                                const EnvideoSurfaceInfo *src_planes, void *const *dst,
+                                const std::uint32_t *dst_linesizes, std::uint64_t timeout_us)
+{
+    if (!channel || !cmdbuf || !src_planes || !dst || !dst_linesizes)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    return envid::download_frame(*channel, *cmdbuf, format, depth, width, height, src_planes,
+                                 dst, dst_linesizes, timeout_us);
+}
+
+int envideo_copy_group_create(EnvideoDevice *device, EnvideoCopyGroup **group, std::uint32_t num_channels) {
+    if (!device || !group) return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *group = nullptr;
+
+    auto *g = new envid::CopyGroup(device);
+    if (!g)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    auto guard = envid::util::ScopeGuard([g] { g->finalize(); delete g; });
+
+    ENVID_CHECK(g->initialize(num_channels));
+
+    *group = reinterpret_cast<EnvideoCopyGroup *>(g);
+    guard.cancel();
+
+    return 0;
+}
+
+int envideo_copy_group_destroy(EnvideoCopyGroup *group) {
+    if (!group) return ENVIDEO_RC_SYSTEM(EINVAL);
+    ENVID_SCOPEGUARD([group] { delete group; });
+    return group->finalize();
+}
+
+int envideo_copy_group_transfer(EnvideoCopyGroup *group, const EnvideoSurfaceInfo *src, const EnvideoSurfaceInfo *dst,
+                                EnvideoFence *fence)
+{
+    if (!group || !src || !dst || !fence) return ENVIDEO_RC_SYSTEM(EINVAL);
+    return group->transfer(*src, *dst, *fence);
+}
 
-    ENVID_CHECK(cmdbuf->push_value(NVC7B5_LINE_LENGTH_IN, src->width));
-    ENVID_CHECK(cmdbuf->push_value(NVC7B5_LINE_COUNT,     std::min(src->height, dst->height)));
+int envideo_copy_group_tune(EnvideoCopyGroup *group, std::uint32_t *num_splits) {
+    return (group && num_splits) ? group->tune(*num_splits) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_copy_group_set_splits(EnvideoCopyGroup *group, std::uint32_t num_splits) {
+    return group ? group->set_splits(num_splits) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_surface_swizzle(void *tiled, const void *linear, const EnvideoSwizzleParams *params) {
+    return params ? envid::swizzle(tiled, linear, *params) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_surface_deswizzle(void *linear, const void *tiled, const EnvideoSwizzleParams *params) {
+    return params ? envid::deswizzle(linear, tiled, *params) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
 
-    ENVID_CHECK(cmdbuf->push_value(NVC7B5_LAUNCH_DMA, flags));
+int envideo_surface_deswizzle_subsampled(void *linear, const void *tiled, const EnvideoSwizzleParams *params,
+                                         std::uint32_t pixel_size, std::uint32_t step_x, std::uint32_t step_y)
+{
+    return params ? envid::deswizzle_subsampled(linear, tiled, *params, pixel_size, step_x, step_y) :
+                    ENVIDEO_RC_SYSTEM(EINVAL);
+}
 
-    ENVID_CHECK(cmdbuf->end());
+bool envideo_swizzle_kernel_supported(EnvideoSwizzleKernel kernel) {
+    return envid::swizzle_kernel_supported(kernel);
+}
+
+int envideo_surface_pool_create(EnvideoDevice *device, EnvideoSurfacePool **pool, const EnvideoSurfacePoolParams *params) {
+    if (!device || !pool || !params || (params->num_channels && !params->channels))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *pool = nullptr;
+
+    auto *p = new envid::SurfacePool(device, *params);
+    if (!p)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    auto guard = envid::util::ScopeGuard([p] { p->finalize(); delete p; });
+
+    ENVID_CHECK(p->initialize(params->width, params->height));
+
+    *pool = reinterpret_cast<EnvideoSurfacePool *>(p);
+    guard.cancel();
 
     return 0;
 }
 
+int envideo_surface_pool_destroy(EnvideoSurfacePool *pool) {
+    if (!pool) return ENVIDEO_RC_SYSTEM(EINVAL);
+    ENVID_SCOPEGUARD([pool] { delete pool; });
+    return pool->finalize();
+}
+
+int envideo_surface_pool_acquire(EnvideoSurfacePool *pool, EnvideoPoolSurface *surface) {
+    return (pool && surface) ? pool->acquire(*surface) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_surface_pool_ref(EnvideoSurfacePool *pool, std::uint32_t index) {
+    return pool ? pool->ref(index) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_surface_pool_release(EnvideoSurfacePool *pool, std::uint32_t index, EnvideoFence fence) {
+    return pool ? pool->release(index, fence) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_surface_pool_resize(EnvideoSurfacePool *pool, std::uint32_t width, std::uint32_t height,
+                                std::uint32_t num_surfaces)
+{
+    return pool ? pool->resize(width, height, num_surfaces) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_readback_create(EnvideoDevice *device, EnvideoChannel *channel, EnvideoReadback **readback,
+                            const EnvideoReadbackParams *params)
+{
+    if (!device || !channel || !readback || !params)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    *readback = nullptr;
+
+    auto *r = new envid::Readback(device, channel, *params);
+    if (!r)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    auto guard = envid::util::ScopeGuard([r] { r->finalize(); delete r; });
+
+    ENVID_CHECK(r->initialize());
+
+    *readback = reinterpret_cast<EnvideoReadback *>(r);
+    guard.cancel();
+
+    return 0;
+}
+
+int envideo_readback_destroy(EnvideoReadback *readback) {
+    if (!readback) return ENVIDEO_RC_SYSTEM(EINVAL);
+    ENVID_SCOPEGUARD([readback] { delete readback; });
+    return readback->finalize();
+}
+
+int envideo_readback_submit(EnvideoReadback *readback, const EnvideoSurfaceInfo *src_planes, EnvideoFence fence) {
+    return (readback && src_planes) ? readback->submit(src_planes, fence) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_readback_acquire(EnvideoReadback *readback, EnvideoReadbackFrame *frame, std::uint64_t timeout_us) {
+    return (readback && frame) ? readback->acquire(*frame, timeout_us) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int envideo_readback_release(EnvideoReadback *readback, std::uint32_t index) {
+    return readback ? readback->release(index) : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+std::uint32_t envideo_readback_get_num_slots(EnvideoReadback *readback) {
+    return readback ? readback->get_num_slots() : 0;
+}
+
 int envideo_get_decode_constraints(EnvideoDevice *device, EnvideoDecodeConstraints *constraints) {
     return (device && constraints) ? envid::get_decode_constraints(device, constraints) : ENVIDEO_RC_SYSTEM(EINVAL);
 }
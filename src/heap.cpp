@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <bit>
+
+#include <errno.h>
+
+#include "heap.hpp"
+
+namespace envid {
+
+void Tlsf::initialize(std::uint64_t size, std::uint64_t granularity) {
+    this->granularity = granularity;
+    this->size        = util::align_down(size, granularity);
+    this->used        = 0;
+
+    this->blocks       .clear();
+    this->unused_blocks.clear();
+    this->allocated    = {};
+
+    this->fl_bitmap  = 0;
+    this->sl_bitmaps = {};
+    for (auto &heads: this->heads)
+        heads.fill(Tlsf::invalid);
+
+    if (this->size)
+        this->insert_free(this->new_block(0, this->size));
+}
+
+bool Tlsf::allocate(std::uint64_t size, std::uint64_t align, std::uint64_t &offset) {
+    size  = util::align_up(std::max(size, this->granularity), this->granularity);
+    align = std::max(align, this->granularity);
+
+    // Block offsets are always a multiple of the granularity, so the padding needed
+    // to align an allocation is bounded by align - granularity
+    auto idx = this->find_free(size + align - this->granularity);
+    if (idx == Tlsf::invalid)
+        return false;
+
+    this->remove_free(idx);
+
+    // Split off the leading padding, and put it back in the free lists
+    auto gap = util::align_up(this->blocks[idx].offset, align) - this->blocks[idx].offset;
+    if (gap) {
+        auto next = this->split(idx, gap);
+        this->insert_free(idx);
+        idx = next;
+    }
+
+    // Same for the trailing space
+    if (this->blocks[idx].size > size)
+        this->insert_free(this->split(idx, size));
+
+    auto &block = this->blocks[idx];
+    block.is_free = false;
+    this->allocated.insert(block.offset, idx);
+    this->used += block.size;
+
+    offset = block.offset;
+    return true;
+}
+
+bool Tlsf::free(std::uint64_t offset) {
+    auto *p = this->allocated.find(offset);
+    if (!p)
+        return false;
+
+    auto idx = *p;
+    this->allocated.erase(offset);
+    this->used -= this->blocks[idx].size;
+
+    // Coalesce with physical neighbors
+    if (auto prev = this->blocks[idx].prev_phys; prev != Tlsf::invalid && this->blocks[prev].is_free) {
+        this->remove_free(prev);
+        this->merge(prev, idx);
+        idx = prev;
+    }
+
+    if (auto next = this->blocks[idx].next_phys; next != Tlsf::invalid && this->blocks[next].is_free) {
+        this->remove_free(next);
+        this->merge(idx, next);
+    }
+
+    this->insert_free(idx);
+    return true;
+}
+
+std::uint64_t Tlsf::get_largest_free() const {
+    if (!this->fl_bitmap)
+        return 0;
+
+    // Blocks in the highest non-empty list are the largest, but are not sorted within it
+    auto fl = std::bit_width(this->fl_bitmap) - 1;
+    auto sl = std::bit_width(this->sl_bitmaps[fl]) - 1;
+
+    std::uint64_t largest = 0;
+    for (auto idx = this->heads[fl][sl]; idx != Tlsf::invalid; idx = this->blocks[idx].next_free)
+        largest = std::max(largest, this->blocks[idx].size);
+
+    return largest;
+}
+
+void Tlsf::mapping(std::uint64_t size, std::uint32_t &fl, std::uint32_t &sl) const {
+    auto units = size / this->granularity;
+
+    // Small blocks are linearly indexed in the first list
+    if (units < Tlsf::sl_count) {
+        fl = 0;
+        sl = units;
+    } else {
+        auto log2 = std::bit_width(units) - 1;
+        fl = log2 - Tlsf::sl_log2 + 1;
+        sl = (units >> (log2 - Tlsf::sl_log2)) - Tlsf::sl_count;
+    }
+}
+
+std::uint32_t Tlsf::find_free(std::uint64_t size) const {
+    // Round up to the next list boundary, so that any block in the found list is large enough
+    auto units = size / this->granularity;
+    if (units >= Tlsf::sl_count)
+        units += util::mask(static_cast<std::uint64_t>(std::bit_width(units) - 1 - Tlsf::sl_log2));
+
+    std::uint32_t fl, sl;
+    this->mapping(units * this->granularity, fl, sl);
+    if (fl >= Tlsf::fl_count)
+        return Tlsf::invalid;
+
+    auto sl_map = this->sl_bitmaps[fl] & (UINT32_C(-1) << sl);
+    if (!sl_map) {
+        auto fl_map = (fl + 1 < 64) ? this->fl_bitmap & (UINT64_C(-1) << (fl + 1)) : 0;
+        if (!fl_map)
+            return Tlsf::invalid;
+
+        fl     = std::countr_zero(fl_map);
+        sl_map = this->sl_bitmaps[fl];
+    }
+
+    return this->heads[fl][std::countr_zero(sl_map)];
+}
+
+std::uint32_t Tlsf::new_block(std::uint64_t offset, std::uint64_t size) {
+    auto block = Block{
+        .offset    = offset,
+        .size      = size,
+        .prev_phys = Tlsf::invalid,
+        .next_phys = Tlsf::invalid,
+        .prev_free = Tlsf::invalid,
+        .next_free = Tlsf::invalid,
+        .is_free   = false,
+    };
+
+    if (!this->unused_blocks.empty()) {
+        auto idx = this->unused_blocks.back();
+        this->unused_blocks.pop_back();
+        this->blocks[idx] = block;
+        return idx;
+    }
+
+    this->blocks.emplace_back(block);
+    return this->blocks.size() - 1;
+}
+
+void Tlsf::delete_block(std::uint32_t idx) {
+    this->unused_blocks.emplace_back(idx);
+}
+
+void Tlsf::insert_free(std::uint32_t idx) {
+    std::uint32_t fl, sl;
+    this->mapping(this->blocks[idx].size, fl, sl);
+
+    auto &block = this->blocks[idx];
+    auto &head  = this->heads[fl][sl];
+    block.is_free   = true;
+    block.prev_free = Tlsf::invalid;
+    block.next_free = head;
+    if (head != Tlsf::invalid)
+        this->blocks[head].prev_free = idx;
+    head = idx;
+
+    this->sl_bitmaps[fl] |= util::bit(sl);
+    this->fl_bitmap      |= util::bit(static_cast<std::uint64_t>(fl));
+}
+
+void Tlsf::remove_free(std::uint32_t idx) {
+    std::uint32_t fl, sl;
+    this->mapping(this->blocks[idx].size, fl, sl);
+
+    auto &block = this->blocks[idx];
+    if (block.prev_free != Tlsf::invalid)
+        this->blocks[block.prev_free].next_free = block.next_free;
+    else
+        this->heads[fl][sl] = block.next_free;
+
+    if (block.next_free != Tlsf::invalid)
+        this->blocks[block.next_free].prev_free = block.prev_free;
+
+    if (this->heads[fl][sl] == Tlsf::invalid) {
+        this->sl_bitmaps[fl] &= ~util::bit(sl);
+        if (!this->sl_bitmaps[fl])
+            this->fl_bitmap &= ~util::bit(static_cast<std::uint64_t>(fl));
+    }
+
+    block.is_free = false;
+}
+
+std::uint32_t Tlsf::split(std::uint32_t idx, std::uint64_t size) {
+    // Note: new_block may reallocate the block storage, so don't hold references across it
+    auto next = this->new_block(this->blocks[idx].offset + size, this->blocks[idx].size - size);
+
+    auto &block = this->blocks[idx], &remainder = this->blocks[next];
+    remainder.prev_phys = idx;
+    remainder.next_phys = block.next_phys;
+    if (block.next_phys != Tlsf::invalid)
+        this->blocks[block.next_phys].prev_phys = next;
+
+    block.size      = size;
+    block.next_phys = next;
+    return next;
+}
+
+void Tlsf::merge(std::uint32_t idx, std::uint32_t next) {
+    auto &block = this->blocks[idx], &absorbed = this->blocks[next];
+    block.size     += absorbed.size;
+    block.next_phys = absorbed.next_phys;
+    if (absorbed.next_phys != Tlsf::invalid)
+        this->blocks[absorbed.next_phys].prev_phys = idx;
+
+    this->delete_block(next);
+}
+
+int Heap::initialize() {
+    // Create a first block upfront so that the initial allocations don't hit the driver
+    Block *block;
+    return this->create_block(this->block_size, this->device->page_size, block);
+}
+
+int Heap::finalize() {
+    std::scoped_lock lk(this->lock);
+
+    int rc = 0;
+    for (auto &block: this->blocks) {
+        if (auto res = this->destroy_block(*block); res && !rc)
+            rc = res;
+    }
+
+    this->blocks.clear();
+    return rc;
+}
+
+int Heap::allocate(SubMap &map, std::size_t size, std::size_t align) {
+    align = std::max<std::size_t>(align, ENVIDEO_MAP_ALIGN);
+    size  = util::align_up(size, ENVIDEO_MAP_ALIGN);
+
+    std::scoped_lock lk(this->lock);
+
+    Block *block = nullptr;
+    std::uint64_t offset = 0;
+    for (auto &b: this->blocks) {
+        // Sub-allocation offsets are only aligned relative to the start of the block
+        if (b->align >= align && b->allocator.allocate(size, align, offset)) {
+            block = b.get();
+            break;
+        }
+    }
+
+    if (!block) {
+        auto block_align = std::max<std::size_t>(align, this->device->page_size);
+        auto block_size  = std::max(this->block_size, util::align_up(size, block_align));
+        ENVID_CHECK(this->create_block(block_size, block_align, block));
+
+        if (!block->allocator.allocate(size, align, offset))
+            return ENVIDEO_RC_SYSTEM(ENOMEM);
+    }
+
+    auto *parent = block->map;
+
+    map.block          = block;
+    map.parent         = parent;
+    map.flags          = parent->flags;
+    map.own_mem        = false;
+    map.handle         = parent->handle;
+    map.handle_offset  = offset;
+    map.size           = size;
+    map.page_size      = parent->page_size;
+    map.cpu_addr       = parent->cpu_addr ? static_cast<std::uint8_t *>(parent->cpu_addr) + offset : nullptr;
+    map.gpu_addr_pitch = parent->gpu_addr_pitch ? parent->gpu_addr_pitch + offset : 0;
+    map.gpu_addr_block = parent->gpu_addr_block ? parent->gpu_addr_block + offset : 0;
+
+    // Inherit the channels the parent was already pinned to
+    map.pins = parent->pins;
+
+    return 0;
+}
+
+int Heap::free(SubMap &map) {
+    if (!map.block)
+        return 0;
+
+    std::scoped_lock lk(this->lock);
+
+    auto *block = map.block;
+    if (!block->allocator.free(map.handle_offset))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    map.block    = nullptr;
+    map.parent   = nullptr;
+    map.cpu_addr = nullptr;
+    map.gpu_addr_pitch = map.gpu_addr_block = 0;
+    map.pins.clear();
+
+    // Release empty blocks, but always keep one around to absorb future allocations
+    if (block->allocator.empty() && this->blocks.size() > 1) {
+        auto it = std::ranges::find_if(this->blocks, [block](auto &b) { return b.get() == block; });
+        auto rc = this->destroy_block(*block);
+        this->blocks.erase(it);
+        return rc;
+    }
+
+    return 0;
+}
+
+int Heap::pin(SubMap &map, envid::Channel *channel) {
+    std::scoped_lock lk(this->lock);
+
+    // Pins are shared by all sub-allocations of a block
+    auto *parent = map.parent;
+    if (parent->find_pin(channel) == 0)
+        ENVID_CHECK(parent->pin(channel));
+
+    if (auto pin = parent->find_pin(channel); pin != 0)
+        map.pins.emplace_back(channel, pin);
+
+    return 0;
+}
+
+int Heap::create_block(std::size_t size, std::size_t align, Block *&block) {
+    EnvideoMap *map;
+    ENVID_CHECK(envideo_map_create(reinterpret_cast<EnvideoDevice *>(this->device), &map, size, align, this->flags));
+
+    auto b = std::make_unique<Block>();
+    b->map   = map;
+    b->align = align;
+    b->allocator.initialize(map->size, ENVIDEO_MAP_ALIGN);
+
+    block = this->blocks.emplace_back(std::move(b)).get();
+    return 0;
+}
+
+int Heap::destroy_block(Block &block) {
+    return envideo_map_destroy(reinterpret_cast<EnvideoMap *>(block.map));
+}
+
+int SubMap::initialize(std::size_t size, std::size_t align) {
+    return this->heap->allocate(*this, size, align);
+}
+
+int SubMap::initialize(void *address, std::size_t size, std::size_t align) {
+    return ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int SubMap::import_dmabuf(int fd, std::size_t size) {
+    return ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int SubMap::export_dmabuf(int &fd) {
+    // The buffer would expose the whole block
+    return ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int SubMap::finalize() {
+    return this->heap->free(*this);
+}
+
+int SubMap::pin(envid::Channel *channel) {
+    return this->heap->pin(*this, channel);
+}
+
+int SubMap::cache_op(std::size_t offset, std::size_t len, EnvideoCacheFlags flags) {
+    return this->parent->cache_op(this->handle_offset + offset, len, flags);
+}
+
+int SubMap::map_cpu() {
+    void *addr;
+    ENVID_CHECK(this->parent->get_cpu_addr(addr));
+
+    this->set_cpu_addr(addr ? static_cast<std::uint8_t *>(addr) + this->handle_offset : nullptr);
+    return 0;
+}
+
+int SubMap::unmap_cpu() {
+    // The parent mapping is shared with other sub-allocations, only forget about it
+    this->set_cpu_addr(nullptr);
+    return 0;
+}
+
+} // namespace envid
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <envideo.h>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+// Two-level segregated fit allocator, handing out offsets into a range of a given size.
+// Block metadata is stored out-of-line, the managed memory is never accessed.
+class Tlsf {
+    public:
+        constexpr static std::uint32_t sl_log2  = 4,
+                                       sl_count = 1 << sl_log2,
+                                       fl_count = 64 - sl_log2 + 1;
+
+        constexpr static std::uint32_t invalid = UINT32_C(-1);
+
+    public:
+        void initialize(std::uint64_t size, std::uint64_t granularity);
+        bool allocate(std::uint64_t size, std::uint64_t align, std::uint64_t &offset);
+        bool free(std::uint64_t offset);
+
+        std::uint64_t get_size() const {
+            return this->size;
+        }
+
+        std::uint64_t get_used() const {
+            return this->used;
+        }
+
+        bool empty() const {
+            return this->used == 0;
+        }
+
+        // Size of the largest free block, bounding the largest possible allocation
+        std::uint64_t get_largest_free() const;
+
+    private:
+        struct Block {
+            std::uint64_t offset, size;
+            std::uint32_t prev_phys, next_phys;
+            std::uint32_t prev_free, next_free;
+            bool          is_free;
+        };
+
+        void mapping(std::uint64_t size, std::uint32_t &fl, std::uint32_t &sl) const;
+        std::uint32_t find_free(std::uint64_t size) const;
+
+        std::uint32_t new_block(std::uint64_t offset, std::uint64_t size);
+        void delete_block(std::uint32_t idx);
+        void insert_free(std::uint32_t idx);
+        void remove_free(std::uint32_t idx);
+        std::uint32_t split(std::uint32_t idx, std::uint64_t size);
+        void merge(std::uint32_t idx, std::uint32_t next);
+
+    private:
+        std::uint64_t size = 0, used = 0, granularity = 1;
+
+        std::vector<Block>         blocks;
+        std::vector<std::uint32_t> unused_blocks;
+        util::FlatHashMap<std::uint64_t, std::uint32_t> allocated;
+
+        std::uint64_t fl_bitmap = 0;
+        std::array<std::uint32_t, fl_count> sl_bitmaps = {};
+        std::array<std::array<std::uint32_t, sl_count>, fl_count> heads;
+};
+
+class SubMap;
+
+class Heap {
+    public:
+        struct Block {
+            envid::Map *map   = nullptr;
+            std::size_t align = 0;
+            Tlsf        allocator;
+        };
+
+    public:
+        Heap(envid::Device *device, std::size_t block_size, EnvideoMapFlags flags):
+            device(device), block_size(block_size), flags(flags) { }
+        int initialize();
+        int finalize();
+
+        int allocate(SubMap &map, std::size_t size, std::size_t align);
+        int free(SubMap &map);
+        int pin(SubMap &map, envid::Channel *channel);
+
+    private:
+        int create_block(std::size_t size, std::size_t align, Block *&block);
+        int destroy_block(Block &block);
+
+    public:
+        Device         *device = nullptr;
+        std::size_t     block_size;
+        EnvideoMapFlags flags;
+
+    private:
+        std::mutex lock;
+        std::vector<std::unique_ptr<Block>> blocks;
+};
+
+class SubMap final: public Map {
+    public:
+        SubMap(Heap *heap): Map(heap->device, heap->flags), heap(heap) { }
+        virtual int initialize(std::size_t size, std::size_t align)                override;
+        virtual int initialize(void *address, std::size_t size, std::size_t align) override;
+        virtual int finalize()                                                     override;
+        virtual int pin(envid::Channel *channel)                                   override;
+        virtual int cache_op(std::size_t offset, std::size_t len,
+                             EnvideoCacheFlags flags)                              override;
+        virtual int map_cpu()                                                      override;
+        virtual int unmap_cpu()                                                    override;
+        virtual int import_dmabuf(int fd, std::size_t size)                        override;
+        virtual int export_dmabuf(int &fd)                                         override;
+
+    public:
+        Heap        *heap  = nullptr;
+        Heap::Block *block = nullptr;
+};
+
+} // namespace envid
+
+struct EnvideoHeap: public envid::Heap { };
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <errno.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+namespace {
+
+#if defined(__linux__)
+
+int map_aligned(std::size_t size, std::size_t align, void *&mem) {
+    // Over-allocate and trim the excess to obtain the requested alignment
+    auto len  = size + align;
+    auto *ptr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return ENVIDEO_RC_SYSTEM(errno);
+
+    auto start   = reinterpret_cast<std::uintptr_t>(ptr);
+    auto aligned = util::align_up(start, std::uintptr_t(align));
+    if (aligned != start)
+        ::munmap(ptr, aligned - start);
+    if (auto tail = start + len - (aligned + size); tail)
+        ::munmap(reinterpret_cast<void *>(aligned + size), tail);
+
+    mem = reinterpret_cast<void *>(aligned);
+    return 0;
+}
+
+constexpr std::size_t max_numa_nodes = 16 * 8 * sizeof(unsigned long);
+
+// The kernel drops the last bit of the mask, hence the extra node
+constexpr unsigned long numa_mask_bits = max_numa_nodes + 1;
+
+#endif
+
+// Host memory is placed next to the device unless opted out of
+bool wants_numa_binding(const Device &device, EnvideoMapFlags flags) {
+    return device.numa_node >= 0 && !(flags & EnvideoMap_AnyNode);
+}
+
+} // namespace
+
+int get_pci_numa_node(std::uint32_t domain, std::uint32_t bus, std::uint32_t slot, std::uint32_t function) {
+#if defined(__linux__)
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/bus/pci/devices/%04x:%02x:%02x.%x/numa_node", domain, bus, slot, function);
+
+    auto *fp = std::fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    // Single-node systems report -1
+    int node;
+    if (std::fscanf(fp, "%d", &node) != 1 || node < 0 || std::size_t(node) >= max_numa_nodes)
+        node = -1;
+
+    std::fclose(fp);
+    return node;
+#else
+    return -1;
+#endif
+}
+
+int bind_numa_node(void *mem, std::size_t size, int node) {
+#if defined(__linux__)
+    unsigned long mask[max_numa_nodes / (8 * sizeof(unsigned long))] = {};
+    mask[node / (8 * sizeof(unsigned long))] = util::bit(static_cast<unsigned long>(node) % (8 * sizeof(unsigned long)));
+
+    // Preferred rather than strict, so that a full node spills over instead of failing allocations
+    ENVID_CHECK_ERRNO(::syscall(SYS_mbind, mem, size, MPOL_PREFERRED, mask, numa_mask_bits, 0));
+#endif
+
+    return 0;
+}
+
+NumaScope::NumaScope(int node) {
+#if defined(__linux__)
+    if (node < 0)
+        return;
+
+    if (::syscall(SYS_get_mempolicy, &this->prev_mode, this->prev_mask, numa_mask_bits, nullptr, 0) < 0)
+        return;
+
+    unsigned long mask[std::size(this->prev_mask)] = {};
+    mask[node / (8 * sizeof(unsigned long))] = util::bit(static_cast<unsigned long>(node) % (8 * sizeof(unsigned long)));
+
+    this->active = ::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, numa_mask_bits) == 0;
+#endif
+}
+
+NumaScope::~NumaScope() {
+#if defined(__linux__)
+    if (this->active)
+        ::syscall(SYS_set_mempolicy, this->prev_mode, this->prev_mask, numa_mask_bits);
+#endif
+}
+
+int host_alloc(Device &device, void *&mem, std::size_t &size, EnvideoMapFlags flags, std::size_t &page_size) {
+    if (!size)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+#if defined(__linux__)
+    // Pages are only faulted in after the policy is set, no migration is needed
+    auto bind = [&device, flags](void *mem, std::size_t size) {
+        if (wants_numa_binding(device, flags))
+            bind_numa_node(mem, size, device.numa_node);
+    };
+
+    if (flags & EnvideoMap_HugePages) {
+        size = util::align_up(size, std::size_t(ENVIDEO_HUGE_PAGE_SIZE));
+
+        // Explicit huge pages only exist if the administrator reserved some
+        mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+        if (mem != MAP_FAILED) {
+            bind(mem, size);
+            page_size = ENVIDEO_HUGE_PAGE_SIZE;
+            return 0;
+        }
+
+        // Fall back to transparent huge pages, which the kernel may or may not provide
+        ENVID_CHECK(map_aligned(size, ENVIDEO_HUGE_PAGE_SIZE, mem));
+        ::madvise(mem, size, MADV_HUGEPAGE);
+        bind(mem, size);
+
+        page_size = device.page_size;
+        return 0;
+    }
+
+    size = util::align_up(size, std::size_t(device.page_size));
+
+    mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return ENVIDEO_RC_SYSTEM(errno);
+
+    bind(mem, size);
+#elif defined(__SWITCH__)
+    size = util::align_up(size, std::size_t(device.page_size));
+
+    mem = std::aligned_alloc(device.page_size, size);
+    if (!mem)
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+#endif
+
+    page_size = device.page_size;
+    return 0;
+}
+
+int host_free(Device &device, void *mem, std::size_t size) {
+#if defined(__linux__)
+    ENVID_CHECK_ERRNO(::munmap(mem, size));
+#elif defined(__SWITCH__)
+    std::free(mem);
+#endif
+
+    return 0;
+}
+
+} // namespace envid
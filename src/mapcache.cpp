@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <bit>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+std::size_t MapCache::size_class(std::size_t size, std::size_t page_size) {
+    // Round up to a quarter of the previous power of two, bounding the waste to 25%
+    auto step = std::max(std::bit_floor(size) / 4, page_size);
+    return util::align_up(size, step);
+}
+
+Map *MapCache::acquire(std::size_t size, std::size_t align, EnvideoMapFlags flags) {
+    std::scoped_lock lk(this->lock);
+
+    // The cache only ever holds a limited amount of maps, a linear search is fine
+    auto it = std::ranges::find_if(this->maps, [&](Map *m) {
+        return m->alloc_size == size && m->alloc_align == align && m->flags == flags;
+    });
+
+    if (it == this->maps.end())
+        return nullptr;
+
+    auto *map = *it;
+    this->maps.erase(it);
+    this->bytes -= map->alloc_size;
+    return map;
+}
+
+bool MapCache::release(Map *map) {
+    // Imported and sub-allocated maps don't own their memory and can't be recycled
+    if (!map->alloc_align || map->parent)
+        return false;
+
+    std::scoped_lock lk(this->lock);
+
+    if (map->alloc_size > this->limit)
+        return false;
+
+    this->maps.emplace_front(map);
+    this->bytes += map->alloc_size;
+
+    this->trim_locked(this->limit);
+    return true;
+}
+
+int MapCache::trim(std::size_t max_bytes) {
+    std::scoped_lock lk(this->lock);
+    return this->trim_locked(max_bytes);
+}
+
+void MapCache::remove_channel(Channel *channel) {
+    std::scoped_lock lk(this->lock);
+
+    for (auto *map: this->maps)
+        std::erase_if(map->pins, [channel](auto &p) { return p.first == channel; });
+}
+
+int MapCache::set_limit(std::size_t max_bytes) {
+    std::scoped_lock lk(this->lock);
+
+    this->limit = max_bytes;
+    return this->trim_locked(max_bytes);
+}
+
+void MapCache::account(bool hit, std::chrono::steady_clock::duration time) {
+    std::scoped_lock lk(this->lock);
+
+    if (hit)
+        ++this->hits, this->hit_time += time;
+    else
+        ++this->misses, this->miss_time += time;
+}
+
+EnvideoMapCacheStats MapCache::get_stats() {
+    std::scoped_lock lk(this->lock);
+
+    using namespace std::chrono;
+    return {
+        .hits         = this->hits,
+        .misses       = this->misses,
+        .evictions    = this->evictions,
+        .cached_bytes = this->bytes,
+        .cached_maps  = this->maps.size(),
+        .hit_time_ns  = static_cast<std::uint64_t>(duration_cast<nanoseconds>(this->hit_time) .count()),
+        .miss_time_ns = static_cast<std::uint64_t>(duration_cast<nanoseconds>(this->miss_time).count()),
+    };
+}
+
+int MapCache::trim_locked(std::size_t max_bytes) {
+    int rc = 0;
+
+    // Evict least recently released maps first
+    while (this->bytes > max_bytes && !this->maps.empty()) {
+        auto *map = this->maps.back();
+        this->maps.pop_back();
+        this->bytes -= map->alloc_size;
+        ++this->evictions;
+
+        map->device->memory.uncharge(*map);
+        if (auto res = map->finalize(); res && !rc)
+            rc = res;
+        delete map;
+    }
+
+    return rc;
+}
+
+} // namespace envid
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+int Device::get_vram_info(std::uint64_t &total, std::uint64_t &free) {
+    total = free = 0;
+    return 0;
+}
+
+int Device::get_va_info(std::uint64_t &total, std::uint64_t &used, std::uint64_t &largest_free) {
+    total = used = largest_free = 0;
+    return 0;
+}
+
+bool MemoryTracker::charge(std::size_t size, EnvideoMapFlags flags) {
+    std::scoped_lock lk(this->lock);
+
+    if (this->budget && this->stats.total.bytes + size > this->budget)
+        return false;
+
+    this->update(size, 1, flags);
+    return true;
+}
+
+void MemoryTracker::uncharge(std::size_t size, EnvideoMapFlags flags) {
+    std::scoped_lock lk(this->lock);
+    this->update(-static_cast<std::int64_t>(size), -1, flags);
+}
+
+void MemoryTracker::uncharge(const Map &map) {
+    // Only maps created by the library were charged, imported and sub-allocated ones don't own their memory
+    if (map.alloc_align && !map.parent)
+        this->uncharge(map.size, map.flags);
+}
+
+void MemoryTracker::recharge(std::size_t charged, std::size_t size, EnvideoMapFlags flags) {
+    std::scoped_lock lk(this->lock);
+    this->update(static_cast<std::int64_t>(size) - static_cast<std::int64_t>(charged), 0, flags);
+}
+
+std::size_t MemoryTracker::excess(std::size_t size) {
+    std::scoped_lock lk(this->lock);
+
+    auto used = this->stats.total.bytes + size;
+    return (this->budget && used > this->budget) ? used - this->budget : 0;
+}
+
+void MemoryTracker::set_budget(std::size_t budget) {
+    std::scoped_lock lk(this->lock);
+    this->budget = budget;
+}
+
+EnvideoMemoryStats MemoryTracker::get_stats() {
+    std::scoped_lock lk(this->lock);
+
+    auto stats = this->stats;
+    stats.budget = this->budget;
+    return stats;
+}
+
+void MemoryTracker::update(std::int64_t size, std::int64_t count, EnvideoMapFlags flags) {
+    auto &s = this->stats;
+
+    auto counters = std::array{
+        &s.total,
+        &s.location[std::min<std::size_t>(ENVIDEO_MAP_GET_LOCATION_FLAGS(flags) >> 8,  std::size(s.location) - 1)],
+        &s.usage   [std::min<std::size_t>(ENVIDEO_MAP_GET_USAGE_FLAGS(flags)    >> 12, std::size(s.usage)    - 1)],
+        &s.cpu     [std::min<std::size_t>(ENVIDEO_MAP_GET_CPU_FLAGS(flags),            std::size(s.cpu)      - 1)],
+        &s.gpu     [std::min<std::size_t>(ENVIDEO_MAP_GET_GPU_FLAGS(flags)      >> 4,  std::size(s.gpu)      - 1)],
+    };
+
+    for (auto *c: counters) {
+        c->bytes      += size;
+        c->count      += count;
+        c->peak_bytes  = std::max(c->peak_bytes, c->bytes);
+        c->peak_count  = std::max(c->peak_count, c->count);
+    }
+}
+
+} // namespace envid
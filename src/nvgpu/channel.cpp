@@ -119,6 +119,10 @@ int Channel::alloc_obj_ctx(std::uint64_t &obj_id, std::uint32_t class_num) const
 int Channel::initialize() {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
+    // The kernel driver assigns the engine of gpu channels, only one instance can be addressed
+    if (this->instance)
+        return ENVIDEO_RC_SYSTEM(ENODEV);
+
     if (this->engine != EnvideoEngine_Copy) {
 #ifndef CONFIG_TEGRA_DRM
         this->type = Type::Host1x;
@@ -44,12 +44,14 @@ class Map final: public envid::Map {
         virtual int pin(envid::Channel *channel)                                   override;
         virtual int cache_op(std::size_t offset, std::size_t len,
                              EnvideoCacheFlags flags)                              override;
+        virtual int map_cpu()                                                      override;
+        virtual int unmap_cpu()                                                    override;
+        virtual int import_dmabuf(int fd, std::size_t size)                        override;
+        virtual int export_dmabuf(int &fd)                                         override;
 
     private:
         int get_fd();
-        int map_cpu();
         int map_gpu(int flags = 0);
-        int unmap_cpu();
         int unmap_gpu();
 
     public:
@@ -107,6 +109,10 @@ class Device: public envid::Device {
             return nullptr;
         }
 
+        virtual int cache_op_batch(const std::vector<CacheRange> &ranges, EnvideoCacheFlags flags) override;
+        virtual int pin_batch(const std::vector<envid::Map *> &maps,
+                              const std::vector<envid::Channel *> &channels)               override;
+
     public:
         int open_gpu_channel(Channel &channel) const;
         int bind_channel_as (Channel &channel) const;
@@ -145,7 +151,8 @@ class Device: public envid::Device {
         std::uint16_t host1x_version = 0,
                       bl_kind        = 0;
 
-        std::uint32_t copy_class = 0;
+        std::uint32_t copy_class    = 0,
+                      big_page_size = 0;
 
         std::uint64_t syncpt_va_base   = 0;
         std::uint32_t syncpt_page_size = 0;
@@ -18,6 +18,7 @@
  */
 
 #include <cstdint>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
@@ -350,7 +351,7 @@ int Device::map_buffer(Map &map, std::uint64_t &addr, int flags, bool cacheable,
         .compr_kind    = NV_KIND_INVALID,
         .incompr_kind  = static_cast<std:: int16_t>(pitch ? 0 : this->bl_kind),
         .dmabuf_fd     = static_cast<std::uint32_t>(map.fd),
-        .page_size     = this->page_size,
+        .page_size     = static_cast<std::uint32_t>(map.page_size),
     };
     ENVID_CHECK_ERRNO(::ioctl(this->nvas_fd, NVGPU_AS_IOCTL_MAP_BUFFER_EX, &args));
 
@@ -562,7 +563,8 @@ int Device::initialize() {
     if (!(characteristics.flags & NVGPU_GPU_FLAGS_HAS_SYNCPOINTS))
         return ENVIDEO_RC_SYSTEM(ENOSYS);
 
-    this->copy_class = characteristics.dma_copy_class;
+    this->copy_class    = characteristics.dma_copy_class;
+    this->big_page_size = characteristics.big_page_size;
 
     ENVID_CHECK(this->alloc_as(characteristics.big_page_size));
     ENVID_CHECK(this->open_tsg());
@@ -629,6 +631,83 @@ int Device::wait(envid::Fence fence, std::uint64_t timeout_us) {
     return 0;
 }
 
+int Device::cache_op_batch(const std::vector<CacheRange> &ranges, EnvideoCacheFlags flags) {
+#if defined(__linux__)
+    auto op = get_cache_op(flags);
+    if (op < 0)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    std::vector<std::uint32_t> handles, offsets, sizes;
+    handles.reserve(ranges.size()), offsets.reserve(ranges.size()), sizes.reserve(ranges.size());
+
+    for (auto &r: ranges) {
+        handles.emplace_back(r.map->handle);
+        offsets.emplace_back(r.map->handle_offset + r.offset);
+        sizes  .emplace_back(r.len);
+    }
+
+    auto args = nvmap_cache_op_list{
+        .handles = reinterpret_cast<std::uintptr_t>(handles.data()),
+        .offsets = reinterpret_cast<std::uintptr_t>(offsets.data()),
+        .sizes   = reinterpret_cast<std::uintptr_t>(sizes  .data()),
+        .nr      = static_cast<std::uint32_t>(ranges.size()),
+        .op      = op,
+    };
+    if (::ioctl(this->nvmap_fd, NVMAP_IOC_CACHE_LIST, &args) == 0)
+        return 0;
+#endif
+
+    // The batched operation might be unavailable, fall back to individual ones
+    return envid::Device::cache_op_batch(ranges, flags);
+}
+
+int Device::pin_batch(const std::vector<envid::Map *> &maps, const std::vector<envid::Channel *> &channels) {
+#if defined(__SWITCH__)
+    // Maps are handed to the channel in arrays, this bounds the size of the ioctl buffer
+    constexpr std::size_t max_batch = 64;
+
+    std::vector<envid::Map *> pending;
+    std::vector<nvioctl_command_buffer_map> args;
+
+    for (auto *channel: channels) {
+        if (!engine_is_multimedia(channel->engine))
+            continue;
+
+        auto &c = *reinterpret_cast<Channel *>(channel);
+
+        pending.clear(), args.clear();
+        for (auto *m: maps) {
+            if (m->find_pin(channel))
+                continue;
+
+            // Sub-allocations share the pins of their block
+            if (m->parent) {
+                ENVID_CHECK(m->pin(channel));
+                continue;
+            }
+
+            pending.emplace_back(m);
+            args.emplace_back(nvioctl_command_buffer_map{ .handle = m->handle });
+        }
+
+        for (std::size_t i = 0; i < args.size(); i += max_batch)
+            ENVID_CHECK_RC(nvioctlChannel_MapCommandBuffer(c.fd, args.data() + i,
+                                                           std::min(args.size() - i, max_batch), false));
+
+        for (std::size_t i = 0; i < pending.size(); ++i)
+            pending[i]->pins.emplace_back(channel, args[i].iova);
+    }
+
+    return 0;
+#elif defined(__linux__) && !defined(CONFIG_TEGRA_DRM)
+    // Pinning is a no-op, see Map::pin
+    return 0;
+#else
+    // Channel mappings are created one buffer at a time
+    return envid::Device::pin_batch(maps, channels);
+#endif
+}
+
 int Device::poll(envid::Fence fence, bool &is_done) {
     std::uint32_t id = fence_id(fence), value = fence_value(fence);
 
@@ -680,9 +759,11 @@ int Map::map_cpu() {
     if (addr == MAP_FAILED)
         return ENVIDEO_RC_SYSTEM(errno);
 
-    this->cpu_addr = addr;
+    this->cache_op_addr = addr;
+    this->set_cpu_addr(addr);
 #elif defined(__SWITCH__)
-    this->cpu_addr = this->map.cpu_addr;
+    this->cache_op_addr = this->map.cpu_addr;
+    this->set_cpu_addr(this->map.cpu_addr);
 #endif
 
     return 0;
@@ -692,7 +773,14 @@ int Map::map_gpu(int flags) {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
     bool is_gpu_cached = ENVIDEO_MAP_GET_GPU_FLAGS(this->flags) == EnvideoMap_GpuCacheable;
-    ENVID_CHECK(d.map_buffer(*this, this->gpu_addr_pitch, flags, is_gpu_cached, true));
+
+    auto rc = d.map_buffer(*this, this->gpu_addr_pitch, flags, is_gpu_cached, true);
+    if (rc && this->page_size != d.page_size) {
+        // Big pages need the backing to be contiguous in the iommu address space, retry with small pages
+        this->page_size = d.page_size;
+        rc = d.map_buffer(*this, this->gpu_addr_pitch, flags, is_gpu_cached, true);
+    }
+    ENVID_CHECK(rc);
 
     if (ENVIDEO_MAP_GET_USAGE_FLAGS(this->flags) == EnvideoMap_UsageFramebuffer)
         ENVID_CHECK(d.map_buffer(*this, this->gpu_addr_block, flags, is_gpu_cached, false));
@@ -708,7 +796,8 @@ int Map::unmap_cpu() {
         ::munmap(this->cache_op_addr, this->size);
 #endif
 
-    this->cpu_addr = this->cache_op_addr = nullptr;
+    this->cache_op_addr = nullptr;
+    this->set_cpu_addr(nullptr);
     return 0;
 }
 
@@ -731,7 +820,16 @@ int Map::unmap_gpu() {
 int Map::initialize(size_t size, size_t align) {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
+    this->page_size = d.page_size;
+
 #if defined(__linux__)
+    // Align the allocation so that it can be mapped with big gpu pages
+    if ((this->flags & EnvideoMap_HugePages) && d.big_page_size) {
+        size  = util::align_up(size, std::size_t(d.big_page_size));
+        align = std::max(align, std::size_t(d.big_page_size));
+        this->page_size = d.big_page_size;
+    }
+
     auto create_args = nvmap_create_handle{
         .size = static_cast<std::uint32_t>(size),
     };
@@ -773,14 +871,12 @@ int Map::initialize(size_t size, size_t align) {
 
     ENVID_CHECK(this->get_fd());
 
-    if (ENVIDEO_MAP_GET_CPU_FLAGS(flags) != EnvideoMap_CpuUnmapped)
+    if (ENVIDEO_MAP_GET_CPU_FLAGS(flags) != EnvideoMap_CpuUnmapped && !(flags & EnvideoMap_CpuLazy))
         ENVID_CHECK(this->map_cpu());
 
     if (ENVIDEO_MAP_GET_GPU_FLAGS(flags) != EnvideoMap_GpuUnmapped)
         ENVID_CHECK(this->map_gpu());
 
-    this->cache_op_addr = this->cpu_addr;
-
 #ifdef CONFIG_TEGRA_DRM
     d.drm_fd_to_handle(this->fd, this->gem);
 #endif
@@ -798,6 +894,8 @@ int Map::initialize(size_t size, size_t align) {
 int Map::initialize(void *address, std::size_t size, std::size_t align) {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
+    this->page_size = d.page_size;
+
 #if defined(__linux__)
     auto map_flags = get_map_flags(this->flags);
     if (map_flags == UINT32_MAX)
@@ -870,6 +968,51 @@ int Map::initialize(void *address, std::size_t size, std::size_t align) {
     return 0;
 }
 
+int Map::import_dmabuf(int fd, std::size_t size) {
+#if defined(__linux__)
+    auto &d = *reinterpret_cast<Device *>(this->device);
+
+    auto args = nvmap_create_handle{
+        .fd = fd,
+    };
+    ENVID_CHECK_ERRNO(::ioctl(d.nvmap_fd, NVMAP_IOC_FROM_FD, &args));
+
+    this->size      = size;
+    this->handle    = args.handle;
+    this->page_size = d.page_size;
+
+    // Partial imports are finalized by the caller
+    ENVID_CHECK(this->get_fd());
+
+    if (ENVIDEO_MAP_GET_CPU_FLAGS(this->flags) != EnvideoMap_CpuUnmapped && !(this->flags & EnvideoMap_CpuLazy))
+        ENVID_CHECK(this->map_cpu());
+
+    if (ENVIDEO_MAP_GET_GPU_FLAGS(this->flags) != EnvideoMap_GpuUnmapped)
+        ENVID_CHECK(this->map_gpu());
+
+#ifdef CONFIG_TEGRA_DRM
+    d.drm_fd_to_handle(this->fd, this->gem);
+#endif
+
+    return 0;
+#else
+    return ENVIDEO_RC_SYSTEM(ENOSYS);
+#endif
+}
+
+int Map::export_dmabuf(int &fd) {
+#if defined(__linux__)
+    if (!this->fd)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // The caller owns the returned descriptor
+    ENVID_CHECK_ERRNO(fd = ::fcntl(this->fd, F_DUPFD_CLOEXEC, 0));
+    return 0;
+#else
+    return ENVIDEO_RC_SYSTEM(ENOSYS);
+#endif
+}
+
 int Map::finalize() {
     this->unmap_gpu();
     this->unmap_cpu();
@@ -949,7 +1092,7 @@ int Map::cache_op(std::size_t offset, std::size_t len, EnvideoCacheFlags flags)
     auto &d = *reinterpret_cast<Device *>(this->device);
 
     auto op = get_cache_op(flags);
-    if (flags < 0)
+    if (op < 0)
         return ENVIDEO_RC_SYSTEM(EINVAL);
 
     auto args = nvmap_cache_op{
@@ -78,16 +78,10 @@ std::uint32_t get_notifier_type(EnvideoEngine engine, std::uint32_t instance) {
 int Channel::initialize() {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
-    // If we are requested a copy channel, find the first asynchronous engine instance
-    std::uint32_t instance = 0;
-    if (this->engine == EnvideoEngine_Copy) {
-        for (;; ++instance) {
-            NV2080_CTRL_CE_GET_CAPS_V2_PARAMS caps = { .ceEngineType = NV2080_ENGINE_TYPE_COPY(instance) };
-            ENVID_CHECK(d.nvrm_control(d.subdevice, NV2080_CTRL_CMD_CE_GET_CAPS_V2, caps));
-            if (!NV2080_CTRL_CE_GET_CAP(caps.capsTbl, NV2080_CTRL_CE_CAPS_CE_GRCE))
-                break;
-        }
-    }
+    // If we are requested a copy channel, find the matching asynchronous engine instance
+    std::uint32_t instance = this->instance;
+    if (this->engine == EnvideoEngine_Copy)
+        ENVID_CHECK(d.find_copy_instance(this->instance, instance));
 
     this->engine_type   = get_engine_type  (this->engine, instance);
     this->notifier_type = get_notifier_type(this->engine, instance);
@@ -24,6 +24,7 @@
 #include <atomic>
 #include <array>
 #include <bit>
+#include <mutex>
 #include <numeric>
 #include <string_view>
 #include <vector>
@@ -33,6 +34,7 @@
 #include <class/cl00de.h>
 
 #include "../common.hpp"
+#include "../heap.hpp"
 
 namespace envid::nvidia {
 
@@ -54,16 +56,20 @@ class Map final: public envid::Map {
         virtual int pin(envid::Channel *channel)                                   override;
         virtual int cache_op(std::size_t offset, std::size_t len,
                              EnvideoCacheFlags flags)                              override;
+        virtual int map_cpu()                                                      override;
+        virtual int unmap_cpu()                                                    override;
+        virtual int import_dmabuf(int fd, std::size_t size)                        override;
+        virtual int export_dmabuf(int &fd)                                         override;
 
     public:
-        int map_cpu(bool system = false);
-        int unmap_cpu();
+        int map_cpu(bool system);
         int map_gpu();
         int unmap_gpu();
 
     public:
         Object        object         = {};
         std::uint64_t linear_address = 0;
+        bool          is_system      = false;
 };
 
 class Channel final: public envid::Channel {
@@ -106,6 +112,13 @@ class Device final: public envid::Device {
         constexpr static std::string_view ctl_dev  = "/dev/nvidiactl";
         constexpr static std::string_view card_dev = "/dev/nvidia%d";
 
+        // Gpu virtual range reserved at initialization, and handed out client-side to maps.
+        // It spans the address space reported by the device up to va_max_size, or va_min_size if that can't be reserved
+        constexpr static std::uint64_t va_base     = UINT64_C(1) << 32;
+        constexpr static std::uint64_t va_min_size = UINT64_C(1) << 37;
+        constexpr static std::uint64_t va_max_size = UINT64_C(1) << 47;
+        constexpr static std::uint64_t va_align    = 0x10000;
+
     public:
         static bool probe();
 
@@ -123,7 +136,26 @@ class Device final: public envid::Device {
             return &this->semaphores;
         }
 
+        virtual int get_vram_info(std::uint64_t &total, std::uint64_t &free) override;
+
+        virtual int pin_batch(const std::vector<envid::Map *> &maps,
+                              const std::vector<envid::Channel *> &channels) override {
+            // All engines use the same address space, see Map::pin
+            return 0;
+        }
+
+        virtual int get_copy_instances(std::uint32_t &count) override;
+        virtual int get_va_info(std::uint64_t &total, std::uint64_t &used, std::uint64_t &largest_free) override;
+        virtual int begin_map_batch() override;
+        virtual int end_map_batch()   override;
+
     public:
+        int find_copy_instance(std::uint32_t index, std::uint32_t &instance);
+
+        int alloc_va(std::uint64_t size, std::uint64_t align, std::uint64_t &addr);
+        int free_va(std::uint64_t addr);
+        int flush_tlb();
+
         int alloc_channel(int &idx, std::uint32_t engine_type);
         int free_channel (int  idx);
         int register_event  (std::uint32_t notifier_type);
@@ -219,6 +251,17 @@ class Device final: public envid::Device {
         std::vector<std::uint32_t> engines = {};
 
         Object root = {}, device = {}, subdevice = {}, vaspace = {};
+
+        std::uint64_t va_size = 0;
+
+        // Protects the fields below, but is not held across mapping ioctls.
+        // Mapping operations that deferred their invalidation flush themselves if the batch ended in the meantime
+        std::mutex                 va_lock;
+        Tlsf                       va_allocator;
+        std::vector<std::uint64_t> va_pending_frees;
+        int                        va_batch_depth = 0;
+        bool                       tlb_dirty      = false;
+
         Map rusd, usermode, semaphores;
 
         int os_event_fd = 0;
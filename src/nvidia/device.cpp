@@ -185,11 +185,28 @@ std::uint32_t get_alloc_flags(EnvideoMapFlags flags, std::uint32_t *attr, std::u
         // The only two possible attributes are cached and writeback cached (see osCreateOsDescriptorFromPageArray)
         if (ENVIDEO_MAP_GET_CPU_FLAGS(flags) != EnvideoMap_CpuCacheable)
             *attr = FLD_SET_DRF(OS32, _ATTR, _COHERENCY, _WRITE_BACK, *attr);
+    } else if (flags & EnvideoMap_HugePages) {
+        *attr  = FLD_SET_DRF(OS32, _ATTR,  _PAGE_SIZE,      _HUGE, *attr);
+        *attr2 = FLD_SET_DRF(OS32, _ATTR2, _PAGE_SIZE_HUGE, _2MB,  *attr2);
     }
 
     return res | NVOS32_ALLOC_FLAGS_ALIGNMENT_FORCE | NVOS32_ALLOC_FLAGS_MAP_NOT_REQUIRED;
 }
 
+std::size_t get_page_size(std::uint32_t attr, std::uint32_t attr2) {
+    switch (DRF_VAL(OS32, _ATTR, _PAGE_SIZE, attr)) {
+        case NVOS32_ATTR_PAGE_SIZE_4KB:
+            return 0x1000;
+        case NVOS32_ATTR_PAGE_SIZE_BIG:
+            return 0x10000;
+        case NVOS32_ATTR_PAGE_SIZE_HUGE:
+            return (DRF_VAL(OS32, _ATTR2, _PAGE_SIZE_HUGE, attr2) == NVOS32_ATTR2_PAGE_SIZE_HUGE_512MB) ?
+                0x20000000 : 0x200000;
+        default:
+            return 0;
+    }
+}
+
 } // namespace
 
 int Device::nvrm_alloc(int fd, const Object &parent, Object &obj, std::uint32_t cl,
@@ -348,6 +365,9 @@ int Device::initialize() {
         return ENVIDEO_RC_SYSTEM(ENOSYS);
 
     std::snprintf(this->card_path.data(), this->card_path.size(), Device::card_dev.data(), info->minor_number);
+    this->numa_node = get_pci_numa_node(info->pci_info.domain, info->pci_info.bus,
+                                        info->pci_info.slot,   info->pci_info.function);
+
     ENVID_CHECK_ERRNO(this->card_fd = ::open(this->card_path.data(), O_RDWR | O_CLOEXEC));
     ENVID_CHECK(nvesc_iowr(this->card_fd, NV_ESC_REGISTER_FD, &this->ctl_fd));
 
@@ -398,11 +418,26 @@ int Device::initialize() {
     if (!usermode_cl || !gpfifo_cl)
         return ENVIDEO_RC_SYSTEM(ENOSYS);
 
-    // Allocate address space
-    ENVID_CHECK(this->nvrm_alloc(this->device, this->vaspace, NV01_MEMORY_VIRTUAL, NV_MEMORY_VIRTUAL_ALLOCATION_PARAMS{
-        .offset = 0,
-        .limit  = 0,
-    }));
+    // Reserve an address range, mappings are then placed in it client-side
+    auto reserve_va = [this](std::uint64_t size) {
+        return this->nvrm_alloc(this->device, this->vaspace, NV01_MEMORY_VIRTUAL, NV_MEMORY_VIRTUAL_ALLOCATION_PARAMS{
+            .offset = Device::va_base,
+            .limit  = Device::va_base + size - 1,
+        });
+    };
+
+    NV0080_CTRL_DMA_ADV_SCHED_GET_VA_CAPS_PARAMS va_caps = {};
+    if (this->nvrm_control(this->device, NV0080_CTRL_CMD_DMA_ADV_SCHED_GET_VA_CAPS, va_caps) == 0 &&
+            va_caps.vaBitCount < 64 && (UINT64_C(1) << va_caps.vaBitCount) > Device::va_base + Device::va_min_size)
+        this->va_size = std::min((UINT64_C(1) << va_caps.vaBitCount) - Device::va_base, Device::va_max_size);
+
+    // The top of the address space may be reserved by the driver
+    if (!this->va_size || reserve_va(this->va_size) != 0) {
+        this->va_size = Device::va_min_size;
+        ENVID_CHECK(reserve_va(this->va_size));
+    }
+
+    this->va_allocator.initialize(this->va_size, 0x1000);
 
     // Allocate and map usermode mmio
     this->usermode.size = NVC361_NV_USERMODE__SIZE;
@@ -530,6 +565,111 @@ int Device::poll(envid::Fence fence, bool &is_done) {
     return 0;
 }
 
+int Device::get_vram_info(std::uint64_t &total, std::uint64_t &free) {
+    NV2080_CTRL_FB_GET_INFO_V2_PARAMS params = {
+        .fbInfoListSize = 2,
+        .fbInfoList     = {
+            { .index = NV2080_CTRL_FB_INFO_INDEX_TOTAL_RAM_SIZE },
+            { .index = NV2080_CTRL_FB_INFO_INDEX_HEAP_FREE      },
+        },
+    };
+    ENVID_CHECK(this->nvrm_control(this->subdevice, NV2080_CTRL_CMD_FB_GET_INFO_V2, params));
+
+    // Sizes are reported in KiB
+    total = std::uint64_t(params.fbInfoList[0].data) << 10;
+    free  = std::uint64_t(params.fbInfoList[1].data) << 10;
+    return 0;
+}
+
+int Device::find_copy_instance(std::uint32_t index, std::uint32_t &instance) {
+    // Graphics copy engines are reserved for the graphics channel, skip them
+    for (instance = 0; instance < NV2080_ENGINE_TYPE_COPY_SIZE; ++instance) {
+        if (std::ranges::find(this->engines, NV2080_ENGINE_TYPE_COPY(instance)) == this->engines.end())
+            continue;
+
+        NV2080_CTRL_CE_GET_CAPS_V2_PARAMS caps = { .ceEngineType = NV2080_ENGINE_TYPE_COPY(instance) };
+        ENVID_CHECK(this->nvrm_control(this->subdevice, NV2080_CTRL_CMD_CE_GET_CAPS_V2, caps));
+        if (!NV2080_CTRL_CE_GET_CAP(caps.capsTbl, NV2080_CTRL_CE_CAPS_CE_GRCE) && !index--)
+            return 0;
+    }
+
+    return ENVIDEO_RC_SYSTEM(ENODEV);
+}
+
+int Device::get_copy_instances(std::uint32_t &count) {
+    std::uint32_t instance;
+    for (count = 0; this->find_copy_instance(count, instance) == 0; ++count);
+    return count ? 0 : ENVIDEO_RC_SYSTEM(ENODEV);
+}
+
+int Device::get_va_info(std::uint64_t &total, std::uint64_t &used, std::uint64_t &largest_free) {
+    std::scoped_lock lk(this->va_lock);
+
+    total        = this->va_allocator.get_size();
+    used         = this->va_allocator.get_used();
+    largest_free = this->va_allocator.get_largest_free();
+    return 0;
+}
+
+int Device::alloc_va(std::uint64_t size, std::uint64_t align, std::uint64_t &addr) {
+    std::uint64_t offset;
+    if (!this->va_allocator.allocate(size, align, offset))
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    addr = Device::va_base + offset;
+    return 0;
+}
+
+int Device::free_va(std::uint64_t addr) {
+    // Translations of addresses unmapped within a batch might still be cached until the flush
+    if (this->va_batch_depth) {
+        this->va_pending_frees.emplace_back(addr);
+        return 0;
+    }
+
+    return this->va_allocator.free(addr - Device::va_base) ? 0 : ENVIDEO_RC_SYSTEM(EINVAL);
+}
+
+int Device::flush_tlb() {
+    if (this->tlb_dirty) {
+        ENVID_CHECK(this->nvrm_control(this->subdevice, NV2080_CTRL_CMD_DMA_INVALIDATE_TLB,
+            NV2080_CTRL_DMA_INVALIDATE_TLB_PARAMS{
+                .hClient  = this->root.handle,
+                .hDevice  = this->device.handle,
+                .hVASpace = 0, // Default address space of the device, which holds our reservation
+            }));
+        this->tlb_dirty = false;
+    }
+
+    for (auto addr: this->va_pending_frees)
+        this->va_allocator.free(addr - Device::va_base);
+
+    this->va_pending_frees.clear();
+    return 0;
+}
+
+int Device::begin_map_batch() {
+    std::scoped_lock lk(this->va_lock);
+    ++this->va_batch_depth;
+    return 0;
+}
+
+int Device::end_map_batch() {
+    std::scoped_lock lk(this->va_lock);
+
+    if (!this->va_batch_depth)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (--this->va_batch_depth)
+        return 0;
+
+    return this->flush_tlb();
+}
+
+int Map::map_cpu() {
+    return this->map_cpu(this->is_system);
+}
+
 int Map::map_cpu(bool system) {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
@@ -557,7 +697,7 @@ int Map::map_cpu(bool system) {
     if (addr == MAP_FAILED)
         return ENVIDEO_RC_SYSTEM(errno);
 
-    this->cpu_addr = addr;
+    this->set_cpu_addr(addr);
 
     return 0;
 }
@@ -565,8 +705,10 @@ int Map::map_cpu(bool system) {
 int Map::unmap_cpu() {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
-    if (this->own_mem && this->cpu_addr)
+    if (this->own_mem && this->cpu_addr) {
         ::munmap(this->cpu_addr, this->size);
+        this->set_cpu_addr(nullptr);
+    }
 
     if (this->linear_address) {
         auto p = NVOS34_PARAMETERS{
@@ -576,6 +718,7 @@ int Map::unmap_cpu() {
             .pLinearAddress = NV_PTR_TO_NvP64(this->linear_address),
         };
         nvesc_iowr(d.ctl_fd, NV_ESC_RM_UNMAP_MEMORY, &p);
+        this->linear_address = 0;
     }
 
     return 0;
@@ -584,19 +727,46 @@ int Map::unmap_cpu() {
 int Map::map_gpu() {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
+    std::unique_lock lk(d.va_lock);
+
+    std::uint64_t addr;
+    auto align = std::max(std::uint64_t(this->page_size), Device::va_align);
+    ENVID_CHECK(d.alloc_va(util::align_up(std::uint64_t(this->size), align), align, addr));
+
+    auto guard = util::ScopeGuard([&d, &lk, addr] {
+        if (!lk.owns_lock())
+            lk.lock();
+        d.va_allocator.free(addr - Device::va_base);
+    });
+
+    bool defer = d.va_batch_depth > 0;
+    lk.unlock();
+
     NVOS46_PARAMETERS p = {
-        .hClient = d.root.handle,
-        .hDevice = d.device.handle,
-        .hDma    = d.vaspace.handle,
-        .hMemory = this->object.handle,
-        .offset  = 0,
-        .length  = this->size,
-        .flags   = DRF_DEF(OS46, _FLAGS, _PAGE_SIZE,              _DEFAULT) |
-                   DRF_DEF(OS46, _FLAGS, _DEFER_TLB_INVALIDATION, _FALSE),
+        .hClient   = d.root.handle,
+        .hDevice   = d.device.handle,
+        .hDma      = d.vaspace.handle,
+        .hMemory   = this->object.handle,
+        .offset    = 0,
+        .length    = this->size,
+        .flags     = DRF_DEF(OS46, _FLAGS, _PAGE_SIZE,        _DEFAULT) |
+                     DRF_DEF(OS46, _FLAGS, _DMA_OFFSET_FIXED, _TRUE)    |
+                     DRF_NUM(OS46, _FLAGS, _DEFER_TLB_INVALIDATION, defer),
+        .dmaOffset = addr,
     };
     ENVID_CHECK_RM(nvesc_iowr(d.ctl_fd, NV_ESC_RM_MAP_MEMORY_DMA, &p), p.status);
 
-    this->gpu_addr_pitch = this->gpu_addr_block = p.dmaOffset;
+    this->gpu_addr_pitch = this->gpu_addr_block = addr;
+    guard.cancel();
+
+    if (defer) {
+        lk.lock();
+        d.tlb_dirty = true;
+
+        // The batch was closed while mapping, its flush may have come too early
+        if (!d.va_batch_depth)
+            ENVID_CHECK(d.flush_tlb());
+    }
 
     return 0;
 }
@@ -605,16 +775,31 @@ int Map::unmap_gpu() {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
     if (this->gpu_addr_pitch) {
+        std::unique_lock lk(d.va_lock);
+
+        bool defer = d.va_batch_depth > 0;
+        lk.unlock();
+
         auto p = NVOS47_PARAMETERS{
             .hClient   = d.root.handle,
             .hDevice   = d.device.handle,
             .hDma      = d.vaspace.handle,
             .hMemory   = this->object.handle,
-            .flags     = DRF_DEF(OS47, _FLAGS, _DEFER_TLB_INVALIDATION, _FALSE),
+            .flags     = DRF_NUM(OS47, _FLAGS, _DEFER_TLB_INVALIDATION, defer),
             .dmaOffset = this->gpu_addr_pitch,
             .size      = this->size,
         };
         ENVID_CHECK_RM(nvesc_iowr(d.ctl_fd, NV_ESC_RM_UNMAP_MEMORY_DMA, &p), p.status);
+
+        lk.lock();
+
+        // The range is only reused after the invalidation, which must be issued here if the batch was closed meanwhile
+        d.tlb_dirty |= defer;
+        if (defer && !d.va_batch_depth)
+            ENVID_CHECK(d.flush_tlb());
+
+        ENVID_CHECK(d.free_va(this->gpu_addr_pitch));
+        this->gpu_addr_pitch = this->gpu_addr_block = 0;
     }
 
     return 0;
@@ -624,22 +809,43 @@ int Map::initialize(std::size_t size, std::size_t align) {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
     this->object.parent = d.device.handle;
-    std::uint32_t attr, attr2, cl = get_memory_class(this->flags);
-    ENVID_CHECK(d.nvrm_alloc(d.device, this->object, cl, NV_MEMORY_ALLOCATION_PARAMS{
-        .owner     = d.root.handle,
-        .type      = get_memory_type(this->flags),
-        .flags     = get_alloc_flags(this->flags, &attr, &attr2),
-        .attr      = attr,
-        .attr2     = attr2,
-        .size      = size,
-        .alignment = align,
-    }));
+    std::uint32_t cl = get_memory_class(this->flags);
+
+    auto alloc = [&](EnvideoMapFlags flags, std::size_t size, std::size_t align, NV_MEMORY_ALLOCATION_PARAMS &params) {
+        std::uint32_t attr, attr2;
+        params = {
+            .owner     = d.root.handle,
+            .type      = get_memory_type(flags),
+            .flags     = get_alloc_flags(flags, &attr, &attr2),
+            .attr      = attr,
+            .attr2     = attr2,
+            .size      = size,
+            .alignment = align,
+        };
+        return d.nvrm_alloc(d.device, this->object, cl, params);
+    };
 
-    this->size   = size;
-    this->handle = this->object.handle;
+    // The RM writes back the attributes it settled on
+    NV_MEMORY_ALLOCATION_PARAMS params;
+    if (this->flags & EnvideoMap_HugePages) {
+        auto huge_size = util::align_up(size, std::size_t(ENVIDEO_HUGE_PAGE_SIZE));
+        if (alloc(this->flags, huge_size, std::max(align, std::size_t(ENVIDEO_HUGE_PAGE_SIZE)), params) == 0) {
+            size = huge_size;
+        } else {
+            // Large pages might be unavailable, fall back to the default page size
+            ENVID_CHECK(alloc(static_cast<EnvideoMapFlags>(this->flags & ~EnvideoMap_HugePages), size, align, params));
+        }
+    } else {
+        ENVID_CHECK(alloc(this->flags, size, align, params));
+    }
 
-    if (ENVIDEO_MAP_GET_CPU_FLAGS(this->flags) != EnvideoMap_CpuUnmapped)
-        ENVID_CHECK(this->map_cpu(cl == NV01_MEMORY_SYSTEM));
+    this->size      = size;
+    this->handle    = this->object.handle;
+    this->is_system = cl == NV01_MEMORY_SYSTEM;
+    this->page_size = get_page_size(params.attr, params.attr2);
+
+    if (ENVIDEO_MAP_GET_CPU_FLAGS(this->flags) != EnvideoMap_CpuUnmapped && !(this->flags & EnvideoMap_CpuLazy))
+        ENVID_CHECK(this->map_cpu());
 
     if (ENVIDEO_MAP_GET_GPU_FLAGS(this->flags) != EnvideoMap_GpuUnmapped)
         ENVID_CHECK(this->map_gpu());
@@ -685,6 +891,16 @@ int Map::initialize(void *address, std::size_t size, std::size_t align) {
     return 0;
 }
 
+int Map::import_dmabuf(int fd, std::size_t size) {
+    // The RM has no support for foreign buffers, file-backed ones are imported through their cpu mapping
+    return ENVIDEO_RC_SYSTEM(ENOSYS);
+}
+
+int Map::export_dmabuf(int &fd) {
+    // Exporting to a dma-buf requires the nvidia-drm prime interface, which this backend does not use
+    return ENVIDEO_RC_SYSTEM(ENOSYS);
+}
+
 int Map::finalize() {
     auto &d = *reinterpret_cast<Device *>(this->device);
 
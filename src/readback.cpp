@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <errno.h>
+
+#include "util.hpp"
+#include "surface.hpp"
+#include "transfer.hpp"
+#include "readback.hpp"
+
+namespace envid {
+
+Readback::Readback(envid::Device *device, envid::Channel *channel, const EnvideoReadbackParams &params):
+        device(device), channel(channel), format(params.format), depth(params.depth),
+        width(params.width), height(params.height)
+{
+    this->min_slots    = params.min_slots ? params.min_slots : Readback::default_min_slots;
+    this->max_slots    = params.max_slots ? params.max_slots : std::max(Readback::default_max_slots, this->min_slots);
+    this->target_slots = this->min_slots;
+}
+
+int Readback::initialize() {
+    std::scoped_lock lk(this->lock);
+
+    if (!this->min_slots || this->min_slots > this->max_slots)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    ENVID_CHECK(compute_frame_layout(this->format, this->depth, this->width, this->height, false,
+                                     ENVIDEO_MAP_ALIGN, this->layout));
+
+    auto *dev  = reinterpret_cast<EnvideoDevice  *>(this->device);
+    auto *chan = reinterpret_cast<EnvideoChannel *>(this->channel);
+
+    // Command memory is reserved for the largest ring, one range per slot
+    ENVID_CHECK(envideo_map_create(dev, &this->cmdbuf_map, this->max_slots * Readback::cmdbuf_size, this->device->page_size,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuUncacheable |
+                                     EnvideoMap_LocationHost    | EnvideoMap_UsageCmdbuf)));
+    ENVID_CHECK(envideo_map_pin(this->cmdbuf_map, chan));
+
+    this->slots.resize(this->max_slots);
+    for (std::uint32_t i = 0; i < this->min_slots; ++i)
+        ENVID_CHECK(this->create_slot(this->slots[i], i));
+
+    return 0;
+}
+
+int Readback::finalize() {
+    std::scoped_lock lk(this->lock);
+
+    int rc = 0;
+    for (auto &s: this->slots) {
+        if (auto res = this->destroy_slot(s); res && !rc)
+            rc = res;
+    }
+    this->slots.clear();
+
+    if (this->cmdbuf_map) {
+        if (auto res = envideo_map_destroy(this->cmdbuf_map); res && !rc)
+            rc = res;
+        this->cmdbuf_map = nullptr;
+    }
+
+    return rc;
+}
+
+int Readback::create_slot(Slot &slot, std::uint32_t index) {
+    auto *dev  = reinterpret_cast<EnvideoDevice  *>(this->device);
+    auto *chan = reinterpret_cast<EnvideoChannel *>(this->channel);
+
+    ENVID_CHECK(envideo_map_create(dev, &slot.map, this->layout.size, this->layout.alignment,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                     EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer)));
+    ENVID_CHECK(envideo_map_pin(slot.map, chan));
+
+    ENVID_CHECK(envideo_cmdbuf_create(chan, &slot.cmdbuf));
+    ENVID_CHECK(envideo_cmdbuf_add_memory(slot.cmdbuf, this->cmdbuf_map, index * Readback::cmdbuf_size,
+                                          Readback::cmdbuf_size));
+
+    slot.state = Slot::State::Free;
+    return 0;
+}
+
+int Readback::destroy_slot(Slot &slot) {
+    int rc = 0;
+    auto check = [&rc](int res) {
+        if (res && !rc)
+            rc = res;
+    };
+
+    // Copies still in flight target the staging map
+    if (slot.fence && (slot.state == Slot::State::Pending || slot.state == Slot::State::Waiting))
+        check(this->device->wait(slot.fence, 5'000'000));
+
+    if (slot.cmdbuf)
+        check(envideo_cmdbuf_destroy(slot.cmdbuf));
+    if (slot.map)
+        check(envideo_map_destroy(slot.map));
+
+    slot = {};
+    return rc;
+}
+
+std::uint32_t Readback::count_slots() const {
+    return std::ranges::count_if(this->slots, [](auto &s) { return s.state != Slot::State::Unused; });
+}
+
+void Readback::update_target() {
+    if (this->consume_time_ema <= 0.0)
+        return;
+
+    // Enough copies in flight to cover their latency at the rate frames are consumed,
+    // plus the slot held by the consumer
+    auto in_flight = static_cast<std::uint32_t>(std::ceil(this->copy_latency_ema / this->consume_time_ema));
+    this->target_slots = std::clamp(in_flight + 1, this->min_slots, this->max_slots);
+}
+
+int Readback::submit(const EnvideoSurfaceInfo *src_planes, Fence fence) {
+    std::scoped_lock lk(this->lock);
+
+    auto it = std::ranges::find(this->slots, Slot::State::Free, &Slot::state);
+    if (it == this->slots.end()) {
+        // Grow the ring when measurements call for more slots
+        if (this->count_slots() >= this->target_slots)
+            return ENVIDEO_RC_SYSTEM(EAGAIN);
+
+        it = std::ranges::find(this->slots, Slot::State::Unused, &Slot::state);
+        auto guard = util::ScopeGuard([this, it] { this->destroy_slot(*it); });
+        ENVID_CHECK(this->create_slot(*it, it - this->slots.begin()));
+        guard.cancel();
+    }
+
+    auto &slot   = *it;
+    auto *cmdbuf = reinterpret_cast<Cmdbuf *>(slot.cmdbuf);
+
+    EnvideoSurfaceInfo dst_planes[ENVIDEO_MAX_PLANES];
+    for (std::uint32_t i = 0; i < this->layout.num_planes; ++i) {
+        auto &p = this->layout.planes[i];
+        dst_planes[i] = {
+            .map        = slot.map,
+            .map_offset = static_cast<std::uint32_t>(p.offset),
+            .stride     = p.stride,
+        };
+    }
+
+    ENVID_CHECK(cmdbuf->clear());
+
+    if (fence) {
+        ENVID_CHECK(cmdbuf->begin(EnvideoEngine_Host));
+        ENVID_CHECK(cmdbuf->wait_fence(fence));
+        ENVID_CHECK(cmdbuf->end());
+    }
+
+    ENVID_CHECK(transfer_frame(*cmdbuf, this->format, this->depth, this->width, this->height, src_planes, dst_planes));
+
+    ENVID_CHECK(cmdbuf->begin(EnvideoEngine_Host));
+    ENVID_CHECK(cmdbuf->cache_op(EnvideoCache_Writeback));
+    ENVID_CHECK(cmdbuf->end());
+
+    ENVID_CHECK(envideo_channel_submit(reinterpret_cast<EnvideoChannel *>(this->channel), slot.cmdbuf, &slot.fence));
+
+    slot.state       = Slot::State::Pending;
+    slot.sequence    = this->next_sequence++;
+    slot.submit_time = Clock::now();
+    return 0;
+}
+
+int Readback::acquire(EnvideoReadbackFrame &frame, std::uint64_t timeout_us) {
+    Slot *slot;
+    {
+        std::scoped_lock lk(this->lock);
+
+        // Frames are handed out in submission order
+        slot = nullptr;
+        for (auto &s: this->slots) {
+            if (s.state == Slot::State::Pending && (!slot || s.sequence < slot->sequence))
+                slot = &s;
+        }
+
+        if (!slot)
+            return ENVIDEO_RC_SYSTEM(EAGAIN);
+
+        slot->state = Slot::State::Waiting;
+    }
+
+    // Only copies that had not completed yet give a sample of their latency
+    bool done;
+    auto rc = this->device->poll(slot->fence, done);
+    if (!rc && !done)
+        rc = this->device->wait(slot->fence, timeout_us);
+
+    auto now = Clock::now();
+
+    std::scoped_lock lk(this->lock);
+
+    // The cpu caches are invalidated on acquisition, so that the consumer reads the copied data
+    if (!rc)
+        rc = envideo_map_cache_op(slot->map, 0, this->layout.size, EnvideoCache_Invalidate);
+
+    if (rc) {
+        slot->state = Slot::State::Pending;
+        return rc;
+    }
+
+    if (!done) {
+        auto latency = std::chrono::duration<double>(now - slot->submit_time).count();
+        this->copy_latency_ema = (this->copy_latency_ema == 0.0) ? latency :
+            this->ema_damping * latency + (1.0 - this->ema_damping) * this->copy_latency_ema;
+        this->update_target();
+    }
+
+    slot->state        = Slot::State::Held;
+    slot->acquire_time = now;
+
+    auto *base = static_cast<const std::uint8_t *>(envideo_map_get_cpu_addr(slot->map));
+
+    frame = {
+        .index = static_cast<std::uint32_t>(slot - this->slots.data()),
+        .map   = slot->map,
+    };
+    for (std::uint32_t i = 0; i < this->layout.num_planes; ++i) {
+        frame.data[i]      = base + this->layout.planes[i].offset;
+        frame.linesizes[i] = this->layout.planes[i].stride;
+    }
+
+    return 0;
+}
+
+int Readback::release(std::uint32_t index) {
+    std::scoped_lock lk(this->lock);
+
+    if (index >= this->slots.size() || this->slots[index].state != Slot::State::Held)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto &slot = this->slots[index];
+    slot.state = Slot::State::Free;
+
+    auto time = std::chrono::duration<double>(Clock::now() - slot.acquire_time).count();
+    this->consume_time_ema = (this->consume_time_ema == 0.0) ? time :
+        this->ema_damping * time + (1.0 - this->ema_damping) * this->consume_time_ema;
+    this->update_target();
+
+    // Shrink the ring as slots retire
+    if (this->count_slots() > this->target_slots)
+        return this->destroy_slot(slot);
+
+    return 0;
+}
+
+std::uint32_t Readback::get_num_slots() {
+    std::scoped_lock lk(this->lock);
+    return this->count_slots();
+}
+
+} // namespace envid
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <envideo.h>
+
+#include "common.hpp"
+
+namespace envid {
+
+class Readback {
+    public:
+        constexpr static std::uint32_t default_min_slots = 2, default_max_slots = 8;
+        constexpr static std::uint32_t cmdbuf_size = 0x1000;
+
+        using Clock = std::chrono::steady_clock;
+
+        struct Slot {
+            enum class State {
+                Unused,         // No staging map was created
+                Free,
+                Pending,        // Copy submitted
+                Waiting,        // Copy being waited on by an acquisition
+                Held,           // Handed to the consumer
+            };
+
+            State          state    = State::Unused;
+            EnvideoMap    *map      = nullptr;
+            EnvideoCmdbuf *cmdbuf   = nullptr;
+            Fence          fence    = 0;
+            std::uint64_t  sequence = 0;
+
+            Clock::time_point submit_time, acquire_time;
+        };
+
+    public:
+        Readback(envid::Device *device, envid::Channel *channel, const EnvideoReadbackParams &params);
+        int initialize();
+        int finalize();
+
+        int submit(const EnvideoSurfaceInfo *src_planes, Fence fence);
+        int acquire(EnvideoReadbackFrame &frame, std::uint64_t timeout_us);
+        int release(std::uint32_t index);
+
+        std::uint32_t get_num_slots();
+
+    private:
+        int create_slot(Slot &slot, std::uint32_t index);
+        int destroy_slot(Slot &slot);
+        std::uint32_t count_slots() const;
+        void update_target();
+
+    public:
+        Device  *device  = nullptr;
+        Channel *channel = nullptr;
+
+    private:
+        std::mutex lock;
+
+        EnvideoSurfaceFormat format;
+        int                  depth;
+        std::uint32_t        width, height;
+        std::uint32_t        min_slots, max_slots, target_slots;
+
+        EnvideoSurfaceLayout layout;
+        EnvideoMap          *cmdbuf_map = nullptr;
+        std::vector<Slot>    slots;
+        std::uint64_t        next_sequence = 1;
+
+        // Exponential moving averages in seconds, of the latency of copies and of the time frames are held
+        double copy_latency_ema = 0.0, consume_time_ema = 0.0, ema_damping = 0.1;
+};
+
+} // namespace envid
+
+struct EnvideoReadback: public envid::Readback { };
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include <errno.h>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+void RetireList::add(Map *map, Fence fence) {
+    this->add(Entry::Kind::Map, map, fence);
+}
+
+void RetireList::add(Cmdbuf *cmdbuf, Fence fence) {
+    this->add(Entry::Kind::Cmdbuf, cmdbuf, fence);
+}
+
+void RetireList::add(Channel *channel, Fence fence) {
+    this->add(Entry::Kind::Channel, channel, fence);
+}
+
+void RetireList::add(Entry::Kind kind, void *object, Fence fence) {
+    std::scoped_lock lk(this->lock);
+    this->entries.emplace_back(kind, object, fence);
+    ++this->count;
+}
+
+int RetireList::reap(Device &device) {
+    if (this->empty())
+        return 0;
+
+    int rc = this->collect(device, Mode::Poll, [](auto &e) { return e.kind != Entry::Kind::Channel; });
+
+    // Channels go last, once no map or command buffer that might depend on them is left
+    {
+        std::scoped_lock lk(this->lock);
+        if (this->busy || !std::ranges::all_of(this->entries, [](auto &e) { return e.kind == Entry::Kind::Channel; }))
+            return rc;
+    }
+
+    if (auto res = this->collect(device, Mode::Poll, [](auto &e) { return e.kind == Entry::Kind::Channel; }); res && !rc)
+        rc = res;
+
+    return rc;
+}
+
+int RetireList::reap_channel(Device &device, Channel *channel) {
+    if (this->empty())
+        return 0;
+
+    // Only maps still pinned to the channel and its command buffers need to be released before it,
+    // objects of other channels are left alone
+    return this->collect(device, Mode::Wait, [channel](auto &e) {
+        switch (e.kind) {
+            case Entry::Kind::Map:
+                return static_cast<Map *>(e.object)->find_pin(channel) != 0;
+            case Entry::Kind::Cmdbuf:
+                return static_cast<Cmdbuf *>(e.object)->channel == channel;
+            default:
+                return false;
+        }
+    });
+}
+
+int RetireList::drain(Device &device) {
+    if (this->empty())
+        return 0;
+
+    int rc = this->collect(device, Mode::Drain, [](auto &e) { return e.kind != Entry::Kind::Channel; });
+    if (auto res = this->collect(device, Mode::Drain, [](auto &) { return true; }); res && !rc)
+        rc = res;
+
+    return rc;
+}
+
+int RetireList::collect(Device &device, Mode mode, const std::function<bool(const Entry &)> &pred) {
+    std::vector<Entry> taken;
+
+    // Entries are taken out of the list, so that fences are not waited on with the lock held
+    {
+        std::scoped_lock lk(this->lock);
+        for (auto it = this->entries.begin(); it != this->entries.end();) {
+            if (!pred(*it)) {
+                ++it;
+                continue;
+            }
+
+            taken.emplace_back(*it);
+            it = this->entries.erase(it);
+        }
+
+        this->busy += taken.size();
+    }
+
+    int rc = 0;
+    std::vector<Entry> pending;
+    for (auto &entry: taken) {
+        bool signaled = false;
+        int res = (mode == Mode::Poll) ? device.poll(entry.fence, signaled) :
+                                         device.wait(entry.fence, RetireList::wait_timeout_us);
+        if (res && !rc)
+            rc = res;
+
+        // Only the device teardown releases objects the gpu might still be using, as their memory goes away with it
+        if (mode == Mode::Drain || (mode == Mode::Wait && !res))
+            signaled = true;
+
+        if (!signaled) {
+            pending.emplace_back(entry);
+            continue;
+        }
+
+        // The map cache might evict and finalize other maps, which happens outside of the lock
+        if (auto res = this->destroy(entry); res && !rc)
+            rc = res;
+    }
+
+    std::scoped_lock lk(this->lock);
+    this->entries.insert(this->entries.end(), pending.begin(), pending.end());
+    this->count -= taken.size() - pending.size();
+    this->busy  -= taken.size();
+
+    return rc;
+}
+
+int RetireList::destroy(const Entry &entry) {
+    switch (entry.kind) {
+        case Entry::Kind::Map:
+            return envideo_map_destroy(static_cast<EnvideoMap *>(entry.object));
+        case Entry::Kind::Cmdbuf:
+            return envideo_cmdbuf_destroy(static_cast<EnvideoCmdbuf *>(entry.object));
+        case Entry::Kind::Channel:
+            return destroy_channel(static_cast<Channel *>(entry.object));
+        default:
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+    }
+}
+
+int destroy_channel(Channel *channel) {
+    // Recycled maps might outlive the channel, drop the stale pins
+    channel->device->map_cache.remove_channel(channel);
+
+    ENVID_SCOPEGUARD([channel] { delete channel; });
+    return channel->finalize();
+}
+
+} // namespace envid
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <errno.h>
+
+#include "util.hpp"
+#include "surface.hpp"
+
+namespace envid {
+
+namespace {
+
+constexpr std::uint64_t release_timeout_us = 5'000'000;
+
+constexpr std::uint32_t codec_size_align(EnvideoCodec codec) {
+    // Coded dimensions are a multiple of the largest block size of the codec
+    switch (codec) {
+        case EnvideoCodec_H265:
+        case EnvideoCodec_Vp9:
+        case EnvideoCodec_Av1:
+            return 64;
+        default:
+            return 16;
+    }
+}
+
+// Decoders write chroma as interleaved UV samples
+constexpr FormatDesc subsampling_desc(EnvideoPixelFormat subsample) {
+    switch (subsample) {
+        case EnvideoSubsampling_Monochrome: return get_format_desc(EnvideoSurfaceFormat_Gray);
+        case EnvideoSubsampling_420:        return get_format_desc(EnvideoSurfaceFormat_Nv12);
+        case EnvideoSubsampling_422:        return get_format_desc(EnvideoSurfaceFormat_Nv16);
+        case EnvideoSubsampling_440:        return { 2, { {0, 0, 1}, {0, 1, 2} } };
+        case EnvideoSubsampling_444:        return get_format_desc(EnvideoSurfaceFormat_Nv24);
+        default:                            return {};
+    }
+}
+
+} // namespace
+
+int compute_surface_layout(EnvideoCodec codec, EnvideoPixelFormat subsample, int depth,
+                           std::uint32_t width, std::uint32_t height, SurfaceLayout &layout)
+{
+    EnvideoSurfaceLayout l;
+    ENVID_CHECK(compute_frame_layout(subsampling_desc(subsample), depth, width, height, true, ENVIDEO_MAP_ALIGN, l,
+                                     codec_size_align(codec)));
+
+    // Monochrome surfaces have an empty chroma plane, placed after the luma one
+    auto &luma = l.planes[0], &chroma = l.planes[1];
+    layout = {
+        .bpp                 = (depth > 8) ? 2u : 1u,
+        .width               = width,
+        .height              = height,
+        .luma_width          = luma.width,
+        .luma_height         = luma.height,
+        .luma_stride         = luma.stride,
+        .chroma_width        = chroma.width,
+        .chroma_height       = chroma.height,
+        .chroma_stride       = chroma.stride,
+        .luma_offset         = static_cast<std::uint32_t>(luma.offset),
+        .chroma_offset       = static_cast<std::uint32_t>((l.num_planes > 1) ? chroma.offset : l.size),
+        .luma_alloc_height   = luma.alloc_height,
+        .chroma_alloc_height = chroma.alloc_height,
+        .size                = l.size,
+        .gob_height          = l.gob_height,
+    };
+
+    return 0;
+}
+
+// 1080p NV12 frames take 1920x1088 luma and 1920x544 chroma
+static_assert([] {
+    EnvideoSurfaceLayout l;
+    compute_frame_layout(EnvideoSurfaceFormat_Nv12, 8, 1920, 1080, true, ENVIDEO_MAP_ALIGN, l);
+    return l.planes[1].offset == 1920 * 1088 && l.size == 1920 * 1088 * 3 / 2;
+}());
+
+SurfacePool::SurfacePool(envid::Device *device, const EnvideoSurfacePoolParams &params):
+        device(device), codec(params.codec), subsample(params.subsample), depth(params.depth),
+        num_surfaces(params.num_surfaces),
+        channels(reinterpret_cast<Channel **>(params.channels),
+                 reinterpret_cast<Channel **>(params.channels) + params.num_channels)
+{
+    this->flags = static_cast<EnvideoMapFlags>((params.flags & ~EnvideoMap_UsageMask) | EnvideoMap_UsageFramebuffer);
+}
+
+int SurfacePool::initialize(std::uint32_t width, std::uint32_t height) {
+    std::scoped_lock lk(this->lock);
+
+    for (auto *c: this->channels) {
+        if (!c)
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+    }
+
+    ENVID_CHECK(compute_surface_layout(this->codec, this->subsample, this->depth, width, height, this->layout));
+
+    // Map all surfaces with a single translation cache invalidation
+    ENVID_CHECK(this->device->begin_map_batch());
+    auto guard = util::ScopeGuard([this] { this->device->end_map_batch(); });
+
+    for (std::uint32_t i = 0; i < this->num_surfaces; ++i) {
+        Surface *s;
+        ENVID_CHECK(this->create_surface(s));
+    }
+
+    guard.cancel();
+    return this->device->end_map_batch();
+}
+
+int SurfacePool::finalize() {
+    std::scoped_lock lk(this->lock);
+
+    int rc = 0;
+    for (auto &s: this->surfaces) {
+        if (auto res = this->retire_surface(*s); res && !rc)
+            rc = res;
+    }
+
+    this->surfaces.clear();
+    return rc;
+}
+
+int SurfacePool::acquire(EnvideoPoolSurface &surface) {
+    std::scoped_lock lk(this->lock);
+
+    ENVID_CHECK(this->reap());
+
+    std::uint32_t num_current = 0;
+    for (auto &s: this->surfaces) {
+        if (!this->is_current(*s))
+            continue;
+
+        ++num_current;
+
+        bool idle;
+        ENVID_CHECK(this->is_idle(*s, idle));
+        if (idle) {
+            s->refs   = 1;
+            s->layout = this->layout;
+            this->fill(*s, surface);
+            return 0;
+        }
+    }
+
+    // Replace surfaces that were retired by a resize
+    if (num_current < this->num_surfaces) {
+        Surface *s;
+        ENVID_CHECK(this->create_surface(s));
+
+        s->refs = 1;
+        this->fill(*s, surface);
+        return 0;
+    }
+
+    return ENVIDEO_RC_SYSTEM(EAGAIN);
+}
+
+int SurfacePool::ref(std::uint32_t index) {
+    std::scoped_lock lk(this->lock);
+
+    auto *s = this->find(index);
+    if (!s || !s->refs)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    ++s->refs;
+    return 0;
+}
+
+int SurfacePool::release(std::uint32_t index, envid::Fence fence) {
+    std::scoped_lock lk(this->lock);
+
+    auto *s = this->find(index);
+    if (!s || !s->refs)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    --s->refs;
+
+    // Keep one fence per syncpoint, later values supersede earlier ones
+    if (fence) {
+        auto it = std::ranges::find_if(s->fences, [fence](Fence f) { return fence_id(f) == fence_id(fence); });
+        if (it != s->fences.end())
+            *it = fence;
+        else
+            s->fences.emplace_back(fence);
+    }
+
+    return 0;
+}
+
+int SurfacePool::resize(std::uint32_t width, std::uint32_t height, std::uint32_t num_surfaces) {
+    std::scoped_lock lk(this->lock);
+
+    SurfaceLayout layout;
+    ENVID_CHECK(compute_surface_layout(this->codec, this->subsample, this->depth, width, height, layout));
+
+    // Surfaces with the previous layout are left alone until they retire
+    this->layout       = layout;
+    this->num_surfaces = num_surfaces;
+
+    return this->reap();
+}
+
+SurfacePool::Surface *SurfacePool::find(std::uint32_t index) {
+    auto it = std::ranges::find_if(this->surfaces, [index](auto &s) { return s->index == index; });
+    return (it != this->surfaces.end()) ? it->get() : nullptr;
+}
+
+int SurfacePool::create_surface(Surface *&surface) {
+    EnvideoMap *map;
+    ENVID_CHECK(envideo_map_create(reinterpret_cast<EnvideoDevice *>(this->device), &map,
+                                   this->layout.size, this->device->page_size, this->flags));
+
+    auto guard = util::ScopeGuard([map] { envideo_map_destroy(map); });
+
+    for (auto *c: this->channels)
+        ENVID_CHECK(envideo_map_pin(map, reinterpret_cast<EnvideoChannel *>(c)));
+
+    auto s = std::make_unique<Surface>();
+    s->index  = this->next_index++;
+    s->map    = map;
+    s->layout = this->layout;
+
+    surface = this->surfaces.emplace_back(std::move(s)).get();
+    guard.cancel();
+
+    return 0;
+}
+
+int SurfacePool::destroy_surface(Surface &surface) {
+    return envideo_map_destroy(reinterpret_cast<EnvideoMap *>(surface.map));
+}
+
+int SurfacePool::retire_surface(Surface &surface) {
+    // Engines may still be writing to the surface, only one fence can be deferred on so wait for the others
+    std::erase_if(surface.fences, [this](Fence f) {
+        bool done;
+        return this->device->poll(f, done) == 0 && done;
+    });
+
+    while (surface.fences.size() > 1) {
+        // A surface that can't be waited on is leaked rather than released under the engine
+        ENVID_CHECK(this->device->wait(surface.fences.back(), release_timeout_us));
+        surface.fences.pop_back();
+    }
+
+    auto *map = reinterpret_cast<EnvideoMap *>(surface.map);
+    return surface.fences.empty() ? envideo_map_destroy(map) : envideo_map_destroy_deferred(map, surface.fences[0]);
+}
+
+int SurfacePool::is_idle(Surface &surface, bool &idle) {
+    idle = false;
+    if (surface.refs)
+        return 0;
+
+    for (auto it = surface.fences.begin(); it != surface.fences.end();) {
+        bool done;
+        ENVID_CHECK(this->device->poll(*it, done));
+        if (!done)
+            return 0;
+
+        it = surface.fences.erase(it);
+    }
+
+    idle = true;
+    return 0;
+}
+
+int SurfacePool::reap() {
+    // Destroy retired surfaces with a stale layout, and surplus ones after shrinking the pool
+    std::uint32_t num_current = std::ranges::count_if(this->surfaces, [this](auto &s) { return this->is_current(*s); });
+
+    for (auto it = this->surfaces.begin(); it != this->surfaces.end();) {
+        auto &s = **it;
+
+        bool current = this->is_current(s);
+        if (current && num_current <= this->num_surfaces) {
+            ++it;
+            continue;
+        }
+
+        bool idle;
+        ENVID_CHECK(this->is_idle(s, idle));
+        if (!idle) {
+            ++it;
+            continue;
+        }
+
+        ENVID_CHECK(this->destroy_surface(s));
+        it = this->surfaces.erase(it);
+
+        if (current)
+            --num_current;
+    }
+
+    return 0;
+}
+
+void SurfacePool::fill(const Surface &surface, EnvideoPoolSurface &out) const {
+    auto &l   = surface.layout;
+    auto *map = reinterpret_cast<EnvideoMap *>(surface.map);
+
+    out = EnvideoPoolSurface{
+        .index = surface.index,
+        .map   = map,
+        .luma = {
+            .map        = map,
+            .map_offset = l.luma_offset,
+            .width      = l.luma_width,
+            .height     = l.luma_height,
+            .stride     = l.luma_stride,
+            .tiled      = true,
+            .gob_height = l.gob_height,
+        },
+        .chroma = {
+            .map        = map,
+            .map_offset = l.chroma_offset,
+            .width      = l.chroma_width,
+            .height     = l.chroma_height,
+            .stride     = l.chroma_stride,
+            .tiled      = true,
+            .gob_height = l.gob_height,
+        },
+    };
+}
+
+} // namespace envid
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <errno.h>
+
+#include <envideo.h>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+// Plane arrangement of a surface format, subsampling factors are expressed as shifts
+struct FormatPlane {
+    std::uint8_t shift_x = 0, shift_y = 0;
+    std::uint8_t components = 1;
+};
+
+struct FormatDesc {
+    std::uint32_t num_planes = 0;
+    FormatPlane   planes[ENVIDEO_MAX_PLANES];
+};
+
+constexpr FormatDesc get_format_desc(EnvideoSurfaceFormat format) {
+    switch (format) {
+        case EnvideoSurfaceFormat_Gray: return { 1, { {0, 0, 1}                         } };
+        case EnvideoSurfaceFormat_Nv12: return { 2, { {0, 0, 1}, {1, 1, 2}              } };
+        case EnvideoSurfaceFormat_Nv16: return { 2, { {0, 0, 1}, {1, 0, 2}              } };
+        case EnvideoSurfaceFormat_Nv24: return { 2, { {0, 0, 1}, {0, 0, 2}              } };
+        case EnvideoSurfaceFormat_I420: return { 3, { {0, 0, 1}, {1, 1, 1}, {1, 1, 1}   } };
+        case EnvideoSurfaceFormat_I422: return { 3, { {0, 0, 1}, {1, 0, 1}, {1, 0, 1}   } };
+        case EnvideoSurfaceFormat_I444: return { 3, { {0, 0, 1}, {0, 0, 1}, {0, 0, 1}   } };
+        default:                        return {};
+    }
+}
+
+constexpr bool is_valid_depth(int depth) {
+    return depth == 8 || depth == 10 || depth == 12 || depth == 16;
+}
+
+// Visible dimensions of a plane, the width in bytes
+constexpr void get_plane_size(const FormatPlane &plane, int depth, std::uint32_t width, std::uint32_t height,
+                              std::uint32_t &plane_width, std::uint32_t &plane_height)
+{
+    auto bpp     = (depth > 8) ? 2u : 1u;
+    plane_width  = ((width  + (1u << plane.shift_x) - 1) >> plane.shift_x) * plane.components * bpp;
+    plane_height =  (height + (1u << plane.shift_y) - 1) >> plane.shift_y;
+}
+
+// Layout of a frame with the planes of desc, laid out for coded dimensions aligned to coded_align.
+// Usable in constant expressions, e.g. to size pools of a fixed format.
+constexpr int compute_frame_layout(const FormatDesc &desc, int depth, std::uint32_t width, std::uint32_t height,
+                                   bool tiled, std::size_t alignment, EnvideoSurfaceLayout &layout,
+                                   std::uint32_t coded_align = 1)
+{
+    if (!desc.num_planes || !width || !height || !is_valid_depth(depth))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto bpp = (depth > 8) ? 2u : 1u;
+
+    auto coded_width  = util::align_up(width,  coded_align);
+    auto coded_height = util::align_up(height, coded_align);
+
+    auto luma_stride       = util::align_up(coded_width, std::uint32_t(ENVIDEO_WIDTH_ALIGN(bpp))) * bpp;
+    auto luma_alloc_height = tiled ? util::align_up(coded_height, std::uint32_t(ENVIDEO_HEIGHT_ALIGN(bpp))) : coded_height;
+
+    layout = {
+        .num_planes = desc.num_planes,
+        .tiled      = tiled,
+        .gob_height = std::uint8_t(tiled ? 2 : 0),
+        .alignment  = alignment,
+    };
+
+    std::size_t offset = 0;
+    for (std::uint32_t i = 0; i < desc.num_planes; ++i) {
+        auto &p = desc.planes[i];
+        auto &l = layout.planes[i];
+
+        get_plane_size(p, depth, width, height, l.width, l.height);
+
+        // Chroma strides derive from the luma one, so that semi-planar formats share a single pitch
+        l.stride       = i ? util::align_up((luma_stride >> p.shift_x) * p.components, 64u) : luma_stride;
+        l.alloc_height = tiled ? luma_alloc_height >> p.shift_y :
+                                 (coded_height + (1u << p.shift_y) - 1) >> p.shift_y;
+        l.offset       = offset;
+
+        offset = util::align_up(offset + std::size_t(l.stride) * l.alloc_height, std::size_t(ENVIDEO_MAP_ALIGN));
+    }
+
+    layout.size = offset;
+    return 0;
+}
+
+constexpr int compute_frame_layout(EnvideoSurfaceFormat format, int depth, std::uint32_t width, std::uint32_t height,
+                                   bool tiled, std::size_t alignment, EnvideoSurfaceLayout &layout)
+{
+    return compute_frame_layout(get_format_desc(format), depth, width, height, tiled, alignment, layout);
+}
+
+// Placement of the planes of a tiled, semi-planar framebuffer
+struct SurfaceLayout {
+    std::uint32_t bpp = 0;
+    std::uint32_t width = 0, height = 0;                                        // Visible dimensions
+    std::uint32_t luma_width   = 0, luma_height   = 0, luma_stride   = 0;       // Widths in bytes
+    std::uint32_t chroma_width = 0, chroma_height = 0, chroma_stride = 0;
+    std::uint32_t luma_offset  = 0, chroma_offset = 0;
+    std::uint32_t luma_alloc_height = 0, chroma_alloc_height = 0;
+    std::size_t   size = 0;
+    std::uint8_t  gob_height = 0;
+};
+
+int compute_surface_layout(EnvideoCodec codec, EnvideoPixelFormat subsample, int depth,
+                           std::uint32_t width, std::uint32_t height, SurfaceLayout &layout);
+
+class SurfacePool {
+    public:
+        struct Surface {
+            std::uint32_t index = 0;
+            Map          *map   = nullptr;
+            SurfaceLayout layout;
+
+            std::uint32_t      refs = 0;
+            std::vector<Fence> fences;
+        };
+
+    public:
+        SurfacePool(envid::Device *device, const EnvideoSurfacePoolParams &params);
+        int initialize(std::uint32_t width, std::uint32_t height);
+        int finalize();
+
+        int acquire(EnvideoPoolSurface &surface);
+        int ref(std::uint32_t index);
+        int release(std::uint32_t index, envid::Fence fence);
+        int resize(std::uint32_t width, std::uint32_t height, std::uint32_t num_surfaces);
+
+    private:
+        Surface *find(std::uint32_t index);
+        int create_surface(Surface *&surface);
+        int destroy_surface(Surface &surface);
+        // Destroys the surface once its pending release fences have signaled
+        int retire_surface(Surface &surface);
+        int is_idle(Surface &surface, bool &idle);
+        int reap();
+        void fill(const Surface &surface, EnvideoPoolSurface &out) const;
+
+        // Surfaces can be reused as long as the placement of their planes is unchanged
+        bool is_current(const Surface &surface) const {
+            auto &a = surface.layout, &b = this->layout;
+            return a.luma_stride   == b.luma_stride   && a.chroma_stride == b.chroma_stride &&
+                   a.chroma_offset == b.chroma_offset && a.size          == b.size;
+        }
+
+    public:
+        Device *device = nullptr;
+
+    private:
+        std::mutex lock;
+
+        EnvideoCodec       codec;
+        EnvideoPixelFormat subsample;
+        int                depth;
+        EnvideoMapFlags    flags;
+        std::uint32_t      num_surfaces;
+
+        SurfaceLayout          layout;
+        std::vector<Channel *> channels;
+
+        std::uint32_t next_index = 0;
+        std::vector<std::unique_ptr<Surface>> surfaces;
+};
+
+} // namespace envid
+
+struct EnvideoSurfacePool: public envid::SurfacePool { };
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define ENVID_SWIZZLE_X86
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define ENVID_SWIZZLE_NEON
+#endif
+
+#include "util.hpp"
+#include "swizzle.hpp"
+
+namespace envid {
+
+namespace {
+
+constexpr std::uint32_t gob_width = 64, gob_rows = 8, gob_size = gob_width * gob_rows;
+
+// Rows handled by a thread, below which splitting the work is not worth it
+constexpr std::uint32_t min_band_rows = 64;
+constexpr std::uint32_t max_threads   = 8;
+
+// Gobs are made of 16Bx2 sectors, arranged in two 32B-wide columns of 4 sectors each
+constexpr std::uint32_t gob_offset(std::uint32_t x, std::uint32_t y) {
+    return ((x % 64) / 32) * 256 + ((y % 8) / 2) * 64 + ((x % 32) / 16) * 32 + (y % 2) * 16 + (x % 16);
+}
+
+// Blocks are one gob wide and gob_height gobs high, laid out in rows spanning the surface
+std::size_t gob_address(const EnvideoSwizzleParams &p, std::uint32_t x, std::uint32_t y) {
+    auto block_size = std::size_t(gob_size) * p.gob_height;
+    return std::size_t(y / (gob_rows * p.gob_height)) * (p.tiled_stride / gob_width) * block_size +
+           std::size_t(x / gob_width) * block_size + (y / gob_rows % p.gob_height) * gob_size;
+}
+
+// Kernels convert one complete gob, partial ones at the edges of the region go through the scalar path
+using GobKernel = void (*)(std::uint8_t *tiled, std::uint8_t *linear, std::size_t stride);
+
+template <bool Swizzle>
+void gob_scalar(std::uint8_t *tiled, std::uint8_t *linear, std::size_t stride,
+                std::uint32_t width = gob_width, std::uint32_t rows = gob_rows)
+{
+    for (std::uint32_t y = 0; y < rows; ++y) {
+        for (std::uint32_t x = 0; x < width; ++x) {
+            if constexpr (Swizzle)
+                tiled[gob_offset(x, y)] = linear[y * stride + x];
+            else
+                linear[y * stride + x] = tiled[gob_offset(x, y)];
+        }
+    }
+}
+
+#ifdef ENVID_SWIZZLE_X86
+
+// Rows are moved in 16B sectors. Tiled reads use streaming loads when aligned,
+// which avoids the slow uncached path when the source is write-combined device memory
+template <bool Swizzle>
+__attribute__((target("sse4.1")))
+void gob_sse4(std::uint8_t *tiled, std::uint8_t *linear, std::size_t stride) {
+    bool aligned = !(reinterpret_cast<std::uintptr_t>(tiled) & 15);
+
+    for (std::uint32_t y = 0; y < gob_rows; ++y) {
+        auto *l = linear + y * stride;
+        auto *t = tiled  + (y / 2) * 64 + (y % 2) * 16;
+
+        for (std::uint32_t x = 0; x < gob_width; x += 16) {
+            auto *ts = reinterpret_cast<__m128i *>(t + (x / 32) * 256 + (x % 32 / 16) * 32);
+            auto *ls = reinterpret_cast<__m128i *>(l + x);
+
+            if constexpr (Swizzle)
+                _mm_storeu_si128(ts, _mm_loadu_si128(ls));
+            else
+                _mm_storeu_si128(ls, aligned ? _mm_stream_load_si128(ts) : _mm_loadu_si128(ts));
+        }
+    }
+}
+
+// Pairs of rows are interleaved sector by sector, which maps to 128-bit lane permutes
+template <bool Swizzle>
+__attribute__((target("avx2")))
+void gob_avx2(std::uint8_t *tiled, std::uint8_t *linear, std::size_t stride) {
+    for (std::uint32_t y = 0; y < gob_rows; y += 2) {
+        auto *l0 = linear + y * stride, *l1 = l0 + stride;
+        auto *t  = tiled  + (y / 2) * 64;
+
+        for (std::uint32_t x = 0; x < gob_width; x += 32) {
+            auto *ts = reinterpret_cast<__m256i *>(t + (x / 32) * 256);
+            auto *a  = reinterpret_cast<__m256i *>(l0 + x), *b = reinterpret_cast<__m256i *>(l1 + x);
+
+            if constexpr (Swizzle) {
+                auto va = _mm256_loadu_si256(a), vb = _mm256_loadu_si256(b);
+                _mm256_storeu_si256(ts + 0, _mm256_permute2x128_si256(va, vb, 0x20));
+                _mm256_storeu_si256(ts + 1, _mm256_permute2x128_si256(va, vb, 0x31));
+            } else {
+                auto v0 = _mm256_loadu_si256(ts + 0), v1 = _mm256_loadu_si256(ts + 1);
+                _mm256_storeu_si256(a, _mm256_permute2x128_si256(v0, v1, 0x20));
+                _mm256_storeu_si256(b, _mm256_permute2x128_si256(v0, v1, 0x31));
+            }
+        }
+    }
+}
+
+#endif // ENVID_SWIZZLE_X86
+
+#ifdef ENVID_SWIZZLE_NEON
+
+// Same pairing as the avx2 kernel, with 64B structure loads and stores
+template <bool Swizzle>
+void gob_neon(std::uint8_t *tiled, std::uint8_t *linear, std::size_t stride) {
+    for (std::uint32_t y = 0; y < gob_rows; y += 2) {
+        auto *l0 = linear + y * stride, *l1 = l0 + stride;
+        auto *t  = tiled  + (y / 2) * 64;
+
+        for (std::uint32_t x = 0; x < gob_width; x += 32) {
+            auto *ts = t + (x / 32) * 256;
+
+            if constexpr (Swizzle) {
+                auto a = vld1q_u8_x2(l0 + x), b = vld1q_u8_x2(l1 + x);
+                vst1q_u8_x4(ts, uint8x16x4_t{{ a.val[0], b.val[0], a.val[1], b.val[1] }});
+            } else {
+                auto v = vld1q_u8_x4(ts);
+                vst1q_u8_x2(l0 + x, uint8x16x2_t{{ v.val[0], v.val[2] }});
+                vst1q_u8_x2(l1 + x, uint8x16x2_t{{ v.val[1], v.val[3] }});
+            }
+        }
+    }
+}
+
+#endif // ENVID_SWIZZLE_NEON
+
+EnvideoSwizzleKernel resolve_kernel(EnvideoSwizzleKernel kernel) {
+    if (kernel != EnvideoSwizzleKernel_Auto)
+        return kernel;
+
+    for (auto k: { EnvideoSwizzleKernel_Avx2, EnvideoSwizzleKernel_Sse4, EnvideoSwizzleKernel_Neon }) {
+        if (swizzle_kernel_supported(k))
+            return k;
+    }
+
+    return EnvideoSwizzleKernel_Scalar;
+}
+
+template <bool Swizzle>
+GobKernel get_kernel(EnvideoSwizzleKernel kernel) {
+    switch (kernel) {
+#ifdef ENVID_SWIZZLE_X86
+        case EnvideoSwizzleKernel_Sse4:
+            return gob_sse4<Swizzle>;
+        case EnvideoSwizzleKernel_Avx2:
+            return gob_avx2<Swizzle>;
+#endif
+#ifdef ENVID_SWIZZLE_NEON
+        case EnvideoSwizzleKernel_Neon:
+            return gob_neon<Swizzle>;
+#endif
+        default:
+            return [](std::uint8_t *tiled, std::uint8_t *linear, std::size_t stride) {
+                gob_scalar<Swizzle>(tiled, linear, stride);
+            };
+    }
+}
+
+// Converts rows [y0, y1), y0 being a multiple of the gob height
+template <bool Swizzle>
+void convert_band(const EnvideoSwizzleParams &p, std::uint8_t *tiled, std::uint8_t *linear,
+                  GobKernel kernel, std::uint32_t y0, std::uint32_t y1)
+{
+    for (auto y = y0; y < y1; y += gob_rows) {
+        auto rows = std::min(gob_rows, y1 - y);
+
+        for (std::uint32_t x = 0; x < p.width; x += gob_width) {
+            auto *t    = tiled  + gob_address(p, x, y);
+            auto *l    = linear + std::size_t(y) * p.linear_stride + x;
+            auto width = std::min(gob_width, p.width - x);
+
+            if (width == gob_width && rows == gob_rows)
+                kernel(t, l, p.linear_stride);
+            else
+                gob_scalar<Swizzle>(t, l, p.linear_stride, width, rows);
+        }
+    }
+}
+
+// Splits rows [0, num_rows) in bands of a multiple of granularity rows, run concurrently
+template <typename F>
+void run_bands(std::uint32_t num_rows, std::uint32_t granularity, std::uint32_t num_threads, F fn) {
+    auto num_units = (num_rows + granularity - 1) / granularity;
+    if (!num_threads)
+        num_threads = std::min({ std::max(std::thread::hardware_concurrency(), 1u), max_threads,
+                                 std::max(num_rows / min_band_rows, 1u) });
+    num_threads = std::min(num_threads, num_units);
+
+    auto band_rows = (num_units + num_threads - 1) / num_threads * granularity;
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (std::uint32_t i = 1; i < num_threads; ++i) {
+        auto y0 = i * band_rows, y1 = std::min(y0 + band_rows, num_rows);
+        if (y0 < y1)
+            threads.emplace_back(fn, y0, y1);
+    }
+
+    fn(0, std::min(band_rows, num_rows));
+
+    for (auto &t: threads)
+        t.join();
+}
+
+template <bool Swizzle>
+int convert(std::uint8_t *tiled, std::uint8_t *linear, const EnvideoSwizzleParams &p) {
+    if (!tiled || !linear || !p.width || !p.height)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!p.gob_height || p.gob_height > 32 || !std::has_single_bit(p.gob_height) ||
+            (p.tiled_stride % gob_width) || p.width > p.tiled_stride || p.width > p.linear_stride)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto kernel = resolve_kernel(p.kernel);
+    if (!swizzle_kernel_supported(kernel))
+        return ENVIDEO_RC_SYSTEM(ENOTSUP);
+
+    auto fn = get_kernel<Swizzle>(kernel);
+
+    // Bands are made of whole gob rows, so that no gob is shared between threads
+    run_bands(p.height, gob_rows, p.num_threads, [&](std::uint32_t y0, std::uint32_t y1) {
+        convert_band<Swizzle>(p, tiled, linear, fn, y0, y1);
+    });
+
+    return 0;
+}
+
+// Pixels never straddle a 16B sector, so each one is read contiguously
+void subsample_band(const EnvideoSwizzleParams &p, const std::uint8_t *tiled, std::uint8_t *linear,
+                    std::uint32_t pixel_size, std::uint32_t step_x, std::uint32_t step_y,
+                    std::uint32_t out_width, std::uint32_t y0, std::uint32_t y1)
+{
+    for (auto r = y0; r < y1; ++r) {
+        auto *l = linear + std::size_t(r) * p.linear_stride;
+        auto  y = r * step_y;
+
+        for (std::uint32_t c = 0; c < out_width; ++c) {
+            auto x = c * step_x * pixel_size;
+            std::memcpy(l + c * pixel_size, tiled + gob_address(p, x, y) + gob_offset(x, y), pixel_size);
+        }
+    }
+}
+
+} // namespace
+
+bool swizzle_kernel_supported(EnvideoSwizzleKernel kernel) {
+    switch (kernel) {
+        case EnvideoSwizzleKernel_Auto:
+        case EnvideoSwizzleKernel_Scalar:
+            return true;
+#ifdef ENVID_SWIZZLE_X86
+        case EnvideoSwizzleKernel_Sse4:
+            return __builtin_cpu_supports("sse4.1");
+        case EnvideoSwizzleKernel_Avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#ifdef ENVID_SWIZZLE_NEON
+        case EnvideoSwizzleKernel_Neon:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+int swizzle(void *tiled, const void *linear, const EnvideoSwizzleParams &params) {
+    return convert<true>(static_cast<std::uint8_t *>(tiled),
+                         static_cast<std::uint8_t *>(const_cast<void *>(linear)), params);
+}
+
+int deswizzle(void *linear, const void *tiled, const EnvideoSwizzleParams &params) {
+    return convert<false>(static_cast<std::uint8_t *>(const_cast<void *>(tiled)),
+                          static_cast<std::uint8_t *>(linear), params);
+}
+
+int deswizzle_subsampled(void *linear, const void *tiled, const EnvideoSwizzleParams &params,
+                         std::uint32_t pixel_size, std::uint32_t step_x, std::uint32_t step_y)
+{
+    auto &p = params;
+    if (!tiled || !linear || !p.width || !p.height || !step_x || !step_y)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (!std::has_single_bit(pixel_size) || pixel_size > 16 || (p.width % pixel_size))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto out_width  = (p.width / pixel_size + step_x - 1) / step_x,
+         out_height = (p.height + step_y - 1) / step_y;
+
+    if (!p.gob_height || p.gob_height > 32 || !std::has_single_bit(p.gob_height) ||
+            (p.tiled_stride % gob_width) || p.width > p.tiled_stride || out_width * pixel_size > p.linear_stride)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    run_bands(out_height, 1, p.num_threads, [&](std::uint32_t y0, std::uint32_t y1) {
+        subsample_band(p, static_cast<const std::uint8_t *>(tiled), static_cast<std::uint8_t *>(linear),
+                       pixel_size, step_x, step_y, out_width, y0, y1);
+    });
+
+    return 0;
+}
+
+} // namespace envid
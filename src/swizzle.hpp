@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <envideo.h>
+
+namespace envid {
+
+// Cpu conversions between block-linear and pitch layouts, split in row bands across threads
+int swizzle  (void *tiled, const void *linear, const EnvideoSwizzleParams &params);
+int deswizzle(void *linear, const void *tiled, const EnvideoSwizzleParams &params);
+
+// Keeps one pixel out of step_x and one row out of step_y, through the scalar path
+int deswizzle_subsampled(void *linear, const void *tiled, const EnvideoSwizzleParams &params,
+                         std::uint32_t pixel_size, std::uint32_t step_x, std::uint32_t step_y);
+
+bool swizzle_kernel_supported(EnvideoSwizzleKernel kernel);
+
+} // namespace envid
@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include <errno.h>
+
+#include <nvmisc.h>
+#include <clc7b5.h>
+
+#include "util.hpp"
+#include "surface.hpp"
+#include "transfer.hpp"
+
+namespace envid {
+
+namespace {
+
+// Pitch surfaces are offset to their origin, block-linear ones are addressed from their base
+std::uint32_t get_origin_offset(const EnvideoSurfaceInfo &s) {
+    return s.map_offset + (!s.tiled ? s.y * s.stride + s.x : 0);
+}
+
+// Copy of a source plane into a destination plane, select giving the source component written to each
+// destination component, or -1 to leave it untouched
+struct ConvertLaunch {
+    std::uint32_t src_plane, dst_plane;
+    std::uint32_t src_components, dst_components;
+    int           select[2];
+};
+
+// Narrowed samples keep their high byte, which is the second one of each little-endian word
+Remap make_remap(const ConvertLaunch &launch, std::uint32_t bpp, bool narrow) {
+    auto remap = Remap{
+        .component_size = narrow ? 1 : bpp,
+        .src_components = launch.src_components * (narrow ? 2 : 1),
+        .dst_components = launch.dst_components,
+    };
+
+    for (std::uint32_t i = 0; i < 4; ++i) {
+        auto sel = (i < launch.dst_components) ? launch.select[i] : -1;
+        remap.selectors[i] = (sel < 0) ? NVC7B5_SET_REMAP_COMPONENTS_DST_X_NO_WRITE :
+            NVC7B5_SET_REMAP_COMPONENTS_DST_X_SRC_X + (narrow ? sel * 2 + 1 : sel);
+    }
+
+    return remap;
+}
+
+} // namespace
+
+// Block-linear origins are programmed in 16-bit fields
+bool is_valid_surface(const EnvideoSurfaceInfo &s) {
+    return s.map && s.width && s.height && s.stride && std::uint64_t(s.x) + s.width <= s.stride &&
+        (!s.tiled || (s.gob_height && s.gob_height <= 32 && std::has_single_bit(s.gob_height) &&
+                      s.x <= 0xffff && s.y <= 0xffff));
+}
+
+int TransferEmitter::set(std::uint32_t method, std::uint32_t value) {
+    auto it = std::ranges::find(this->values, method, &decltype(this->values)::value_type::first);
+    if (it != this->values.end()) {
+        if (it->second == value)
+            return 0;
+        it->second = value;
+    } else {
+        this->values.emplace_back(method, value);
+    }
+
+    return this->push(method, value);
+}
+
+int TransferEmitter::push(std::uint32_t method, std::uint32_t value) {
+    ++this->num_methods;
+    return !this->dry_run ? this->cmdbuf.push_value(method, value) : 0;
+}
+
+int TransferEmitter::push_reloc(std::uint32_t method, const EnvideoSurfaceInfo &s, std::uint32_t offset) {
+    ++this->num_methods;
+    return !this->dry_run ? this->cmdbuf.push_reloc(method, s.map, offset,
+        !s.tiled ? EnvideoRelocType_Pitch : EnvideoRelocType_Tiled, 0) : 0;
+}
+
+int TransferEmitter::transfer(const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst, bool first, bool last,
+                              const Remap *remap)
+{
+    auto flags = (first ? DRF_DEF(C7B5, _LAUNCH_DMA, _DATA_TRANSFER_TYPE, _NON_PIPELINED) :
+                          DRF_DEF(C7B5, _LAUNCH_DMA, _DATA_TRANSFER_TYPE, _PIPELINED))    |
+                 (last  ? DRF_DEF(C7B5, _LAUNCH_DMA, _FLUSH_ENABLE,       _TRUE)          :
+                          DRF_DEF(C7B5, _LAUNCH_DMA, _FLUSH_ENABLE,       _FALSE))        |
+                 DRF_DEF(C7B5, _LAUNCH_DMA, _MULTI_LINE_ENABLE, _TRUE);
+
+    // Horizontal dimensions are counted in pixels when remapping, pitches stay in bytes
+    auto src_pixel_size = remap ? remap->src_pixel_size() : 1u,
+         dst_pixel_size = remap ? remap->dst_pixel_size() : 1u;
+
+    if (remap) {
+        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _REMAP_ENABLE, _TRUE);
+        ENVID_CHECK(this->set(NVC7B5_SET_REMAP_COMPONENTS,
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _DST_X,              remap->selectors[0])        |
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _DST_Y,              remap->selectors[1])        |
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _DST_Z,              remap->selectors[2])        |
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _DST_W,              remap->selectors[3])        |
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _COMPONENT_SIZE,     remap->component_size - 1)  |
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _NUM_SRC_COMPONENTS, remap->src_components - 1)  |
+            DRF_NUM(C7B5, _SET_REMAP_COMPONENTS, _NUM_DST_COMPONENTS, remap->dst_components - 1)));
+    }
+
+    ENVID_CHECK(this->push_reloc(NVC7B5_OFFSET_IN_UPPER,  src, get_origin_offset(src)));
+    ENVID_CHECK(this->push_reloc(NVC7B5_OFFSET_OUT_UPPER, dst, get_origin_offset(dst)));
+
+    if (src.tiled) {
+        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _SRC_MEMORY_LAYOUT, _BLOCKLINEAR);
+        ENVID_CHECK(this->set(NVC7B5_SET_SRC_BLOCK_SIZE,
+            DRF_DEF(C7B5, _SET_SRC_BLOCK_SIZE, _WIDTH,      _ONE_GOB)                         |
+            DRF_NUM(C7B5, _SET_SRC_BLOCK_SIZE, _HEIGHT,     std::countr_zero(src.gob_height)) |
+            DRF_DEF(C7B5, _SET_SRC_BLOCK_SIZE, _DEPTH,      _ONE_GOB)                         |
+            DRF_DEF(C7B5, _SET_SRC_BLOCK_SIZE, _GOB_HEIGHT, _GOB_HEIGHT_FERMI_8)));
+        ENVID_CHECK(this->set(NVC7B5_SET_SRC_WIDTH,  src.stride / src_pixel_size));
+        ENVID_CHECK(this->set(NVC7B5_SET_SRC_HEIGHT, src.y + src.height));
+        ENVID_CHECK(this->set(NVC7B5_SET_SRC_DEPTH,  1));
+        ENVID_CHECK(this->set(NVC7B5_SET_SRC_ORIGIN,
+            DRF_NUM(C7B5, _SET_SRC_ORIGIN, _X, src.x / src_pixel_size) |
+            DRF_NUM(C7B5, _SET_SRC_ORIGIN, _Y, src.y)));
+    } else {
+        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _SRC_MEMORY_LAYOUT, _PITCH);
+        ENVID_CHECK(this->set(NVC7B5_PITCH_IN, src.stride));
+    }
+
+    if (dst.tiled) {
+        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _DST_MEMORY_LAYOUT, _BLOCKLINEAR);
+        ENVID_CHECK(this->set(NVC7B5_SET_DST_BLOCK_SIZE,
+            DRF_DEF(C7B5, _SET_DST_BLOCK_SIZE, _WIDTH,      _ONE_GOB)                         |
+            DRF_NUM(C7B5, _SET_DST_BLOCK_SIZE, _HEIGHT,     std::countr_zero(dst.gob_height)) |
+            DRF_DEF(C7B5, _SET_DST_BLOCK_SIZE, _DEPTH,      _ONE_GOB)                         |
+            DRF_DEF(C7B5, _SET_DST_BLOCK_SIZE, _GOB_HEIGHT, _GOB_HEIGHT_FERMI_8)));
+        ENVID_CHECK(this->set(NVC7B5_SET_DST_WIDTH,  dst.stride / dst_pixel_size));
+        ENVID_CHECK(this->set(NVC7B5_SET_DST_HEIGHT, dst.y + dst.height));
+        ENVID_CHECK(this->set(NVC7B5_SET_DST_DEPTH,  1));
+        ENVID_CHECK(this->set(NVC7B5_SET_DST_ORIGIN,
+            DRF_NUM(C7B5, _SET_DST_ORIGIN, _X, dst.x / dst_pixel_size) |
+            DRF_NUM(C7B5, _SET_DST_ORIGIN, _Y, dst.y)));
+    } else {
+        flags |= DRF_DEF(C7B5, _LAUNCH_DMA, _DST_MEMORY_LAYOUT, _PITCH);
+        ENVID_CHECK(this->set(NVC7B5_PITCH_OUT, dst.stride));
+    }
+
+    ENVID_CHECK(this->set(NVC7B5_LINE_LENGTH_IN, src.width / src_pixel_size));
+    ENVID_CHECK(this->set(NVC7B5_LINE_COUNT,     std::min(src.height, dst.height)));
+
+    return this->push(NVC7B5_LAUNCH_DMA, flags);
+}
+
+void mark_surface_written(Cmdbuf &cmdbuf, const EnvideoSurfaceInfo &dst) {
+    std::size_t offset, len;
+    if (dst.tiled) {
+        auto first = util::align_down(dst.y,              8u * dst.gob_height),
+             last  = util::align_up  (dst.y + dst.height, 8u * dst.gob_height);
+        offset = dst.map_offset + std::size_t(dst.stride) * first;
+        len    = std::size_t(dst.stride) * (last - first);
+    } else {
+        // The padding after the last row may not belong to the surface, e.g. in imported caller memory
+        offset = get_origin_offset(dst);
+        len    = dst.height ? std::size_t(dst.stride) * (dst.height - 1) + dst.width : 0;
+    }
+
+    offset = std::min(offset, dst.map->size);
+    cmdbuf.mark_written(dst.map, offset, std::min(len, dst.map->size - offset));
+}
+
+int transfer_surface(Cmdbuf &cmdbuf, const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst) {
+    if (!is_valid_surface(src) || !is_valid_surface(dst))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    TransferEmitter emitter(cmdbuf);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    ENVID_CHECK(emitter.transfer(src, dst, true, true));
+    ENVID_CHECK(cmdbuf.end());
+
+    mark_surface_written(cmdbuf, dst);
+    return 0;
+}
+
+int transfer_frame(Cmdbuf &cmdbuf, EnvideoSurfaceFormat format, int depth, std::uint32_t width, std::uint32_t height,
+                   const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes)
+{
+    auto desc = get_format_desc(format);
+    if (!desc.num_planes || !is_valid_depth(depth) || !width || !height)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    EnvideoSurfaceInfo src[ENVIDEO_MAX_PLANES], dst[ENVIDEO_MAX_PLANES];
+    for (std::uint32_t i = 0; i < desc.num_planes; ++i) {
+        src[i] = src_planes[i], dst[i] = dst_planes[i];
+
+        get_plane_size(desc.planes[i], depth, width, height, src[i].width, src[i].height);
+        dst[i].width = src[i].width, dst[i].height = src[i].height;
+
+        if (!is_valid_surface(src[i]) || !is_valid_surface(dst[i]))
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+    }
+
+    // Planes are disjoint, so all launches after the first can overlap
+    TransferEmitter emitter(cmdbuf);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    for (std::uint32_t i = 0; i < desc.num_planes; ++i)
+        ENVID_CHECK(emitter.transfer(src[i], dst[i], i == 0, i == desc.num_planes - 1));
+    ENVID_CHECK(cmdbuf.end());
+
+    for (std::uint32_t i = 0; i < desc.num_planes; ++i)
+        mark_surface_written(cmdbuf, dst[i]);
+
+    return 0;
+}
+
+int transfer_batch(Cmdbuf &cmdbuf, const EnvideoSurfaceTransfer *transfers, std::uint32_t num_transfers) {
+    if (!num_transfers)
+        return 0;
+
+    for (std::uint32_t i = 0; i < num_transfers; ++i) {
+        if (!is_valid_surface(transfers[i].src) || !is_valid_surface(transfers[i].dst))
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+    }
+
+    // Pipelined launches can overlap, so a transfer waits for the earlier ones when it reads one of their
+    // destinations, or writes to one of their sources or destinations
+    std::vector<bool> needs_wait(num_transfers);
+    for (std::uint32_t i = 0; i < num_transfers; ++i) {
+        needs_wait[i] = (i == 0) || std::any_of(transfers, transfers + i,
+            [&t = transfers[i]](auto &prev) {
+                return prev.dst.map == t.src.map || prev.dst.map == t.dst.map || prev.src.map == t.dst.map;
+            });
+    }
+
+    // Size the sequence before recording it, so that a batch is never left partially recorded
+    TransferEmitter counter(cmdbuf, true);
+    for (std::uint32_t i = 0; i < num_transfers; ++i)
+        ENVID_CHECK(counter.transfer(transfers[i].src, transfers[i].dst, needs_wait[i], i == num_transfers - 1));
+
+    if (counter.get_num_methods() * TransferEmitter::max_method_words >= cmdbuf.free_words())
+        return ENVIDEO_RC_SYSTEM(ENOMEM);
+
+    TransferEmitter emitter(cmdbuf);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    for (std::uint32_t i = 0; i < num_transfers; ++i)
+        ENVID_CHECK(emitter.transfer(transfers[i].src, transfers[i].dst, needs_wait[i], i == num_transfers - 1));
+    ENVID_CHECK(cmdbuf.end());
+
+    for (std::uint32_t i = 0; i < num_transfers; ++i)
+        mark_surface_written(cmdbuf, transfers[i].dst);
+
+    return 0;
+}
+
+int convert_frame(Cmdbuf &cmdbuf, EnvideoSurfaceFormat src_format, int src_depth,
+                  EnvideoSurfaceFormat dst_format, int dst_depth, std::uint32_t width, std::uint32_t height,
+                  const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes)
+{
+    auto src_desc = get_format_desc(src_format), dst_desc = get_format_desc(dst_format);
+    if (!src_desc.num_planes || !dst_desc.num_planes || !is_valid_depth(src_depth) || !is_valid_depth(dst_depth) ||
+            !width || !height)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    // Samples can be narrowed to 8 bits but not widened, and chroma can be (de)interleaved but not resampled
+    auto src_bpp = (src_depth > 8) ? 2u : 1u, dst_bpp = (dst_depth > 8) ? 2u : 1u;
+    if (dst_bpp > src_bpp)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    if (dst_desc.num_planes > 1 && (src_desc.num_planes == 1 ||
+            src_desc.planes[1].shift_x != dst_desc.planes[1].shift_x ||
+            src_desc.planes[1].shift_y != dst_desc.planes[1].shift_y))
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    EnvideoSurfaceInfo src[ENVIDEO_MAX_PLANES], dst[ENVIDEO_MAX_PLANES];
+    for (std::uint32_t i = 0; i < src_desc.num_planes; ++i) {
+        src[i] = src_planes[i];
+        get_plane_size(src_desc.planes[i], src_depth, width, height, src[i].width, src[i].height);
+        if (!is_valid_surface(src[i]))
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+    }
+
+    for (std::uint32_t i = 0; i < dst_desc.num_planes; ++i) {
+        dst[i] = dst_planes[i];
+        get_plane_size(dst_desc.planes[i], dst_depth, width, height, dst[i].width, dst[i].height);
+        if (!is_valid_surface(dst[i]))
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+    }
+
+    // Luma is always copied as is, a gray destination only receives it
+    ConvertLaunch launches[3] = { { 0, 0, 1, 1, { 0, -1 } } };
+    std::uint32_t num_launches = 1;
+
+    if (dst_desc.num_planes > 1) {
+        auto src_semiplanar = src_desc.num_planes == 2, dst_semiplanar = dst_desc.num_planes == 2;
+        if (src_semiplanar && dst_semiplanar) {
+            launches[num_launches++] = { 1, 1, 2, 2, {  0,  1 } };
+        } else if (src_semiplanar) {
+            launches[num_launches++] = { 1, 1, 2, 1, {  0, -1 } };
+            launches[num_launches++] = { 1, 2, 2, 1, {  1, -1 } };
+        } else if (dst_semiplanar) {
+            launches[num_launches++] = { 1, 1, 1, 2, {  0, -1 } };
+            launches[num_launches++] = { 2, 1, 1, 2, { -1,  0 } };
+        } else {
+            launches[num_launches++] = { 1, 1, 1, 1, {  0, -1 } };
+            launches[num_launches++] = { 2, 2, 1, 1, {  0, -1 } };
+        }
+    }
+
+    auto narrow = dst_bpp < src_bpp;
+
+    TransferEmitter emitter(cmdbuf);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    for (std::uint32_t i = 0; i < num_launches; ++i) {
+        auto &l = launches[i];
+
+        // Identical component layouts are copied without remapping
+        auto is_copy = !narrow && l.src_components == l.dst_components && l.select[0] == 0 &&
+            (l.dst_components == 1 || l.select[1] == 1);
+        auto remap   = make_remap(l, src_bpp, narrow);
+
+        // Interleaving writes the same destination twice, so the second launch must not overlap the first
+        auto first = (i == 0) || (l.dst_plane == launches[i - 1].dst_plane);
+        ENVID_CHECK(emitter.transfer(src[l.src_plane], dst[l.dst_plane], first, i == num_launches - 1,
+                                     is_copy ? nullptr : &remap));
+    }
+    ENVID_CHECK(cmdbuf.end());
+
+    for (std::uint32_t i = 0; i < dst_desc.num_planes; ++i)
+        mark_surface_written(cmdbuf, dst[i]);
+
+    return 0;
+}
+
+int subsample_frame(Cmdbuf &cmdbuf, EnvideoSurfaceFormat format, int depth, std::uint32_t width, std::uint32_t height,
+                    const EnvideoSubsampleParams &params,
+                    const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes)
+{
+    auto desc = get_format_desc(format);
+    if (!desc.num_planes || !is_valid_depth(depth) || !width || !height || !params.step_x || !params.step_y)
+        return ENVIDEO_RC_SYSTEM(EINVAL);
+
+    auto bpp        = (depth > 8) ? 2u : 1u;
+    auto num_planes = params.luma_only ? 1u : desc.num_planes;
+
+    EnvideoSurfaceInfo src[ENVIDEO_MAX_PLANES], dst[ENVIDEO_MAX_PLANES];
+    Remap remaps[ENVIDEO_MAX_PLANES];
+    std::uint32_t full_groups[ENVIDEO_MAX_PLANES], pixel_sizes[ENVIDEO_MAX_PLANES];
+    for (std::uint32_t i = 0; i < num_planes; ++i) {
+        auto &p = desc.planes[i];
+
+        std::uint32_t plane_width, plane_height;
+        get_plane_size(p, depth, width, height, plane_width, plane_height);
+
+        auto pixel_size = p.components * bpp;
+        auto out_width  = (plane_width / pixel_size + params.step_x - 1) / params.step_x,
+             out_height = (plane_height + params.step_y - 1) / params.step_y;
+
+        // Columns are skipped by reading step_x pixels as the components of a single one, of which
+        // the first is kept. Remaps take up to 4 components.
+        if (p.components * params.step_x > 4)
+            return ENVIDEO_RC_SYSTEM(ENOTSUP);
+
+        // Reads are clamped to the plane, a trailing partial group is copied separately
+        full_groups[i] = plane_width / pixel_size / params.step_x;
+        pixel_sizes[i] = pixel_size;
+
+        src[i]        = src_planes[i];
+        src[i].width  = std::min(out_width * params.step_x * pixel_size, plane_width);
+        src[i].height = out_height;
+        if (!is_valid_surface(src[i]))
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+
+        // Rows are skipped by reading with a multiple of the pitch, which block-linear surfaces do not have
+        if (params.step_y > 1) {
+            if (src[i].tiled)
+                return ENVIDEO_RC_SYSTEM(ENOTSUP);
+
+            if (std::uint64_t(src[i].stride) * params.step_y > UINT32_MAX)
+                return ENVIDEO_RC_SYSTEM(EINVAL);
+
+            src[i].map_offset = get_origin_offset(src[i]);
+            src[i].x = src[i].y = 0;
+            src[i].stride    *= params.step_y;
+        }
+
+        dst[i]        = dst_planes[i];
+        dst[i].width  = out_width * pixel_size;
+        dst[i].height = out_height;
+        if (!is_valid_surface(dst[i]))
+            return ENVIDEO_RC_SYSTEM(EINVAL);
+
+        remaps[i] = {
+            .component_size = bpp,
+            .src_components = p.components * params.step_x,
+            .dst_components = p.components,
+        };
+
+        for (std::uint32_t j = 0; j < 4; ++j)
+            remaps[i].selectors[j] = (j < p.components) ? NVC7B5_SET_REMAP_COMPONENTS_DST_X_SRC_X + j :
+                                                          NVC7B5_SET_REMAP_COMPONENTS_DST_X_NO_WRITE;
+    }
+
+    // Planes skipping columns are remapped over their whole groups of step_x pixels, without column skipping
+    // they are copied as they are
+    struct Launch {
+        EnvideoSurfaceInfo src, dst;
+        const Remap *remap;
+    };
+
+    std::array<Launch, 2 * ENVIDEO_MAX_PLANES> launches;
+    std::uint32_t num_launches = 0;
+    for (std::uint32_t i = 0; i < num_planes; ++i) {
+        if (params.step_x == 1) {
+            launches[num_launches++] = { src[i], dst[i], nullptr };
+            continue;
+        }
+
+        auto group_size = params.step_x * pixel_sizes[i];
+        if (full_groups[i]) {
+            auto s = src[i], d = dst[i];
+            s.width = full_groups[i] * group_size;
+            d.width = full_groups[i] * pixel_sizes[i];
+            launches[num_launches++] = { s, d, &remaps[i] };
+        }
+
+        // The first pixel of a trailing partial group, read on its own
+        if (src[i].width > full_groups[i] * group_size) {
+            auto s = src[i], d = dst[i];
+            s.x    += full_groups[i] * group_size;
+            d.x    += full_groups[i] * pixel_sizes[i];
+            s.width = d.width = pixel_sizes[i];
+            launches[num_launches++] = { s, d, nullptr };
+        }
+    }
+
+    TransferEmitter emitter(cmdbuf);
+
+    ENVID_CHECK(cmdbuf.begin(EnvideoEngine_Copy));
+    for (std::uint32_t i = 0; i < num_launches; ++i)
+        ENVID_CHECK(emitter.transfer(launches[i].src, launches[i].dst, i == 0, i == num_launches - 1,
+                                     launches[i].remap));
+    ENVID_CHECK(cmdbuf.end());
+
+    for (std::uint32_t i = 0; i < num_planes; ++i)
+        mark_surface_written(cmdbuf, dst[i]);
+
+    return 0;
+}
+
+} // namespace envid
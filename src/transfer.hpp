@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <envideo.h>
+
+#include "common.hpp"
+
+namespace envid {
+
+// Reordering of the components of each pixel during a copy, selectors are SET_REMAP_COMPONENTS values
+struct Remap {
+    std::uint32_t component_size = 1;                    // In bytes
+    std::uint32_t src_components = 1, dst_components = 1;
+    std::uint32_t selectors[4]   = {};
+
+    std::uint32_t src_pixel_size() const { return this->component_size * this->src_components; }
+    std::uint32_t dst_pixel_size() const { return this->component_size * this->dst_components; }
+};
+
+// Records 2D copy engine launches between surfaces.
+// Registers keep their value across the launches of a sequence, so writes of unchanged values are elided.
+// In a dry run nothing is recorded, and only the method writes are counted.
+class TransferEmitter {
+    public:
+        // Words taken by a method write on any backend, relocations included
+        constexpr static std::uint32_t max_method_words = 3;
+
+    public:
+        TransferEmitter(Cmdbuf &cmdbuf, bool dry_run = false): cmdbuf(cmdbuf), dry_run(dry_run) { }
+
+        // Only the first launch of a sequence waits for previous work, and only the last one flushes
+        // With a remap, the width of the source is still expressed in bytes
+        int transfer(const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst, bool first, bool last,
+                     const Remap *remap = nullptr);
+
+        std::size_t get_num_methods() const {
+            return this->num_methods;
+        }
+
+    private:
+        int set(std::uint32_t method, std::uint32_t value);
+        int push(std::uint32_t method, std::uint32_t value);
+        int push_reloc(std::uint32_t method, const EnvideoSurfaceInfo &s, std::uint32_t offset);
+
+    private:
+        Cmdbuf     &cmdbuf;
+        bool        dry_run;
+        std::size_t num_methods = 0;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> values;
+};
+
+// Non-empty surfaces whose rows fit in their stride, with an origin and block size the engine can express
+bool is_valid_surface(const EnvideoSurfaceInfo &s);
+
+// Declares the extent of the destination as written, from its origin to the end of its last row for pitch
+// surfaces, and spanning whole blocks for block-linear ones
+void mark_surface_written(Cmdbuf &cmdbuf, const EnvideoSurfaceInfo &dst);
+
+int transfer_surface(Cmdbuf &cmdbuf, const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst);
+
+int transfer_frame(Cmdbuf &cmdbuf, EnvideoSurfaceFormat format, int depth, std::uint32_t width, std::uint32_t height,
+                   const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes);
+
+// Launches after the first one are pipelined, unless they read a destination of the batch or write to any of its maps
+int transfer_batch(Cmdbuf &cmdbuf, const EnvideoSurfaceTransfer *transfers, std::uint32_t num_transfers);
+
+int convert_frame(Cmdbuf &cmdbuf, EnvideoSurfaceFormat src_format, int src_depth,
+                  EnvideoSurfaceFormat dst_format, int dst_depth, std::uint32_t width, std::uint32_t height,
+                  const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes);
+
+// Keeps one pixel out of step_x and one row out of step_y of each plane, or of the luma plane only.
+// Returns ENOTSUP when the engine cannot express the subsampling, e.g. skipping rows of a block-linear source.
+int subsample_frame(Cmdbuf &cmdbuf, EnvideoSurfaceFormat format, int depth, std::uint32_t width, std::uint32_t height,
+                    const EnvideoSubsampleParams &params,
+                    const EnvideoSurfaceInfo *src_planes, const EnvideoSurfaceInfo *dst_planes);
+
+// Transfers a frame straight into caller memory, imported for the duration of the copy, and waits for completion.
+// Rows sharing an ENVIDEO_MAP_ALIGN block with memory outside of their plane are staged in a bounce map,
+// and copied in place by the cpu.
+int download_frame(Channel &channel, Cmdbuf &cmdbuf, EnvideoSurfaceFormat format, int depth,
+                   std::uint32_t width, std::uint32_t height, const EnvideoSurfaceInfo *src_planes,
+                   void *const *dst, const std::uint32_t *dst_linesizes, std::uint64_t timeout_us);
+
+class CopyGroup {
+    public:
+        // Dimensions of the frame used for tuning
+        constexpr static std::uint32_t tune_width = 3840, tune_height = 2160, tune_iterations = 4;
+
+        struct Lane {
+            EnvideoChannel *channel    = nullptr;
+            EnvideoMap     *cmdbuf_map = nullptr;
+            EnvideoCmdbuf  *cmdbuf     = nullptr;
+            Fence           fence      = 0;      // Last submission, the cmdbuf is reused once it signals
+        };
+
+    public:
+        CopyGroup(envid::Device *device): device(device) { }
+        int initialize(std::uint32_t num_channels);
+        int finalize();
+
+        int transfer(const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst, Fence &fence);
+        int tune(std::uint32_t &num_splits);
+        int set_splits(std::uint32_t num_splits);
+
+    private:
+        int transfer_locked(const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst, Fence &fence);
+        int prepare(Lane &lane, const EnvideoSurfaceInfo &src, const EnvideoSurfaceInfo &dst);
+
+    public:
+        Device *device = nullptr;
+
+    private:
+        std::mutex lock;
+
+        std::vector<Lane> lanes;
+        std::uint32_t     num_splits = 0;
+};
+
+} // namespace envid
+
+struct EnvideoCopyGroup: public envid::CopyGroup { };
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <algorithm>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -109,6 +110,13 @@ struct ScopeGuard {
         F f;
 };
 
+// Mutex that can be embedded in copyable objects, copies get their own unlocked mutex
+struct CopyableMutex: public std::mutex {
+    CopyableMutex() = default;
+    CopyableMutex(const CopyableMutex &): std::mutex() { }
+    CopyableMutex &operator =(const CopyableMutex &) { return *this; }
+};
+
 template <typename K, typename V>
 class FlatHashMap {
     private:
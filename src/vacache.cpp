@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "common.hpp"
+#include "util.hpp"
+
+namespace envid {
+
+Map *VaCache::acquire(void *mem, std::size_t size, std::size_t align, EnvideoMapFlags flags) {
+    std::scoped_lock lk(this->lock);
+
+    // The cache only ever holds a limited amount of ranges, a linear search is fine
+    auto start = reinterpret_cast<std::uintptr_t>(mem);
+    auto it = std::ranges::find_if(this->entries, [&](const Entry &e) {
+        return e.start == start && e.size == size && e.align >= align && e.flags == flags;
+    });
+
+    if (it == this->entries.end())
+        return nullptr;
+
+    this->entries.splice(this->entries.begin(), this->entries, it);
+
+    ++it->map->va_refs;
+    return it->map;
+}
+
+void VaCache::insert(Map *map, void *mem, std::size_t size, std::size_t align) {
+    std::scoped_lock lk(this->lock);
+
+    map->va_refs = 1;
+    this->entries.emplace_front(map, reinterpret_cast<std::uintptr_t>(mem), size, align, map->flags);
+    this->bytes += size;
+
+    this->trim_locked(this->limit);
+}
+
+bool VaCache::release(Map *map) {
+    std::scoped_lock lk(this->lock);
+
+    if (--map->va_refs)
+        return true;
+
+    // Ranges that were unregistered while in use are released with their last user
+    auto it = std::ranges::find(this->entries, map, &Entry::map);
+    if (it == this->entries.end())
+        return false;
+
+    // Keep the registration around, it is only dropped once the cache goes over its limit
+    this->trim_locked(this->limit);
+    return true;
+}
+
+int VaCache::unregister(void *mem, std::size_t size) {
+    std::scoped_lock lk(this->lock);
+
+    auto start = reinterpret_cast<std::uintptr_t>(mem), end = start + size;
+
+    int rc = 0;
+    for (auto it = this->entries.begin(); it != this->entries.end();) {
+        if (it->start >= end || it->start + it->size <= start) {
+            ++it;
+            continue;
+        }
+
+        // Maps still in use are detached, and destroyed normally by their last user
+        if (!it->map->va_refs) {
+            if (auto res = VaCache::destroy(it->map); res && !rc)
+                rc = res;
+        }
+
+        this->bytes -= it->size;
+        it = this->entries.erase(it);
+    }
+
+    return rc;
+}
+
+int VaCache::set_limit(std::size_t max_bytes) {
+    std::scoped_lock lk(this->lock);
+
+    this->limit = max_bytes;
+    return this->trim_locked(max_bytes);
+}
+
+int VaCache::trim_locked(std::size_t max_bytes) {
+    int rc = 0;
+
+    // Evict least recently used ranges first, those in use have to stay registered
+    for (auto it = this->entries.end(); this->bytes > max_bytes && it != this->entries.begin();) {
+        --it;
+        if (it->map->va_refs)
+            continue;
+
+        if (auto res = VaCache::destroy(it->map); res && !rc)
+            rc = res;
+
+        this->bytes -= it->size;
+        it = this->entries.erase(it);
+    }
+
+    return rc;
+}
+
+int VaCache::destroy(Map *map) {
+    ENVID_SCOPEGUARD([map] { delete map; });
+    return map->finalize();
+}
+
+} // namespace envid
@@ -142,6 +142,47 @@ TEST_F(JobTest, Event) {
     EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
 }
 
+TEST_F(JobTest, Deferred) {
+    EnvideoMemoryStats before, stats;
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &before), 0);
+
+    EnvideoChannel *chan2;
+    EnvideoMap     *map2;
+    EnvideoCmdbuf  *cmdbuf2;
+    EXPECT_EQ(envideo_channel_create(dev, &chan2, EnvideoEngine_Copy), 0);
+    EXPECT_EQ(envideo_map_create(dev, &map2, 0x10000, 0x1000,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuUncacheable |
+                                     EnvideoMap_LocationHost    | EnvideoMap_UsageCmdbuf)), 0);
+    EXPECT_EQ(envideo_map_pin(map2, chan2), 0);
+    EXPECT_EQ(envideo_cmdbuf_create(chan2, &cmdbuf2), 0);
+    EXPECT_EQ(envideo_cmdbuf_add_memory(cmdbuf2, map2, 0, envideo_map_get_size(map2)), 0);
+
+    EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf2, EnvideoEngine_Host), 0);
+    EXPECT_EQ(envideo_cmdbuf_push_value(cmdbuf2, NVC76F_NOP, 0), 0);
+    EXPECT_EQ(envideo_cmdbuf_end(cmdbuf2), 0);
+
+    EnvideoFence fence;
+    EXPECT_EQ(envideo_channel_submit(chan2, cmdbuf2, &fence), 0);
+
+    // Release everything while the job might still be in flight
+    EXPECT_EQ(envideo_cmdbuf_destroy_deferred (cmdbuf2, fence), 0);
+    EXPECT_EQ(envideo_map_destroy_deferred    (map2,    fence), 0);
+    EXPECT_EQ(envideo_channel_destroy_deferred(chan2,   fence), 0);
+
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &stats), 0);
+    EXPECT_EQ(stats.total.count, before.total.count);
+
+    // Command buffers that never received memory can be retired as well
+    EnvideoCmdbuf *empty;
+    EXPECT_EQ(envideo_cmdbuf_create(chan, &empty), 0);
+    EXPECT_EQ(envideo_cmdbuf_destroy_deferred(empty, fence), 0);
+
+    EXPECT_NE(envideo_map_destroy_deferred    (nullptr, fence), 0);
+    EXPECT_NE(envideo_cmdbuf_destroy_deferred (nullptr, fence), 0);
+    EXPECT_NE(envideo_channel_destroy_deferred(nullptr, fence), 0);
+}
+
 TEST_F(JobTest, Wrap) {
     for (std::uint64_t i = 0; i < 0x1000; ++i) {
         EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
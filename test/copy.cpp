@@ -17,10 +17,12 @@
  * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <tuple>
+#include <vector>
 
 #include <xxhash.h>
 #include <gtest/gtest.h>
@@ -50,6 +52,45 @@ struct CopyTest: public testing::Test {
         envideo_device_destroy (this->dev);
     }
 
+    // Creates a block-linear Nv12 frame filled with random contents, which are also returned in pitch layout
+    void create_tiled_frame(std::uint32_t width, std::uint32_t height, EnvideoSurfaceLayout &layout,
+                            EnvideoMap *&src, std::vector<std::uint8_t> &linear, EnvideoSurfaceInfo *src_planes)
+    {
+        EXPECT_EQ(envideo_surface_compute_layout(this->dev, EnvideoSurfaceFormat_Nv12, 8, width, height, true,
+                                                 &layout), 0);
+
+        EXPECT_EQ(envideo_map_create(this->dev, &src, layout.size, layout.alignment,
+            static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                         EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer)), 0);
+        EXPECT_EQ(envideo_map_pin(src, this->chan), 0);
+
+        linear.resize(layout.size);
+        std::ranges::generate(linear, [] { return std::rand(); });
+
+        for (std::uint32_t i = 0; i < layout.num_planes; ++i) {
+            auto &p = layout.planes[i];
+
+            EnvideoSwizzleParams params = {
+                .width         = p.stride,
+                .height        = p.alloc_height,
+                .tiled_stride  = p.stride,
+                .linear_stride = p.stride,
+                .gob_height    = layout.gob_height,
+            };
+            EXPECT_EQ(envideo_surface_swizzle(static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(src)) + p.offset,
+                                              linear.data() + p.offset, &params), 0);
+
+            src_planes[i] = {
+                .map        = src,
+                .map_offset = static_cast<std::uint32_t>(p.offset),
+                .stride     = p.stride,
+                .tiled      = true,
+                .gob_height = layout.gob_height,
+            };
+        }
+        EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+    }
+
     EnvideoDevice  *dev        = nullptr;
     EnvideoChannel *chan       = nullptr;
     EnvideoMap     *cmdbuf_map = nullptr;
@@ -266,3 +307,787 @@ TEST_F(CopyTest, Image) {
     EXPECT_EQ(envideo_map_destroy(dst), 0);
     EXPECT_EQ(envideo_map_destroy(src), 0);
 }
+
+TEST_F(CopyTest, FillCopy) {
+    EnvideoMap *src, *dst;
+
+    auto size = 0x100000, align = 0x1000;
+    auto fill_off = 0x102, fill_len = 0x2345 * 2, copy_off = 0x33, copy_len = 0x54321;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+    EXPECT_EQ(envideo_map_create(dev, &src, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_create(dev, &dst, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_pin(src, chan), 0);
+    EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+    auto *s = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(src)),
+         *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+    for (int i = 0; i < size; ++i)
+        s[i] = i;
+    std::memset(d, 0, size);
+    EXPECT_EQ(envideo_map_cache_op(src, 0, size, EnvideoCache_Writeback), 0);
+    EXPECT_EQ(envideo_map_cache_op(dst, 0, size, EnvideoCache_Writeback), 0);
+
+    EXPECT_EQ(envideo_cmdbuf_fill(cmdbuf, src, fill_off, fill_len, 0xbeef, 2),            0);
+    EXPECT_EQ(envideo_cmdbuf_copy(cmdbuf, dst, copy_off + 1, src, copy_off, copy_len),    0);
+    EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+
+    EnvideoFence fence;
+    EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+    EXPECT_EQ(envideo_map_cache_op(src, 0, size, EnvideoCache_Invalidate), 0);
+    EXPECT_EQ(envideo_map_cache_op(dst, 0, size, EnvideoCache_Invalidate), 0);
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+
+    for (int i = 0; i < size; ++i) {
+        std::uint8_t expected = i;
+        if (i >= fill_off && i < fill_off + fill_len)
+            expected = (i - fill_off) % 2 ? 0xbe : 0xef;
+        EXPECT_EQ(s[i], expected);
+
+        expected = (i > copy_off && i <= copy_off + copy_len) ? s[i - 1] : 0;
+        EXPECT_EQ(d[i], expected);
+    }
+
+    EXPECT_NE(envideo_cmdbuf_fill(cmdbuf, src, 1, 0x10, 0xbeef, 2),    0);
+    EXPECT_NE(envideo_cmdbuf_fill(cmdbuf, src, 0, 0x11, 0xbeef, 2),    0);
+    EXPECT_NE(envideo_cmdbuf_fill(cmdbuf, src, 0, 0x10, 0xbeef, 3),    0);
+    EXPECT_NE(envideo_cmdbuf_fill(cmdbuf, src, 0, size + 1, 0xbe, 1),  0);
+    EXPECT_NE(envideo_cmdbuf_copy(cmdbuf, dst, 1, src, 0, size),       0);
+    EXPECT_NE(envideo_cmdbuf_copy(cmdbuf, dst, 0, nullptr, 0, size),   0);
+
+    EXPECT_EQ(envideo_map_destroy(dst), 0);
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+}
+
+TEST_F(CopyTest, DirtyTracking) {
+    EnvideoMap *src, *dst;
+
+    auto size = 0x100000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+    EXPECT_EQ(envideo_map_create(dev, &src, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_create(dev, &dst, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_pin(src, chan), 0);
+    EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+    // Dirty ranges are written back on submission, no explicit cache maintenance
+    std::uint8_t data[0x300];
+    for (std::size_t i = 0; i < sizeof(data); ++i)
+        data[i] = i;
+    EXPECT_EQ(envideo_map_write(src, 0x1000, data, sizeof(data)), 0);
+    std::memset(static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(src)) + 0x8000, 0x77, 0x100);
+    EXPECT_EQ(envideo_map_mark_dirty(src, 0x8000, 0x100), 0);
+
+    EXPECT_EQ(envideo_cmdbuf_copy(cmdbuf, dst, 0, src, 0x1000, sizeof(data)), 0);
+    EXPECT_EQ(envideo_cmdbuf_copy(cmdbuf, dst, 0x400, src, 0x8000, 0x100), 0);
+    EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+
+    EnvideoFence fence;
+    EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+    EXPECT_EQ(envideo_cmdbuf_invalidate_written(cmdbuf), 0);
+
+    auto *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+    EXPECT_EQ(std::memcmp(d, data, sizeof(data)), 0);
+    EXPECT_TRUE(std::all_of(d + 0x400, d + 0x500, [](auto b) { return b == 0x77; }));
+
+    EXPECT_NE(envideo_map_write(src, size - 1, data, 2),           0);
+    EXPECT_NE(envideo_map_write(src, 0, nullptr, 2),               0);
+    EXPECT_NE(envideo_map_mark_dirty(nullptr, 0, 1),               0);
+    EXPECT_NE(envideo_map_mark_dirty(src, size, 1),                0);
+    EXPECT_NE(envideo_cmdbuf_mark_written(cmdbuf, dst, size, 1),   0);
+    EXPECT_NE(envideo_cmdbuf_invalidate_written(nullptr),          0);
+
+    EXPECT_EQ(envideo_map_destroy(dst), 0);
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+}
+
+TEST_F(CopyTest, Frame) {
+    std::uint32_t width = 320, height = 180;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+    for (auto [format, depth, num_planes]: { std::tuple{EnvideoSurfaceFormat_Nv12, 8,  2},
+                                             std::tuple{EnvideoSurfaceFormat_Nv12, 10, 2},
+                                             std::tuple{EnvideoSurfaceFormat_I420, 8,  3},
+                                             std::tuple{EnvideoSurfaceFormat_I444, 16, 3} }) {
+        auto bpp = (depth > 8) ? 2u : 1u;
+
+        // Chroma planes are sized for the worst case, tiled planes span whole blocks
+        std::uint32_t plane_width  = width * 2 * bpp, plane_stride = (plane_width + 63) & ~63u,
+                      plane_height = (height + 15) & ~15u, plane_size = plane_stride * plane_height;
+
+        EnvideoMap *src, *dst;
+        EXPECT_EQ(envideo_map_create(dev, &src, plane_size * num_planes, 0x1000, flags), 0);
+        EXPECT_EQ(envideo_map_create(dev, &dst, plane_size * num_planes, 0x1000, flags), 0);
+        EXPECT_EQ(envideo_map_pin(src, chan), 0);
+        EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+        auto *s = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(src)),
+             *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+        std::memset(d, 0, plane_size * num_planes);
+
+        std::vector<std::uint8_t> linear(plane_size * num_planes);
+        std::ranges::generate(linear, [] { return std::rand(); });
+
+        EnvideoSurfaceInfo src_planes[ENVIDEO_MAX_PLANES], dst_planes[ENVIDEO_MAX_PLANES];
+        for (int i = 0; i < num_planes; ++i) {
+            src_planes[i] = {
+                .map        = src,
+                .map_offset = plane_size * i,
+                .stride     = plane_stride,
+                .tiled      = true,
+                .gob_height = 2,
+            };
+            dst_planes[i] = {
+                .map        = dst,
+                .map_offset = plane_size * i,
+                .stride     = plane_stride,
+            };
+
+            EnvideoSwizzleParams p = {
+                .width         = plane_stride,
+                .height        = height,
+                .tiled_stride  = plane_stride,
+                .linear_stride = plane_stride,
+                .gob_height    = 2,
+            };
+            EXPECT_EQ(envideo_surface_swizzle(s + plane_size * i, linear.data() + plane_size * i, &p), 0);
+        }
+        EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Writeback), 0);
+
+        EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
+        EXPECT_EQ(envideo_surface_transfer_frame(cmdbuf, format, depth, width, height, src_planes, dst_planes), 0);
+        EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+        EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+        EnvideoFence fence;
+        EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+        EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Invalidate), 0);
+
+        // Only the visible part of each plane is transferred
+        for (int i = 0; i < num_planes; ++i) {
+            auto sub_x = (i && format != EnvideoSurfaceFormat_I444) ? 2u : 1u,
+                 sub_y = (i && format != EnvideoSurfaceFormat_I444) ? 2u : 1u;
+            auto comps = (i && format == EnvideoSurfaceFormat_Nv12) ? 2u : 1u;
+            auto row   = (width + sub_x - 1) / sub_x * comps * bpp, rows = (height + sub_y - 1) / sub_y;
+
+            for (std::uint32_t y = 0; y < rows; ++y) {
+                auto off = plane_size * i + y * plane_stride;
+                EXPECT_EQ(std::memcmp(d + off, linear.data() + off, row), 0);
+                EXPECT_TRUE(std::all_of(d + off + row, d + off + plane_stride, [](auto b) { return b == 0; }));
+            }
+        }
+
+        EXPECT_EQ(envideo_map_destroy(dst), 0);
+        EXPECT_EQ(envideo_map_destroy(src), 0);
+    }
+
+    EnvideoSurfaceInfo planes[ENVIDEO_MAX_PLANES] = {};
+    EXPECT_NE(envideo_surface_transfer_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, planes,  planes),  0);
+    EXPECT_NE(envideo_surface_transfer_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 9, width, height, planes,  planes),  0);
+    EXPECT_NE(envideo_surface_transfer_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, nullptr, planes),  0);
+    EXPECT_NE(envideo_surface_transfer_frame(nullptr, EnvideoSurfaceFormat_Nv12, 8, width, height, planes, planes),  0);
+}
+
+TEST_F(CopyTest, Crop) {
+    std::uint32_t width = 1920, height = 1088, size = width * height;
+
+    // Rectangle of a decoded 1080p frame, copied at an offset into a smaller surface
+    std::uint32_t crop_x = 100, crop_y = 20, crop_w = 640, crop_h = 360;
+    std::uint32_t out_x  = 8,   out_y  = 4,  out_stride = 1024, out_size = out_stride * 512;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+    std::vector<std::uint8_t> linear(size);
+    std::ranges::generate(linear, [] { return std::rand(); });
+
+    for (bool tiled: { true, false }) {
+        EnvideoMap *src, *dst;
+        EXPECT_EQ(envideo_map_create(dev, &src, size,     0x1000, flags), 0);
+        EXPECT_EQ(envideo_map_create(dev, &dst, out_size, 0x1000, flags), 0);
+        EXPECT_EQ(envideo_map_pin(src, chan), 0);
+        EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+        auto *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+        std::memset(d, 0, out_size);
+
+        if (tiled) {
+            EnvideoSwizzleParams p = {
+                .width         = width,
+                .height        = height,
+                .tiled_stride  = width,
+                .linear_stride = width,
+                .gob_height    = 2,
+            };
+            EXPECT_EQ(envideo_surface_swizzle(envideo_map_get_cpu_addr(src), linear.data(), &p), 0);
+        } else {
+            std::memcpy(envideo_map_get_cpu_addr(src), linear.data(), size);
+        }
+        EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Writeback), 0);
+
+        EnvideoSurfaceInfo src_info = {
+            .map        = src,
+            .width      = crop_w,
+            .height     = crop_h,
+            .stride     = width,
+            .tiled      = tiled,
+            .gob_height = 2,
+            .x          = crop_x,
+            .y          = crop_y,
+        }, dst_info = {
+            .map        = dst,
+            .width      = crop_w,
+            .height     = crop_h,
+            .stride     = out_stride,
+            .x          = out_x,
+            .y          = out_y,
+        };
+
+        EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
+        EXPECT_EQ(envideo_surface_transfer(cmdbuf, &src_info, &dst_info), 0);
+        EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+        EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+        EnvideoFence fence;
+        EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+        EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Invalidate), 0);
+
+        // Only the rectangle is written
+        for (std::uint32_t y = 0; y < out_size / out_stride; ++y) {
+            auto *row = d + y * out_stride;
+            if (y < out_y || y >= out_y + crop_h) {
+                EXPECT_TRUE(std::all_of(row, row + out_stride, [](auto b) { return b == 0; }));
+                continue;
+            }
+
+            EXPECT_EQ(std::memcmp(row + out_x, linear.data() + (crop_y + y - out_y) * width + crop_x, crop_w), 0);
+            EXPECT_TRUE(std::all_of(row, row + out_x, [](auto b) { return b == 0; }));
+            EXPECT_TRUE(std::all_of(row + out_x + crop_w, row + out_stride, [](auto b) { return b == 0; }));
+        }
+
+        EXPECT_EQ(envideo_map_destroy(dst), 0);
+        EXPECT_EQ(envideo_map_destroy(src), 0);
+    }
+
+    // The rectangle must fit in the stride
+    EnvideoSurfaceInfo info = {
+        .map    = cmdbuf_map,
+        .width  = 64,
+        .height = 1,
+        .stride = 64,
+        .x      = 1,
+    };
+    EXPECT_NE(envideo_surface_transfer(cmdbuf, &info, &info), 0);
+}
+
+TEST_F(CopyTest, Batch) {
+    std::uint32_t width = 1920, height = 1088, size = width * height;
+
+    // Mosaic of 8x8 thumbnails, picked from a block-linear frame
+    std::uint32_t tile_w = 64, tile_h = 32, num_tiles = 8 * 8;
+    std::uint32_t out_stride = tile_w * 8, out_size = out_stride * tile_h * 8;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+    EnvideoMap *src, *dst;
+    EXPECT_EQ(envideo_map_create(dev, &src, size,     0x1000, flags), 0);
+    EXPECT_EQ(envideo_map_create(dev, &dst, out_size, 0x1000, flags), 0);
+    EXPECT_EQ(envideo_map_pin(src, chan), 0);
+    EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+    std::vector<std::uint8_t> linear(size);
+    std::ranges::generate(linear, [] { return std::rand(); });
+
+    EnvideoSwizzleParams p = {
+        .width         = width,
+        .height        = height,
+        .tiled_stride  = width,
+        .linear_stride = width,
+        .gob_height    = 2,
+    };
+    EXPECT_EQ(envideo_surface_swizzle(envideo_map_get_cpu_addr(src), linear.data(), &p), 0);
+    EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+
+    std::vector<EnvideoSurfaceTransfer> transfers(num_tiles);
+    for (std::uint32_t i = 0; i < num_tiles; ++i) {
+        transfers[i] = {
+            .src = {
+                .map        = src,
+                .width      = tile_w,
+                .height     = tile_h,
+                .stride     = width,
+                .tiled      = true,
+                .gob_height = 2,
+                .x          = (i * 197) % (width  - tile_w),
+                .y          = (i * 131) % (height - tile_h),
+            },
+            .dst = {
+                .map        = dst,
+                .width      = tile_w,
+                .height     = tile_h,
+                .stride     = out_stride,
+                .x          = i % 8 * tile_w,
+                .y          = i / 8 * tile_h,
+            },
+        };
+    }
+
+    EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
+    EXPECT_EQ(envideo_surface_transfer_batch(cmdbuf, transfers.data(), num_tiles), 0);
+    EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+    EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+    EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+    EnvideoFence fence;
+    EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+    EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Invalidate), 0);
+
+    auto *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+    for (auto &t: transfers) {
+        for (std::uint32_t y = 0; y < tile_h; ++y)
+            EXPECT_EQ(std::memcmp(d + (t.dst.y + y) * out_stride + t.dst.x,
+                                  linear.data() + (t.src.y + y) * width + t.src.x, tile_w), 0);
+    }
+
+    // Batches that might not fit are rejected as a whole
+    std::vector<EnvideoSurfaceTransfer> large(0x1000, transfers[0]);
+    EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
+    EXPECT_NE(envideo_surface_transfer_batch(cmdbuf, large.data(), large.size()), 0);
+    EXPECT_EQ(envideo_surface_transfer_batch(cmdbuf, transfers.data(), num_tiles), 0);
+
+    EXPECT_EQ(envideo_surface_transfer_batch(cmdbuf, nullptr, 0), 0);
+    EXPECT_NE(envideo_surface_transfer_batch(cmdbuf, nullptr, 1), 0);
+
+    EXPECT_EQ(envideo_map_destroy(dst), 0);
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+}
+
+TEST_F(CopyTest, Convert) {
+    std::uint32_t width = 320, height = 180;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+    // All cases are 4:2:0, planes are sized for the worst case of interleaved 16-bit chroma
+    std::uint32_t plane_stride = (width * 2 * 2 + 63) & ~63u, plane_height = (height + 15) & ~15u,
+                  plane_size   = plane_stride * plane_height;
+
+    auto num_planes = [](EnvideoSurfaceFormat f) {
+        return (f == EnvideoSurfaceFormat_Gray) ? 1 : (f == EnvideoSurfaceFormat_Nv12) ? 2 : 3;
+    };
+
+    for (auto [src_format, src_depth, dst_format, dst_depth]: {
+            std::tuple{EnvideoSurfaceFormat_Nv12, 8,  EnvideoSurfaceFormat_I420, 8},
+            std::tuple{EnvideoSurfaceFormat_Nv12, 10, EnvideoSurfaceFormat_I420, 8},
+            std::tuple{EnvideoSurfaceFormat_Nv12, 10, EnvideoSurfaceFormat_I420, 10},
+            std::tuple{EnvideoSurfaceFormat_Nv12, 16, EnvideoSurfaceFormat_Nv12, 8},
+            std::tuple{EnvideoSurfaceFormat_I420, 8,  EnvideoSurfaceFormat_Nv12, 8},
+            std::tuple{EnvideoSurfaceFormat_Nv12, 10, EnvideoSurfaceFormat_Gray, 8} }) {
+        auto src_bpp = (src_depth > 8) ? 2u : 1u, dst_bpp = (dst_depth > 8) ? 2u : 1u;
+
+        EnvideoMap *src, *dst;
+        EXPECT_EQ(envideo_map_create(dev, &src, plane_size * 3, 0x1000, flags), 0);
+        EXPECT_EQ(envideo_map_create(dev, &dst, plane_size * 3, 0x1000, flags), 0);
+        EXPECT_EQ(envideo_map_pin(src, chan), 0);
+        EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+        auto *s = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(src)),
+             *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+        std::memset(d, 0, plane_size * 3);
+
+        std::vector<std::uint8_t> linear(plane_size * 3);
+        std::ranges::generate(linear, [] { return std::rand(); });
+
+        EnvideoSurfaceInfo src_planes[ENVIDEO_MAX_PLANES], dst_planes[ENVIDEO_MAX_PLANES];
+        for (int i = 0; i < ENVIDEO_MAX_PLANES; ++i) {
+            src_planes[i] = {
+                .map        = src,
+                .map_offset = plane_size * i,
+                .stride     = plane_stride,
+                .tiled      = true,
+                .gob_height = 2,
+            };
+            dst_planes[i] = {
+                .map        = dst,
+                .map_offset = plane_size * i,
+                .stride     = plane_stride,
+            };
+
+            EnvideoSwizzleParams p = {
+                .width         = plane_stride,
+                .height        = plane_height,
+                .tiled_stride  = plane_stride,
+                .linear_stride = plane_stride,
+                .gob_height    = 2,
+            };
+            EXPECT_EQ(envideo_surface_swizzle(s + plane_size * i, linear.data() + plane_size * i, &p), 0);
+        }
+        EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Writeback), 0);
+
+        EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
+        EXPECT_EQ(envideo_surface_convert_frame(cmdbuf, src_format, src_depth, dst_format, dst_depth, width, height,
+                                                src_planes, dst_planes), 0);
+        EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+        EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+        EnvideoFence fence;
+        EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+        EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Invalidate), 0);
+
+        auto src_semiplanar = num_planes(src_format) == 2, dst_semiplanar = num_planes(dst_format) == 2;
+        for (int p = 0; p < num_planes(dst_format); ++p) {
+            auto comps = (p && dst_semiplanar) ? 2u : 1u;
+            auto w = p ? (width + 1) / 2 : width, h = p ? (height + 1) / 2 : height;
+
+            for (std::uint32_t c = 0; c < comps; ++c) {
+                // Locate the component in the source
+                auto comp  = p ? (dst_semiplanar ? c : p - 1) : 0;
+                auto plane = (p && !src_semiplanar) ? 1 + comp : p ? 1 : 0;
+                auto src_comps = (plane && src_semiplanar) ? 2u : 1u;
+                if (!src_semiplanar)
+                    comp = 0;
+
+                for (std::uint32_t y = 0; y < h; ++y) {
+                    for (std::uint32_t x = 0; x < w; ++x) {
+                        auto *exp = linear.data() + plane_size * plane + y * plane_stride + (x * src_comps + comp) * src_bpp;
+                        auto *got = d + plane_size * p + y * plane_stride + (x * comps + c) * dst_bpp;
+                        if (dst_bpp < src_bpp)
+                            ASSERT_EQ(got[0], exp[1]);
+                        else
+                            ASSERT_EQ(std::memcmp(got, exp, dst_bpp), 0);
+                    }
+                }
+            }
+        }
+
+        EXPECT_EQ(envideo_map_destroy(dst), 0);
+        EXPECT_EQ(envideo_map_destroy(src), 0);
+    }
+
+    EnvideoSurfaceInfo planes[ENVIDEO_MAX_PLANES] = {};
+    EXPECT_NE(envideo_surface_convert_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, EnvideoSurfaceFormat_I420, 10,
+                                            width, height, planes, planes), 0);
+    EXPECT_NE(envideo_surface_convert_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, EnvideoSurfaceFormat_I444, 8,
+                                            width, height, planes, planes), 0);
+    EXPECT_NE(envideo_surface_convert_frame(cmdbuf, EnvideoSurfaceFormat_Gray, 8, EnvideoSurfaceFormat_Nv12, 8,
+                                            width, height, planes, planes), 0);
+    EXPECT_NE(envideo_surface_convert_frame(nullptr, EnvideoSurfaceFormat_Nv12, 8, EnvideoSurfaceFormat_I420, 8,
+                                            width, height, planes, planes), 0);
+}
+
+TEST_F(CopyTest, Group) {
+    std::uint32_t num_instances;
+    EXPECT_EQ(envideo_device_get_copy_instances(dev, &num_instances), 0);
+    EXPECT_GE(num_instances, 1u);
+
+    EnvideoCopyGroup *group;
+    EXPECT_EQ(envideo_copy_group_create(dev, &group, 0), 0);
+
+    // Odd height, so that the last band is partial
+    std::uint32_t width = 1920, height = 1080 + 24, size = width * height;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+    EnvideoMap *src, *dst;
+    EXPECT_EQ(envideo_map_create(dev, &src, size, 0x1000, flags), 0);
+    EXPECT_EQ(envideo_map_create(dev, &dst, size, 0x1000, flags), 0);
+
+    std::vector<std::uint8_t> linear(size);
+    std::ranges::generate(linear, [] { return std::rand(); });
+
+    EnvideoSwizzleParams p = {
+        .width         = width,
+        .height        = height,
+        .tiled_stride  = width,
+        .linear_stride = width,
+        .gob_height    = 2,
+    };
+    EXPECT_EQ(envideo_surface_swizzle(envideo_map_get_cpu_addr(src), linear.data(), &p), 0);
+    EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+
+    EnvideoSurfaceInfo src_info = {
+        .map        = src,
+        .width      = width,
+        .height     = height,
+        .stride     = width,
+        .tiled      = true,
+        .gob_height = 2,
+    }, dst_info = {
+        .map        = dst,
+        .width      = width,
+        .height     = height,
+        .stride     = width,
+    };
+
+    for (std::uint32_t splits = 1; splits <= num_instances; ++splits) {
+        std::memset(envideo_map_get_cpu_addr(dst), 0, size);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Writeback), 0);
+
+        EnvideoFence fence;
+        EXPECT_EQ(envideo_copy_group_set_splits(group, splits), 0);
+        EXPECT_EQ(envideo_copy_group_transfer(group, &src_info, &dst_info, &fence), 0);
+        EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Invalidate), 0);
+
+        EXPECT_EQ(std::memcmp(envideo_map_get_cpu_addr(dst), linear.data(), size), 0);
+    }
+
+    std::uint32_t num_splits;
+    EXPECT_EQ(envideo_copy_group_tune(group, &num_splits), 0);
+    EXPECT_GE(num_splits, 1u);
+    EXPECT_LE(num_splits, num_instances);
+
+    EnvideoFence fence;
+    EXPECT_NE(envideo_copy_group_set_splits(group, 0),                 0);
+    EXPECT_NE(envideo_copy_group_set_splits(group, num_instances + 1), 0);
+    EXPECT_NE(envideo_copy_group_transfer(group, &src_info, nullptr, &fence), 0);
+
+    auto empty = src_info;
+    empty.height = 0;
+    EXPECT_EQ(envideo_copy_group_transfer(group, &empty, &dst_info, &fence), ENVIDEO_RC_SYSTEM(EINVAL));
+    EXPECT_EQ(envideo_copy_group_transfer(group, &src_info, &empty, &fence), ENVIDEO_RC_SYSTEM(EINVAL));
+
+    EnvideoCopyGroup *invalid;
+    EXPECT_NE(envideo_copy_group_create(dev, &invalid, num_instances + 1),   0);
+
+    EXPECT_EQ(envideo_map_destroy(dst), 0);
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+    EXPECT_EQ(envideo_copy_group_destroy(group), 0);
+}
+
+TEST_F(CopyTest, Readback) {
+    std::uint32_t width = 640, height = 360;
+
+    EnvideoSurfaceLayout layout;
+    EnvideoMap *src;
+    std::vector<std::uint8_t> linear;
+    EnvideoSurfaceInfo src_planes[ENVIDEO_MAX_PLANES];
+    create_tiled_frame(width, height, layout, src, linear, src_planes);
+
+    EnvideoReadbackParams params = {
+        .format    = EnvideoSurfaceFormat_Nv12,
+        .depth     = 8,
+        .width     = width,
+        .height    = height,
+        .min_slots = 2,
+        .max_slots = 4,
+    };
+
+    EnvideoReadback *readback;
+    EXPECT_EQ(envideo_readback_create(dev, chan, &readback, &params), 0);
+    EXPECT_EQ(envideo_readback_get_num_slots(readback), 2u);
+
+    auto check = [&](const EnvideoReadbackFrame &frame) {
+        for (std::uint32_t i = 0; i < layout.num_planes; ++i) {
+            auto &p = layout.planes[i];
+            for (std::uint32_t y = 0; y < p.height; ++y)
+                ASSERT_EQ(std::memcmp(frame.data[i] + y * frame.linesizes[i],
+                                      linear.data() + p.offset + y * p.stride, p.width), 0);
+        }
+    };
+
+    // The copy of the next frame overlaps with the consumption of the current one
+    EXPECT_EQ(envideo_readback_submit(readback, src_planes, 0), 0);
+    for (int i = 0; i < 32; ++i) {
+        EXPECT_EQ(envideo_readback_submit(readback, src_planes, 0), 0);
+
+        EnvideoReadbackFrame frame;
+        EXPECT_EQ(envideo_readback_acquire(readback, &frame, 5e6), 0);
+        check(frame);
+        EXPECT_EQ(envideo_readback_release(readback, frame.index), 0);
+
+        EXPECT_GE(envideo_readback_get_num_slots(readback), params.min_slots);
+        EXPECT_LE(envideo_readback_get_num_slots(readback), params.max_slots);
+    }
+
+    // Without consumption, the ring fills up
+    int rc;
+    for (std::uint32_t i = 0; i <= params.max_slots && !(rc = envideo_readback_submit(readback, src_planes, 0)); ++i);
+    EXPECT_EQ(rc, ENVIDEO_RC_SYSTEM(EAGAIN));
+
+    EnvideoReadbackFrame frame;
+    while (envideo_readback_acquire(readback, &frame, 5e6) == 0) {
+        check(frame);
+        EXPECT_EQ(envideo_readback_release(readback, frame.index), 0);
+    }
+
+    EXPECT_NE(envideo_readback_release(readback, 0),  0);
+    EXPECT_NE(envideo_readback_release(readback, 64), 0);
+    EXPECT_NE(envideo_readback_submit(readback, nullptr, 0), 0);
+
+    EXPECT_EQ(envideo_readback_destroy(readback), 0);
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+
+    params.min_slots = 4, params.max_slots = 2;
+    EXPECT_NE(envideo_readback_create(dev, chan, &readback, &params), 0);
+}
+
+TEST_F(CopyTest, DownloadTo) {
+    std::uint32_t width = 640, height = 360;
+
+    EnvideoSurfaceLayout layout;
+    EnvideoMap *src;
+    std::vector<std::uint8_t> linear;
+    EnvideoSurfaceInfo src_planes[ENVIDEO_MAX_PLANES];
+    create_tiled_frame(width, height, layout, src, linear, src_planes);
+
+    // Planes start and end off any alignment, with padded rows, so that both the engine and the cpu write to them
+    std::uint32_t linesizes[ENVIDEO_MAX_PLANES] = { width + 40, width + 40 };
+    std::size_t   offsets  [ENVIDEO_MAX_PLANES] = { 24, 24 + linesizes[0] * height + 72 };
+    std::size_t   size = offsets[1] + linesizes[1] * (height / 2) + 56;
+
+    std::vector<std::uint8_t> buf(size + 0x1000);
+    auto *base = buf.data() + (0x1000 - reinterpret_cast<std::uintptr_t>(buf.data()) % 0x1000);
+
+    auto download = [&] {
+        std::memset(base, 0xa5, size);
+
+        void *dst[ENVIDEO_MAX_PLANES] = { base + offsets[0], base + offsets[1] };
+        EXPECT_EQ(envideo_surface_download_to(chan, cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, src_planes,
+                                              dst, linesizes, 5e6), 0);
+
+        for (std::uint32_t i = 0; i < layout.num_planes; ++i) {
+            auto &p = layout.planes[i];
+            for (std::uint32_t y = 0; y < p.height; ++y) {
+                auto *row = base + offsets[i] + y * linesizes[i];
+                ASSERT_EQ(std::memcmp(row, linear.data() + p.offset + y * p.stride, p.width), 0);
+
+                // Padding is left untouched
+                ASSERT_TRUE(std::all_of(row + p.width, row + linesizes[i], [](auto b) { return b == 0xa5; }));
+            }
+        }
+
+        ASSERT_TRUE(std::all_of(base, base + offsets[0], [](auto b) { return b == 0xa5; }));
+    };
+
+    download();
+
+    // Registrations are reused through the cache
+    EXPECT_EQ(envideo_va_cache_set_limit(dev, 64 << 20), 0);
+    download();
+    download();
+    EXPECT_EQ(envideo_va_cache_set_limit(dev, 0), 0);
+
+    std::uint32_t short_linesizes[ENVIDEO_MAX_PLANES] = { width - 1, width };
+    void *dst[ENVIDEO_MAX_PLANES] = { base, base };
+    EXPECT_NE(envideo_surface_download_to(chan, cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, src_planes,
+                                          dst, short_linesizes, 5e6), 0);
+    EXPECT_NE(envideo_surface_download_to(chan, cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, src_planes,
+                                          nullptr, linesizes, 5e6), 0);
+
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+}
+
+TEST_F(CopyTest, Subsample) {
+    std::uint32_t width = 640, height = 360;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+
+    EnvideoSurfaceLayout layout;
+    EXPECT_EQ(envideo_surface_compute_layout(dev, EnvideoSurfaceFormat_Nv12, 8, width, height, false, &layout), 0);
+
+    EnvideoMap *src, *dst;
+    EXPECT_EQ(envideo_map_create(dev, &src, layout.size, layout.alignment, flags), 0);
+    EXPECT_EQ(envideo_map_create(dev, &dst, layout.size, layout.alignment, flags), 0);
+    EXPECT_EQ(envideo_map_pin(src, chan), 0);
+    EXPECT_EQ(envideo_map_pin(dst, chan), 0);
+
+    auto *s = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(src));
+    auto *d = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(dst));
+    std::generate_n(s, layout.size, [] { return std::rand(); });
+    EXPECT_EQ(envideo_map_cache_op(src, 0, envideo_map_get_size(src), EnvideoCache_Writeback), 0);
+
+    EnvideoSurfaceInfo src_planes[ENVIDEO_MAX_PLANES], dst_planes[ENVIDEO_MAX_PLANES];
+    for (std::uint32_t i = 0; i < layout.num_planes; ++i) {
+        auto &p = layout.planes[i];
+        src_planes[i] = dst_planes[i] = {
+            .map_offset = static_cast<std::uint32_t>(p.offset),
+            .stride     = p.stride,
+        };
+        src_planes[i].map = src, dst_planes[i].map = dst;
+    }
+
+    auto run = [&](const EnvideoSubsampleParams &params) {
+        std::memset(d, 0, layout.size);
+        EXPECT_EQ(envideo_map_cache_op(dst, 0, envideo_map_get_size(dst), EnvideoCache_Writeback), 0);
+
+        EXPECT_EQ(envideo_cmdbuf_clear(cmdbuf), 0);
+        EXPECT_EQ(envideo_surface_subsample_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, &params,
+                                                  src_planes, dst_planes), 0);
+        EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+        EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+        EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+        EnvideoFence fence;
+        EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+        EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+        EXPECT_EQ(envideo_cmdbuf_invalidate_written(cmdbuf), 0);
+
+        auto num_planes = params.luma_only ? 1u : layout.num_planes;
+        for (std::uint32_t i = 0; i < layout.num_planes; ++i) {
+            auto &p = layout.planes[i];
+            auto components = i ? 2u : 1u;
+            auto out_width  = (p.width / components + params.step_x - 1) / params.step_x * components,
+                 out_height = (p.height + params.step_y - 1) / params.step_y;
+
+            for (std::uint32_t y = 0; y < out_height; ++y) {
+                auto *row = d + p.offset + y * p.stride;
+                if (i >= num_planes) {
+                    ASSERT_TRUE(std::all_of(row, row + p.width, [](auto b) { return b == 0; }));
+                    continue;
+                }
+
+                for (std::uint32_t x = 0; x < out_width; ++x) {
+                    auto src_x = x / components * params.step_x * components + x % components;
+                    ASSERT_EQ(row[x], s[p.offset + y * params.step_y * p.stride + src_x]);
+                }
+            }
+        }
+    };
+
+    run({ .step_x = 1, .step_y = 2 });
+    run({ .step_x = 2, .step_y = 2 });
+    run({ .step_x = 4, .step_y = 4, .luma_only = true });
+    // The last group of columns is partial, and must not be read past the plane
+    run({ .step_x = 3, .step_y = 1, .luma_only = true });
+
+    // Interleaved chroma only leaves room to skip every other pair of samples
+    EnvideoSubsampleParams params = { .step_x = 4, .step_y = 4 };
+    EXPECT_EQ(envideo_surface_subsample_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, &params,
+                                              src_planes, dst_planes), ENVIDEO_RC_SYSTEM(ENOTSUP));
+
+    // Rows of block-linear surfaces cannot be skipped by the engine, only columns
+    for (auto &p: src_planes)
+        p.tiled = true, p.gob_height = 2;
+
+    params = { .step_x = 2, .step_y = 2 };
+    EXPECT_EQ(envideo_surface_subsample_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, &params,
+                                              src_planes, dst_planes), ENVIDEO_RC_SYSTEM(ENOTSUP));
+    params = { .step_x = 2, .step_y = 1 };
+    EXPECT_EQ(envideo_surface_subsample_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, &params,
+                                              src_planes, dst_planes), 0);
+
+    params = { .step_x = 0, .step_y = 1 };
+    EXPECT_NE(envideo_surface_subsample_frame(cmdbuf, EnvideoSurfaceFormat_Nv12, 8, width, height, &params,
+                                              src_planes, dst_planes), 0);
+
+    EXPECT_EQ(envideo_map_destroy(dst), 0);
+    EXPECT_EQ(envideo_map_destroy(src), 0);
+}
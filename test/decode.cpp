@@ -40,8 +40,6 @@ extern std::uint8_t pic_setup_bin[],         bitstream_bin[],          slice_off
 std::size_t         pic_setup_bin_len = 344, bitstream_bin_len = 6426, slice_offsets_bin_len = 32;
 
 std::uint32_t frame_width = 128, frame_height = 128;
-std::uint32_t frame_size = frame_width * frame_height + frame_width * frame_height / 2,
-    luma_off = 0, chroma_off = frame_width * frame_height;
 
 #define ALIGN(x, a) (((x) + (a) - 1) & ~((a) - 1))
 #define ALIGN_MAP(x) ALIGN(x, ENVIDEO_MAP_ALIGN)
@@ -78,13 +76,17 @@ struct DecodeContext {
 
         flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuUnmapped    | EnvideoMap_GpuCacheable |
                                              EnvideoMap_LocationDevice | EnvideoMap_UsageFramebuffer);
-        envideo_map_create(this->dev, &this->frame, frame_size, 0x1000, flags);
+        envideo_surface_compute_layout(this->dev, EnvideoSurfaceFormat_Nv12, 8, frame_width, frame_height, true,
+                                       &this->frame_layout);
+        envideo_map_create(this->dev, &this->frame, this->frame_layout.size, this->frame_layout.alignment, flags);
         envideo_map_pin(this->frame, this->chan);
         envideo_map_pin(this->frame, this->copy_chan);
 
         flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
-        envideo_map_create(this->dev, &this->result, frame_size, 0x1000, flags);
+        envideo_surface_compute_layout(this->dev, EnvideoSurfaceFormat_Nv12, 8, frame_width, frame_height, false,
+                                       &this->result_layout);
+        envideo_map_create(this->dev, &this->result, this->result_layout.size, 0x1000, flags);
         envideo_map_pin(this->result, this->copy_chan);
     }
 
@@ -103,6 +105,8 @@ struct DecodeContext {
     EnvideoMap     *cmdbuf_map = nullptr, *input_map = nullptr, *frame = nullptr, *result = nullptr;
     EnvideoChannel *chan       = nullptr, *copy_chan   = nullptr;
     EnvideoCmdbuf  *cmdbuf     = nullptr, *copy_cmdbuf = nullptr;
+
+    EnvideoSurfaceLayout frame_layout = {}, result_layout = {};
 };
 
 void decode_mpeg2(DecodeContext &context) {
@@ -142,9 +146,9 @@ void decode_mpeg2(DecodeContext &context) {
             context.input_map, status_off,    EnvideoRelocType_Default, 8), 0);
 
     EXPECT_EQ(envideo_cmdbuf_push_reloc(context.cmdbuf, NVC9B0_SET_PICTURE_LUMA_OFFSET0,
-            context.frame, luma_off,   EnvideoRelocType_Tiled, 8), 0);
+            context.frame, context.frame_layout.planes[0].offset, EnvideoRelocType_Tiled, 8), 0);
     EXPECT_EQ(envideo_cmdbuf_push_reloc(context.cmdbuf, NVC9B0_SET_PICTURE_CHROMA_OFFSET0,
-            context.frame, chroma_off, EnvideoRelocType_Tiled, 8), 0);
+            context.frame, context.frame_layout.planes[1].offset, EnvideoRelocType_Tiled, 8), 0);
 
     EXPECT_EQ(envideo_cmdbuf_push_value(context.cmdbuf, NVC9B0_EXECUTE,
         DRF_DEF(C9B0, _EXECUTE, _NOTIFY, _DISABLE) |
@@ -158,40 +162,24 @@ void decode_mpeg2(DecodeContext &context) {
     EXPECT_EQ(envideo_cmdbuf_wait_fence(context.copy_cmdbuf, decode_fence), 0);
     EXPECT_EQ(envideo_cmdbuf_end(context.copy_cmdbuf), 0);
 
-    EnvideoSurfaceInfo luma_src_info = {
-        .map        = context.frame,
-        .map_offset = luma_off,
-        .width      = frame_width,
-        .height     = frame_height,
-        .stride     = frame_width,
-        .tiled      = true,
-        .gob_height = 2,
-    }, luma_dst_info = {
-        .map        = context.result,
-        .map_offset = luma_off,
-        .width      = frame_width,
-        .height     = frame_height,
-        .stride     = frame_width,
-    };
-    EXPECT_EQ(envideo_surface_transfer(context.copy_cmdbuf, &luma_src_info, &luma_dst_info), 0);
-
-    EnvideoSurfaceInfo chroma_src_info = {
-        .map        = context.frame,
-        .map_offset = chroma_off,
-        .width      = frame_width,
-        .height     = frame_height / 2,
-        .stride     = frame_width,
-        .tiled      = true,
-        .gob_height = 2,
-    }, chroma_dst_info = {
-        .map        = context.result,
-        .map_offset = chroma_off,
-        .width      = frame_width,
-        .height     = frame_height / 2,
-        .stride     = frame_width,
-        .tiled      = false,
-    };
-    EXPECT_EQ(envideo_surface_transfer(context.copy_cmdbuf, &chroma_src_info, &chroma_dst_info), 0);
+    EnvideoSurfaceInfo src_planes[ENVIDEO_MAX_PLANES], dst_planes[ENVIDEO_MAX_PLANES];
+    for (int i = 0; i < 2; ++i) {
+        auto &src = context.frame_layout.planes[i], &dst = context.result_layout.planes[i];
+        src_planes[i] = {
+            .map        = context.frame,
+            .map_offset = static_cast<std::uint32_t>(src.offset),
+            .stride     = src.stride,
+            .tiled      = true,
+            .gob_height = context.frame_layout.gob_height,
+        };
+        dst_planes[i] = {
+            .map        = context.result,
+            .map_offset = static_cast<std::uint32_t>(dst.offset),
+            .stride     = dst.stride,
+        };
+    }
+    EXPECT_EQ(envideo_surface_transfer_frame(context.copy_cmdbuf, EnvideoSurfaceFormat_Nv12, 8,
+                                             frame_width, frame_height, src_planes, dst_planes), 0);
 
     EXPECT_EQ(envideo_cmdbuf_begin(context.copy_cmdbuf, EnvideoEngine_Host), 0);
     EXPECT_EQ(envideo_cmdbuf_cache_op(context.copy_cmdbuf, EnvideoCache_Writeback), 0);
@@ -22,6 +22,12 @@
 #include <cstring>
 #include <tuple>
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
 #include <gtest/gtest.h>
 
 #include <envideo.h>
@@ -52,6 +58,54 @@ TEST(DeviceTest, Fence) {
     EXPECT_EQ(envideo_device_destroy(device), 0);
 }
 
+// Node backing the page at addr, which must have been touched
+static int get_page_node(void *addr) {
+#if defined(__linux__)
+    int node = -1;
+    if (::syscall(SYS_get_mempolicy, &node, nullptr, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) < 0)
+        return -1;
+    return node;
+#else
+    return -1;
+#endif
+}
+
+TEST(DeviceTest, NumaNode) {
+    EnvideoDevice *device;
+    EXPECT_EQ(envideo_device_create(&device), 0);
+
+    auto info = envideo_device_get_info(device);
+    EXPECT_GE(info.numa_node, -1);
+
+    // Host allocations are placed on the node of the device, unless opted out of
+    for (auto flags: {EnvideoMap_LocationHost, EnvideoMap_AnyNode}) {
+        bool bound = info.numa_node >= 0 && !(flags & EnvideoMap_AnyNode);
+
+        EnvideoMap *map;
+        EXPECT_EQ(envideo_map_create(device, &map, 0x10000, 0x1000, flags), 0);
+        auto *addr = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(map));
+        ASSERT_NE(addr, nullptr);
+        addr[0] = 0xff;
+        if (bound) {
+            EXPECT_EQ(get_page_node(addr), info.numa_node);
+        }
+        EXPECT_EQ(envideo_map_destroy(map), 0);
+
+        void *mem;
+        std::size_t size = 0x10000, page_size;
+        EXPECT_EQ(envideo_host_alloc(device, &mem, &size, flags, &page_size), 0);
+        std::memset(mem, 0, size);
+        if (bound) {
+            EXPECT_EQ(get_page_node(mem), info.numa_node);
+        }
+        EXPECT_EQ(envideo_host_free(device, mem, size), 0);
+    }
+
+    EXPECT_EQ(envideo_device_get_info(nullptr).numa_node, -1);
+
+    EXPECT_EQ(envideo_device_destroy(device), 0);
+}
+
 
 struct ContraintsTest: public testing::TestWithParam<std::tuple<EnvideoCodec, EnvideoPixelFormat>> {
     ContraintsTest() { envideo_device_create(&this->dev); }
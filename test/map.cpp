@@ -17,10 +17,17 @@
  * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <gtest/gtest.h>
 
@@ -82,6 +89,57 @@ TEST_F(MapTest, FromVa) {
     operator delete[] (mem, std::align_val_t(align));
 }
 
+TEST_F(MapTest, VaCache) {
+    EnvideoMap *map, *map2, *map3;
+
+    auto size = 0x10000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable);
+
+    auto *mem  = static_cast<std::uint8_t *>(std::aligned_alloc(align, 2 * size));
+    auto *mem2 = mem + size;
+    ASSERT_NE(mem, nullptr);
+
+    EXPECT_EQ(envideo_va_cache_set_limit(dev, size), 0);
+
+    // Recurring ranges share the same map
+    EXPECT_EQ(envideo_map_from_va(dev, &map,  mem, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_from_va(dev, &map2, mem, size, align, flags), 0);
+    EXPECT_EQ(map, map2);
+    auto gpu_addr = envideo_map_get_gpu_addr(map);
+    EXPECT_EQ(envideo_map_destroy(map2), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    EXPECT_EQ(envideo_map_from_va(dev, &map, mem, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_get_gpu_addr(map), gpu_addr);
+
+    // Different flags create a separate registration
+    EXPECT_EQ(envideo_map_from_va(dev, &map2, mem, size, align,
+        static_cast<EnvideoMapFlags>(flags | EnvideoMap_CpuLazy)), 0);
+    EXPECT_NE(map, map2);
+
+    // Ranges in use survive the limit and unregistration
+    EXPECT_EQ(envideo_map_from_va(dev, &map3, mem2, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_unregister_va(dev, mem, 2 * size), 0);
+    EXPECT_NE(envideo_map_get_gpu_addr(map), 0);
+    EXPECT_NE(envideo_map_get_cpu_addr(map), nullptr);
+
+    EXPECT_NE(envideo_map_realloc(map, 2 * size, align), 0);
+
+    EXPECT_EQ(envideo_map_destroy(map3), 0);
+    EXPECT_EQ(envideo_map_destroy(map2), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    EXPECT_EQ(envideo_map_from_va(dev, &map, mem, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    EXPECT_EQ(envideo_va_cache_set_limit(dev, 0), 0);
+    EXPECT_NE(envideo_va_cache_set_limit(nullptr, 0), 0);
+    EXPECT_NE(envideo_map_unregister_va(nullptr, mem, size), 0);
+    EXPECT_NE(envideo_map_unregister_va(dev, nullptr, size), 0);
+
+    std::free(mem);
+}
+
 TEST_F(MapTest, Realloc) {
     EnvideoMap *map;
 
@@ -97,6 +155,177 @@ TEST_F(MapTest, Realloc) {
     EXPECT_NE(envideo_map_get_gpu_addr(map), 0);
     EXPECT_GE(envideo_map_get_size    (map), new_size);
     EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    // Contents can't be migrated through the cpu without a mapping
+    EXPECT_EQ(envideo_map_create(dev, &map, size, align,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuUnmapped | EnvideoMap_GpuCacheable)), 0);
+    EXPECT_EQ(envideo_map_realloc(map, new_size, 0x1000), ENVIDEO_RC_SYSTEM(EINVAL));
+    EXPECT_EQ(envideo_map_get_size(map), std::size_t(size));
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+}
+
+TEST_F(MapTest, ReallocAsync) {
+    EnvideoMap *map, *cmdbuf_map;
+    EnvideoChannel *chan;
+    EnvideoCmdbuf *cmdbuf;
+    EnvideoFence fence;
+
+    auto size = 0x1000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable);
+
+    EXPECT_EQ(envideo_channel_create(dev, &chan, EnvideoEngine_Copy), 0);
+    EXPECT_EQ(envideo_map_create(dev, &cmdbuf_map, 0x10000, 0x1000,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuUncacheable |
+                                     EnvideoMap_LocationHost    | EnvideoMap_UsageCmdbuf)), 0);
+    EXPECT_EQ(envideo_map_pin(cmdbuf_map, chan), 0);
+    EXPECT_EQ(envideo_cmdbuf_create(chan, &cmdbuf), 0);
+    EXPECT_EQ(envideo_cmdbuf_add_memory(cmdbuf, cmdbuf_map, 0, envideo_map_get_size(cmdbuf_map)), 0);
+
+    EXPECT_EQ(envideo_map_create(dev, &map, size, align, flags), 0);
+    std::memset(envideo_map_get_cpu_addr(map), 0x5a, size);
+
+    EXPECT_EQ(envideo_map_realloc_async(map, size + 1, align, chan, cmdbuf, &fence), 0);
+    EXPECT_NE(fence, 0);
+    EXPECT_GE(envideo_map_get_size(map), 2 * size);
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+    EXPECT_EQ(envideo_map_cache_op(map, 0, size, EnvideoCache_Invalidate), 0);
+
+    auto *mem = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(map));
+    EXPECT_TRUE(std::all_of(mem, mem + size, [](auto b) { return b == 0x5a; }));
+
+    // The written range follows the new storage, the previous one being released along the way
+    std::memset(envideo_map_get_cpu_addr(map), 0xa5, size);
+    EXPECT_EQ(envideo_map_cache_op(map, 0, size, EnvideoCache_Writeback), 0);
+    EXPECT_EQ(envideo_map_realloc_async(map, envideo_map_get_size(map) + 1, align, chan, cmdbuf, &fence), 0);
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+    EXPECT_EQ(envideo_cmdbuf_invalidate_written(cmdbuf), 0);
+
+    EnvideoMap *other;
+    EXPECT_EQ(envideo_map_create(dev, &other, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_destroy(other), 0);
+
+    mem = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(map));
+    EXPECT_TRUE(std::all_of(mem, mem + size, [](auto b) { return b == 0xa5; }));
+
+    // Maps backing command buffers keep their storage
+    EXPECT_EQ(envideo_map_realloc(cmdbuf_map, 0x20000, 0x1000), ENVIDEO_RC_SYSTEM(EINVAL));
+    EXPECT_EQ(envideo_map_realloc_async(cmdbuf_map, 0x20000, 0x1000, chan, cmdbuf, &fence),
+              ENVIDEO_RC_SYSTEM(EINVAL));
+
+    // Without a channel the contents are copied through the cpu
+    auto cur_size = envideo_map_get_size(map);
+    EXPECT_EQ(envideo_map_realloc_async(map, cur_size + 1, align, nullptr, nullptr, &fence), 0);
+    EXPECT_EQ(fence, 0);
+    EXPECT_GE(envideo_map_get_size(map), 2 * cur_size);
+
+    EXPECT_NE(envideo_map_realloc_async(map, 0x1000, align, chan, cmdbuf, &fence), 0);
+    EXPECT_NE(envideo_map_realloc_async(map, 0x100000, align, chan, nullptr, &fence), 0);
+    EXPECT_NE(envideo_map_realloc_async(map, 0x100000, align, chan, cmdbuf, nullptr), 0);
+
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    // Command words are written through the cpu mapping, which stays in place while the cmdbuf lives
+    EXPECT_EQ(envideo_map_unmap_cpu(cmdbuf_map), ENVIDEO_RC_SYSTEM(EBUSY));
+    EXPECT_EQ(envideo_cmdbuf_destroy(cmdbuf), 0);
+    EXPECT_EQ(envideo_map_unmap_cpu(cmdbuf_map), 0);
+
+    EXPECT_EQ(envideo_map_destroy(cmdbuf_map), 0);
+    EXPECT_EQ(envideo_channel_destroy(chan), 0);
+}
+
+TEST_F(MapTest, HugePages) {
+    EnvideoMap *map;
+
+    auto size = 0x300000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer |
+                                              EnvideoMap_HugePages);
+
+    EXPECT_EQ(envideo_map_create(dev, &map, size, align, flags), 0);
+    EXPECT_NE(envideo_map_get_cpu_addr(map), nullptr);
+    EXPECT_GE(envideo_map_get_size(map), size);
+    EXPECT_NE(envideo_map_get_page_size(map), 0);
+    EXPECT_EQ(envideo_map_get_gpu_addr(map) % envideo_map_get_page_size(map), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    void *mem;
+    std::size_t alloc_size = size, page_size;
+    EXPECT_EQ(envideo_host_alloc(dev, &mem, &alloc_size, flags, &page_size), 0);
+    EXPECT_GE(alloc_size, size);
+    EXPECT_EQ(alloc_size % ENVIDEO_HUGE_PAGE_SIZE, 0);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(mem) % ENVIDEO_HUGE_PAGE_SIZE, 0);
+    EXPECT_NE(page_size, 0);
+    std::memset(mem, 0xa5, alloc_size);
+
+    EXPECT_EQ(envideo_map_from_va(dev, &map, mem, alloc_size, align, flags), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+    EXPECT_EQ(envideo_host_free(dev, mem, alloc_size), 0);
+
+    EXPECT_EQ(envideo_map_get_page_size(nullptr), 0);
+    EXPECT_NE(envideo_host_alloc(nullptr, &mem, &alloc_size, flags, &page_size), 0);
+    EXPECT_NE(envideo_host_alloc(dev, nullptr,  &alloc_size, flags, &page_size), 0);
+    EXPECT_NE(envideo_host_alloc(dev, &mem, nullptr, flags, &page_size), 0);
+    EXPECT_NE(envideo_host_free(dev, nullptr, alloc_size), 0);
+}
+
+TEST_F(MapTest, Dmabuf) {
+    EnvideoMap *map;
+
+    auto size = 0x4000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable);
+
+    // memfds stand in for dma-bufs, and exercise the cpu mapping fallback
+    int fd = ::memfd_create("envideo-test", MFD_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::ftruncate(fd, size), 0);
+
+    std::vector<std::uint8_t> data(size);
+    for (std::size_t i = 0; i < data.size(); ++i)
+        data[i] = std::uint8_t(i * 7);
+    ASSERT_EQ(::pwrite(fd, data.data(), data.size(), 0), size);
+
+    EXPECT_EQ(envideo_map_import_dmabuf(dev, fd, 0, flags, &map), 0);
+    EXPECT_GE(envideo_map_get_size(map), size);
+    EXPECT_NE(envideo_map_get_gpu_addr(map), 0);
+    ASSERT_NE(envideo_map_get_cpu_addr(map), nullptr);
+    EXPECT_EQ(std::memcmp(envideo_map_get_cpu_addr(map), data.data(), size), 0);
+
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    // Partial imports, the descriptor stays owned by the caller
+    EXPECT_EQ(envideo_map_import_dmabuf(dev, fd, 0x1000, flags, &map), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+    EXPECT_NE(::fcntl(fd, F_GETFD), -1);
+
+    EXPECT_NE(envideo_map_import_dmabuf(dev, fd, size + 1, flags, &map), 0);
+    EXPECT_NE(envideo_map_import_dmabuf(dev, -1, size, flags, &map), 0);
+    EXPECT_NE(envideo_map_import_dmabuf(nullptr, fd, size, flags, &map), 0);
+    EXPECT_NE(envideo_map_import_dmabuf(dev, fd, size, flags, nullptr), 0);
+
+    int exported;
+    EXPECT_NE(envideo_map_export_dmabuf(nullptr, &exported), 0);
+
+    EXPECT_EQ(::close(fd), 0);
+
+    ASSERT_EQ(envideo_map_create(dev, &map, size, 0x1000, flags), 0);
+
+    int rc = envideo_map_export_dmabuf(map, &exported);
+    if (rc == ENVIDEO_RC_SYSTEM(ENOSYS)) {
+        EXPECT_EQ(exported, -1);
+        EXPECT_EQ(envideo_map_destroy(map), 0);
+        GTEST_SKIP() << "dma-buf export is not supported by this backend";
+    }
+
+    ASSERT_EQ(rc, 0);
+    EXPECT_GE(exported, 0);
+
+    // The exported buffer can be imported back
+    EnvideoMap *reimported;
+    EXPECT_EQ(envideo_map_import_dmabuf(dev, exported, 0, flags, &reimported), 0);
+    EXPECT_EQ(envideo_map_destroy(reimported), 0);
+
+    EXPECT_EQ(::close(exported), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
 }
 
 TEST_F(MapTest, Cache) {
@@ -115,6 +344,54 @@ TEST_F(MapTest, Cache) {
     EXPECT_EQ(envideo_map_destroy(map), 0);
 }
 
+TEST_F(MapTest, MemoryStats) {
+    EnvideoMap *map, *map2;
+    EnvideoMemoryStats before, stats;
+
+    auto size = 0x10000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost     | EnvideoMap_UsageFramebuffer);
+
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &before), 0);
+    EXPECT_EQ(before.budget, 0);
+
+    EXPECT_EQ(envideo_map_create(dev, &map, size, align, flags), 0);
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &stats), 0);
+
+    // Maps are accounted for with their actual size, which may be rounded up by the driver
+    auto charged = envideo_map_get_size(map);
+    EXPECT_GE(charged, size);
+    EXPECT_EQ(stats.total.bytes, before.total.bytes + charged);
+    EXPECT_EQ(stats.total.count, before.total.count + 1);
+    EXPECT_GE(stats.total.peak_bytes, stats.total.bytes);
+    EXPECT_EQ(stats.location[EnvideoMap_LocationHost       >> 8 ].bytes, before.location[EnvideoMap_LocationHost       >> 8 ].bytes + charged);
+    EXPECT_EQ(stats.usage   [EnvideoMap_UsageFramebuffer   >> 12].bytes, before.usage   [EnvideoMap_UsageFramebuffer   >> 12].bytes + charged);
+    EXPECT_EQ(stats.cpu     [EnvideoMap_CpuWriteCombine         ].bytes, before.cpu     [EnvideoMap_CpuWriteCombine         ].bytes + charged);
+    EXPECT_EQ(stats.gpu     [EnvideoMap_GpuCacheable       >> 4 ].bytes, before.gpu     [EnvideoMap_GpuCacheable       >> 4 ].bytes + charged);
+    EXPECT_GE(stats.vram_total, stats.vram_free);
+
+    // Allocations past the budget fail without reaching the driver
+    EXPECT_EQ(envideo_device_set_memory_budget(dev, stats.total.bytes + size / 2), 0);
+    EXPECT_EQ(envideo_map_create(dev, &map2, size, align, flags), ENVIDEO_RC_BUDGET_EXCEEDED);
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &stats), 0);
+    EXPECT_EQ(stats.total.count, before.total.count + 1);
+    EXPECT_EQ(stats.budget, before.total.bytes + charged + size / 2);
+
+    // Released maps make room
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+    EXPECT_EQ(envideo_map_create(dev, &map2, size, align, flags), 0);
+    EXPECT_EQ(envideo_map_destroy(map2), 0);
+
+    EXPECT_EQ(envideo_device_set_memory_budget(dev, 0), 0);
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &stats), 0);
+    EXPECT_EQ(stats.total.bytes, before.total.bytes);
+    EXPECT_EQ(stats.total.count, before.total.count);
+
+    EXPECT_NE(envideo_device_get_memory_stats(nullptr, &stats), 0);
+    EXPECT_NE(envideo_device_get_memory_stats(dev, nullptr), 0);
+    EXPECT_NE(envideo_device_set_memory_budget(nullptr, 0), 0);
+}
+
 TEST_F(MapTest, Pin) {
     EnvideoMap *map;
 
@@ -134,6 +411,230 @@ TEST_F(MapTest, Pin) {
     EXPECT_EQ(envideo_channel_destroy(channel), 0);
 }
 
+TEST_F(MapTest, Many) {
+    constexpr std::size_t num_maps = 16;
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable | EnvideoMap_UsageFramebuffer);
+
+    std::array<std::size_t,  num_maps> sizes;
+    std::array<EnvideoMap *, num_maps> maps;
+    for (std::size_t i = 0; i < num_maps; ++i)
+        sizes[i] = (i + 1) * 0x1000;
+
+    EnvideoChannel *copy, *nvdec = nullptr;
+    EXPECT_EQ(envideo_channel_create(dev, &copy, EnvideoEngine_Copy), 0);
+    envideo_channel_create(dev, &nvdec, EnvideoEngine_Nvdec);
+
+    std::vector<EnvideoChannel *> channels = { copy };
+    if (nvdec) {
+        channels.emplace_back(nvdec);
+    }
+
+    EXPECT_EQ(envideo_map_create_many(dev, num_maps, sizes.data(), flags, maps.data()), 0);
+    for (std::size_t i = 0; i < num_maps; ++i) {
+        ASSERT_NE(maps[i], nullptr);
+        EXPECT_GE(envideo_map_get_size(maps[i]), sizes[i]);
+        EXPECT_NE(envideo_map_get_cpu_addr(maps[i]), nullptr);
+    }
+
+    EXPECT_EQ(envideo_map_pin_many(maps.data(), num_maps, channels.data(), channels.size()), 0);
+    EXPECT_EQ(envideo_map_pin_many(maps.data(), num_maps, channels.data(), channels.size()), 0);
+
+    for (auto *m: maps)
+        EXPECT_EQ(envideo_map_pin(m, copy), 0);
+
+    EXPECT_NE(envideo_map_pin_many(nullptr,     num_maps, channels.data(), channels.size()), 0);
+    EXPECT_NE(envideo_map_pin_many(maps.data(), num_maps, nullptr,         channels.size()), 0);
+
+    for (auto *m: maps)
+        EXPECT_EQ(envideo_map_destroy(m), 0);
+
+    // A failing creation leaves no map behind
+    sizes[num_maps / 2] = 0;
+    EXPECT_NE(envideo_map_create_many(dev, num_maps, sizes.data(), flags, maps.data()), 0);
+    EXPECT_TRUE(std::ranges::all_of(maps, [](auto *m) { return m == nullptr; }));
+
+    EXPECT_NE(envideo_map_create_many(nullptr, num_maps, sizes.data(), flags, maps.data()), 0);
+    EXPECT_NE(envideo_map_create_many(dev,     num_maps, nullptr,      flags, maps.data()), 0);
+    EXPECT_NE(envideo_map_create_many(dev,     num_maps, sizes.data(), flags, nullptr),     0);
+
+    if (nvdec) {
+        EXPECT_EQ(envideo_channel_destroy(nvdec), 0);
+    }
+    EXPECT_EQ(envideo_channel_destroy(copy), 0);
+}
+
+TEST_F(MapTest, Batch) {
+    constexpr std::size_t num_maps = 8;
+
+    auto size = 0x10000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable | EnvideoMap_UsageFramebuffer);
+
+    std::array<EnvideoMap *, num_maps> maps;
+
+    EXPECT_EQ(envideo_device_begin_map_batch(dev), 0);
+    EXPECT_EQ(envideo_device_begin_map_batch(dev), 0);
+    for (auto *&m: maps)
+        EXPECT_EQ(envideo_map_create(dev, &m, size, align, flags), 0);
+    EXPECT_EQ(envideo_device_end_map_batch(dev), 0);
+    EXPECT_EQ(envideo_device_end_map_batch(dev), 0);
+
+    // Mappings do not overlap
+    std::vector<std::uint64_t> addrs;
+    for (auto *m: maps)
+        addrs.emplace_back(envideo_map_get_gpu_addr(m));
+    std::ranges::sort(addrs);
+    for (std::size_t i = 1; i < addrs.size(); ++i)
+        EXPECT_GE(addrs[i], addrs[i - 1] + size);
+
+    EnvideoMemoryStats stats;
+    EXPECT_EQ(envideo_device_get_memory_stats(dev, &stats), 0);
+    EXPECT_LE(stats.va_used, stats.va_total);
+    EXPECT_LE(stats.va_largest_free, stats.va_total - stats.va_used);
+    if (stats.va_total) {
+        EXPECT_GE(stats.va_used, num_maps * size);
+    }
+
+    EXPECT_EQ(envideo_device_begin_map_batch(dev), 0);
+    for (auto *m: maps)
+        EXPECT_EQ(envideo_map_destroy(m), 0);
+    EXPECT_EQ(envideo_device_end_map_batch(dev), 0);
+
+    EXPECT_NE(envideo_device_begin_map_batch(nullptr), 0);
+    EXPECT_NE(envideo_device_end_map_batch(nullptr),   0);
+}
+
+TEST_F(MapTest, LazyCpu) {
+    EnvideoMap *map;
+
+    auto size = 0x10000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable | EnvideoMap_CpuLazy);
+
+    EXPECT_EQ(envideo_map_create(dev, &map, size, align, flags), 0);
+    EXPECT_NE(envideo_map_get_gpu_addr(map), 0);
+
+    auto *mem = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(map));
+    EXPECT_NE(mem, nullptr);
+    EXPECT_EQ(envideo_map_get_cpu_addr(map), mem);
+    std::memset(mem, 0xa5, size);
+    EXPECT_EQ(envideo_map_cache_op(map, 0, size, EnvideoCache_Writeback), 0);
+
+    // Dropping the mapping doesn't lose the contents
+    EXPECT_EQ(envideo_map_unmap_cpu(map), 0);
+    mem = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(map));
+    EXPECT_NE(mem, nullptr);
+    EXPECT_EQ(mem[0],        0xa5);
+    EXPECT_EQ(mem[size - 1], 0xa5);
+
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    EXPECT_NE(envideo_map_unmap_cpu(nullptr), 0);
+}
+
+TEST_F(MapTest, Recycle) {
+    EnvideoMap *map;
+
+    auto size = 0x3000, align = 0x1000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable);
+
+    EXPECT_EQ(envideo_map_cache_set_limit(dev, 0x100000), 0);
+
+    EXPECT_EQ(envideo_map_create(dev, &map, size, align, flags), 0);
+    auto handle = envideo_map_get_handle(map);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+
+    auto stats = envideo_map_cache_get_stats(dev);
+    EXPECT_EQ(stats.misses,      1);
+    EXPECT_EQ(stats.cached_maps, 1);
+
+    // Same size class
+    EXPECT_EQ(envideo_map_create(dev, &map, size - 0x100, align, flags), 0);
+    EXPECT_EQ(envideo_map_get_handle(map), handle);
+    EXPECT_GE(envideo_map_get_size  (map), size);
+
+    stats = envideo_map_cache_get_stats(dev);
+    EXPECT_EQ(stats.hits,        1);
+    EXPECT_EQ(stats.cached_maps, 0);
+
+    EnvideoMap *other;
+    EXPECT_EQ(envideo_map_create(dev, &other, size, align, static_cast<EnvideoMapFlags>(flags | EnvideoMap_UsageEngine)), 0);
+    EXPECT_EQ(envideo_map_destroy(other), 0);
+    EXPECT_EQ(envideo_map_destroy(map),   0);
+    EXPECT_EQ(envideo_map_cache_get_stats(dev).cached_maps, 2);
+
+    EXPECT_EQ(envideo_map_cache_trim(dev, 0x4000), 0);
+    stats = envideo_map_cache_get_stats(dev);
+    EXPECT_EQ(stats.evictions,   1);
+    EXPECT_EQ(stats.cached_maps, 1);
+    EXPECT_LE(stats.cached_bytes, 0x4000);
+
+    // Larger than the limit
+    EXPECT_EQ(envideo_map_create(dev, &map, 0x200000, align, flags), 0);
+    EXPECT_EQ(envideo_map_destroy(map), 0);
+    EXPECT_EQ(envideo_map_cache_get_stats(dev).cached_maps, 1);
+
+    EXPECT_EQ(envideo_map_cache_set_limit(dev, 0), 0);
+    EXPECT_EQ(envideo_map_cache_get_stats(dev).cached_maps, 0);
+
+    EXPECT_NE(envideo_map_cache_set_limit(nullptr, 0), 0);
+}
+
+TEST_F(MapTest, Heap) {
+    EnvideoHeap *heap;
+
+    auto block_size = 0x10000;
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable);
+
+    EXPECT_EQ(envideo_heap_create(dev, &heap, block_size, flags), 0);
+
+    EnvideoMap *maps[40];
+    for (auto &map: maps) {
+        EXPECT_EQ(envideo_heap_alloc(heap, &map, 0x1234, ENVIDEO_MAP_ALIGN), 0);
+        EXPECT_NE(envideo_map_get_handle  (map), 0);
+        EXPECT_NE(envideo_map_get_cpu_addr(map), nullptr);
+        EXPECT_NE(envideo_map_get_gpu_addr(map), 0);
+        EXPECT_GE(envideo_map_get_size    (map), 0x1234);
+        EXPECT_EQ(envideo_map_get_gpu_addr(map) % ENVIDEO_MAP_ALIGN, 0);
+    }
+
+    // Sub-allocations must not overlap
+    for (auto &map: maps)
+        std::memset(envideo_map_get_cpu_addr(map), &map - maps, envideo_map_get_size(map));
+    for (auto &map: maps) {
+        auto *mem = static_cast<std::uint8_t *>(envideo_map_get_cpu_addr(map));
+        EXPECT_EQ(mem[0], &map - maps);
+        EXPECT_EQ(mem[envideo_map_get_size(map) - 1], &map - maps);
+    }
+
+    EnvideoMap *aligned;
+    EXPECT_EQ(envideo_heap_alloc(heap, &aligned, 0x100, 0x100000), 0);
+    EXPECT_EQ(envideo_map_get_gpu_addr(aligned) % 0x100000, 0);
+    EXPECT_EQ(envideo_map_cache_op(aligned, 0, 0x100, EnvideoCache_Writeback), 0);
+    EXPECT_EQ(envideo_map_realloc(aligned, 0x2000, ENVIDEO_MAP_ALIGN), 0);
+    EXPECT_GE(envideo_map_get_size(aligned), 0x2000);
+    EXPECT_EQ(envideo_map_destroy(aligned), 0);
+
+    EnvideoChannel *channel;
+    EXPECT_EQ(envideo_channel_create(dev, &channel, EnvideoEngine_Copy), 0);
+    for (auto &map: maps)
+        EXPECT_EQ(envideo_map_pin(map, channel), 0);
+
+    for (auto &map: maps)
+        EXPECT_EQ(envideo_map_destroy(map), 0);
+    EXPECT_EQ(envideo_channel_destroy(channel), 0);
+
+    EXPECT_NE(envideo_heap_alloc(heap, nullptr, 0x1000, 0x1000), 0);
+    EXPECT_NE(envideo_heap_alloc(heap, &maps[0], 0, 0x1000),      0);
+    EXPECT_NE(envideo_heap_alloc(heap, &maps[0], 0x1000, 0x1001), 0);
+    EXPECT_NE(envideo_heap_alloc(nullptr, &maps[0], 0x1000, 0x1000), 0);
+
+    EXPECT_EQ(envideo_heap_destroy(heap), 0);
+
+    EXPECT_NE(envideo_heap_create(nullptr, &heap, block_size, flags), 0);
+    EXPECT_NE(envideo_heap_create(dev, nullptr,  block_size, flags), 0);
+    EXPECT_NE(envideo_heap_create(dev, &heap, 0, flags), 0);
+}
+
 struct FlagTest: public testing::TestWithParam<std::tuple<EnvideoMapFlags, EnvideoMapFlags, EnvideoMapFlags, EnvideoMapFlags>> {
     FlagTest() { envideo_device_create(&this->dev); }
    ~FlagTest() { envideo_device_destroy(this->dev); }
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+
+#include <gtest/gtest.h>
+
+#include <envideo.h>
+
+#include "common.hpp"
+
+struct SurfacePoolTest: public testing::Test {
+    SurfacePoolTest() {
+        envideo_device_create(&this->dev);
+        envideo_channel_create(this->dev, &this->chan, EnvideoEngine_Copy);
+    }
+
+   ~SurfacePoolTest() {
+        envideo_channel_destroy(this->chan);
+        envideo_device_destroy(this->dev);
+    }
+
+    EnvideoSurfacePoolParams params(std::uint32_t width, std::uint32_t height, std::uint32_t num_surfaces) {
+        return {
+            .codec        = EnvideoCodec_H264,
+            .subsample    = EnvideoSubsampling_420,
+            .depth        = 8,
+            .width        = width,
+            .height       = height,
+            .num_surfaces = num_surfaces,
+            .flags        = static_cast<EnvideoMapFlags>(EnvideoMap_CpuUnmapped | EnvideoMap_GpuCacheable |
+                                                         EnvideoMap_LocationDevice),
+            .channels     = &this->chan,
+            .num_channels = 1,
+        };
+    }
+
+    EnvideoDevice  *dev  = nullptr;
+    EnvideoChannel *chan = nullptr;
+};
+
+TEST_F(SurfacePoolTest, Basic) {
+    EnvideoSurfacePool *pool;
+
+    auto p = params(1920, 1080, 2);
+    EXPECT_EQ(envideo_surface_pool_create(dev, &pool, &p), 0);
+
+    EnvideoPoolSurface s1, s2, s3;
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s1), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s2), 0);
+    EXPECT_NE(s1.index, s2.index);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s3), ENVIDEO_RC_SYSTEM(EAGAIN));
+
+    EXPECT_NE(s1.map, nullptr);
+    EXPECT_EQ(s1.luma.width,   1920);
+    EXPECT_EQ(s1.luma.height,  1080);
+    EXPECT_EQ(s1.chroma.width, 1920);
+    EXPECT_EQ(s1.chroma.height, 540);
+    EXPECT_TRUE(s1.luma.tiled);
+    EXPECT_EQ(s1.luma.stride % ENVIDEO_WIDTH_ALIGN(1), 0);
+    EXPECT_EQ(s1.chroma.map_offset % ENVIDEO_MAP_ALIGN, 0);
+    EXPECT_GE(s1.chroma.map_offset, s1.luma.stride * 1080);
+    EXPECT_GE(envideo_map_get_size(s1.map), s1.chroma.map_offset + s1.chroma.stride * 540);
+
+    // Still referenced
+    EXPECT_EQ(envideo_surface_pool_ref    (pool, s1.index),    0);
+    EXPECT_EQ(envideo_surface_pool_release(pool, s1.index, 0), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s3), ENVIDEO_RC_SYSTEM(EAGAIN));
+
+    EXPECT_EQ(envideo_surface_pool_release(pool, s1.index, 0), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s3), 0);
+    EXPECT_EQ(s3.index, s1.index);
+
+    EXPECT_NE(envideo_surface_pool_release(pool, 1234, 0), 0);
+    EXPECT_NE(envideo_surface_pool_ref    (pool, 1234),    0);
+
+    EXPECT_EQ(envideo_surface_pool_destroy(pool), 0);
+
+    EXPECT_NE(envideo_surface_pool_create(nullptr, &pool, &p), 0);
+    EXPECT_NE(envideo_surface_pool_create(dev, nullptr, &p), 0);
+    EXPECT_NE(envideo_surface_pool_create(dev, &pool, nullptr), 0);
+
+    p.depth = 4;
+    EXPECT_NE(envideo_surface_pool_create(dev, &pool, &p), 0);
+}
+
+TEST_F(SurfacePoolTest, Fence) {
+    EnvideoSurfacePool *pool;
+
+    auto p = params(256, 256, 1);
+    EXPECT_EQ(envideo_surface_pool_create(dev, &pool, &p), 0);
+
+    EnvideoCmdbuf *cmdbuf;
+    EnvideoMap    *cmdbuf_map;
+    EXPECT_EQ(envideo_map_create(dev, &cmdbuf_map, 0x1000, 0x1000,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuUncacheable | EnvideoMap_UsageCmdbuf)), 0);
+    EXPECT_EQ(envideo_map_pin(cmdbuf_map, chan), 0);
+    EXPECT_EQ(envideo_cmdbuf_create(chan, &cmdbuf), 0);
+    EXPECT_EQ(envideo_cmdbuf_add_memory(cmdbuf, cmdbuf_map, 0, 0x1000), 0);
+
+    EnvideoPoolSurface s;
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s), 0);
+
+    EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+    EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+    EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+    EnvideoFence fence;
+    EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+    EXPECT_EQ(envideo_surface_pool_release(pool, s.index, fence), 0);
+
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 1000000), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s), 0);
+    EXPECT_EQ(envideo_surface_pool_release(pool, s.index, 0), 0);
+
+    EXPECT_EQ(envideo_cmdbuf_destroy(cmdbuf), 0);
+    EXPECT_EQ(envideo_map_destroy(cmdbuf_map), 0);
+    EXPECT_EQ(envideo_surface_pool_destroy(pool), 0);
+}
+
+TEST_F(SurfacePoolTest, Resize) {
+    EnvideoSurfacePool *pool;
+
+    auto p = params(640, 480, 2);
+    EXPECT_EQ(envideo_surface_pool_create(dev, &pool, &p), 0);
+
+    EnvideoPoolSurface old, s1, s2;
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &old), 0);
+
+    // The in-flight surface keeps its layout
+    EXPECT_EQ(envideo_surface_pool_resize(pool, 1280, 720, 2), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s1), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s2), 0);
+    EXPECT_EQ(s1.luma.width, 1280);
+    EXPECT_EQ(s2.luma.width, 1280);
+    EXPECT_EQ(old.luma.width, 640);
+    EXPECT_NE(old.index, s1.index);
+    EXPECT_NE(old.index, s2.index);
+
+    EXPECT_EQ(envideo_surface_pool_release(pool, old.index, 0), 0);
+    EXPECT_EQ(envideo_surface_pool_release(pool, s1.index,  0), 0);
+
+    // Shrinking the pool
+    EXPECT_EQ(envideo_surface_pool_resize(pool, 1280, 720, 1), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s1), ENVIDEO_RC_SYSTEM(EAGAIN));
+    EXPECT_EQ(envideo_surface_pool_release(pool, s2.index, 0), 0);
+    EXPECT_EQ(envideo_surface_pool_acquire(pool, &s1), 0);
+
+    EXPECT_NE(envideo_surface_pool_resize(pool, 0, 720, 1), 0);
+
+    EXPECT_EQ(envideo_surface_pool_destroy(pool), 0);
+}
+
+TEST_F(SurfacePoolTest, Layout) {
+    EnvideoSurfaceLayout l;
+
+    EXPECT_EQ(envideo_surface_compute_layout(dev, EnvideoSurfaceFormat_Nv12, 8, 1920, 1080, true, &l), 0);
+    EXPECT_EQ(l.num_planes, 2u);
+    EXPECT_EQ(l.gob_height, 2);
+    EXPECT_EQ(l.tegra_layout, envideo_device_get_info(dev).tegra_layout);
+    EXPECT_EQ(l.planes[0].offset, 0u);
+    EXPECT_EQ(l.planes[0].stride, 1920u);
+    EXPECT_EQ(l.planes[0].alloc_height, 1088u);
+    EXPECT_EQ(l.planes[1].offset, 1920u * 1088);
+    EXPECT_EQ(l.planes[1].width,  1920u);
+    EXPECT_EQ(l.planes[1].height, 540u);
+    EXPECT_EQ(l.planes[1].alloc_height, 544u);
+    EXPECT_EQ(l.size, 1920u * 1088 * 3 / 2);
+    EXPECT_GE(l.alignment, std::size_t(ENVIDEO_MAP_ALIGN));
+    EXPECT_EQ(l.alignment & (l.alignment - 1), 0u);
+
+    // Odd dimensions, high depth and pitch layout
+    EXPECT_EQ(envideo_surface_compute_layout(dev, EnvideoSurfaceFormat_I420, 10, 1919, 1079, false, &l), 0);
+    EXPECT_EQ(l.num_planes, 3u);
+    EXPECT_EQ(l.planes[0].width,  1919u * 2);
+    EXPECT_EQ(l.planes[1].width,  960u  * 2);
+    EXPECT_EQ(l.planes[1].height, 540u);
+
+    std::size_t end = 0;
+    for (std::uint32_t i = 0; i < l.num_planes; ++i) {
+        auto &p = l.planes[i];
+        EXPECT_EQ(p.offset % ENVIDEO_MAP_ALIGN, 0u);
+        EXPECT_EQ(p.stride % 64, 0u);
+        EXPECT_GE(p.stride, p.width);
+        EXPECT_GE(p.alloc_height, p.height);
+        EXPECT_GE(p.offset, end);
+        end = p.offset + std::size_t(p.stride) * p.alloc_height;
+    }
+    EXPECT_GE(l.size, end);
+    EXPECT_EQ(l.size % ENVIDEO_MAP_ALIGN, 0u);
+
+    EXPECT_NE(envideo_surface_compute_layout(dev,     EnvideoSurfaceFormat_Nv12, 8, 0,    1080, true, &l),     0);
+    EXPECT_NE(envideo_surface_compute_layout(dev,     EnvideoSurfaceFormat_Nv12, 4, 1920, 1080, true, &l),     0);
+    EXPECT_NE(envideo_surface_compute_layout(dev,     EnvideoSurfaceFormat_Nv12, 9, 1920, 1080, true, &l),     0);
+    EXPECT_NE(envideo_surface_compute_layout(dev,     EnvideoSurfaceFormat_Nv12, 8, 1920, 1080, true, nullptr), 0);
+    EXPECT_NE(envideo_surface_compute_layout(nullptr, EnvideoSurfaceFormat_Nv12, 8, 1920, 1080, true, &l),     0);
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2025 averne <averne381@gmail.com>
+ *
+ * This file is part of Envideo.
+
+ * Envideo is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License,
+ * or (at your option) any later version.
+
+ * Envideo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Envideo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <envideo.h>
+
+#include "common.hpp"
+
+namespace {
+
+// Golden model of the block-linear layout, one byte at a time
+std::size_t tiled_offset(const EnvideoSwizzleParams &p, std::uint32_t x, std::uint32_t y) {
+    std::size_t block_size = 512 * p.gob_height;
+    return (y / (8 * p.gob_height)) * (p.tiled_stride / 64) * block_size + (x / 64) * block_size +
+           (y / 8 % p.gob_height) * 512 +
+           ((x % 64) / 32) * 256 + ((y % 8) / 2) * 64 + ((x % 32) / 16) * 32 + (y % 2) * 16 + (x % 16);
+}
+
+std::size_t tiled_size(const EnvideoSwizzleParams &p) {
+    auto block_rows = 8 * p.gob_height;
+    return std::size_t(p.tiled_stride) * ((p.height + block_rows - 1) / block_rows * block_rows);
+}
+
+std::vector<std::uint8_t> random_bytes(std::size_t size) {
+    std::vector<std::uint8_t> v(size);
+    std::ranges::generate(v, [] { return std::rand(); });
+    return v;
+}
+
+} // namespace
+
+struct SwizzleTest: public testing::TestWithParam<std::tuple<EnvideoSwizzleKernel, int>> { };
+
+TEST_P(SwizzleTest, Golden) {
+    auto [kernel, gob_height] = GetParam();
+    if (!envideo_swizzle_kernel_supported(kernel))
+        GTEST_SKIP();
+
+    // Partial gobs on the right and bottom edges go through a separate path
+    EnvideoSwizzleParams p = {
+        .width         = 200,
+        .height        = 301,
+        .tiled_stride  = 256,
+        .linear_stride = 211,
+        .gob_height    = static_cast<std::uint8_t>(gob_height),
+        .num_threads   = 0,
+        .kernel        = kernel,
+    };
+
+    auto linear = random_bytes(std::size_t(p.linear_stride) * p.height);
+    std::vector<std::uint8_t> tiled(tiled_size(p)), expected(tiled_size(p)), back(linear.size());
+
+    for (std::uint32_t y = 0; y < p.height; ++y) {
+        for (std::uint32_t x = 0; x < p.width; ++x)
+            expected[tiled_offset(p, x, y)] = linear[y * p.linear_stride + x];
+    }
+
+    EXPECT_EQ(envideo_surface_swizzle(tiled.data(), linear.data(), &p), 0);
+    EXPECT_EQ(tiled, expected);
+
+    EXPECT_EQ(envideo_surface_deswizzle(back.data(), tiled.data(), &p), 0);
+    for (std::uint32_t y = 0; y < p.height; ++y)
+        EXPECT_EQ(std::memcmp(&back[y * p.linear_stride], &linear[y * p.linear_stride], p.width), 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Kernels, SwizzleTest,
+    ::testing::Combine(
+        ::testing::ValuesIn({EnvideoSwizzleKernel_Scalar, EnvideoSwizzleKernel_Sse4, EnvideoSwizzleKernel_Avx2,
+                             EnvideoSwizzleKernel_Neon,   EnvideoSwizzleKernel_Auto}),
+        ::testing::ValuesIn({1, 2, 4, 8, 16, 32})
+    )
+);
+
+TEST(Swizzle, Threads) {
+    EnvideoSwizzleParams p = {
+        .width         = 1920,
+        .height        = 1080,
+        .tiled_stride  = 1920,
+        .linear_stride = 1920,
+        .gob_height    = 2,
+    };
+
+    auto linear = random_bytes(std::size_t(p.linear_stride) * p.height);
+    std::vector<std::uint8_t> single(tiled_size(p)), multi(tiled_size(p));
+
+    p.num_threads = 1;
+    EXPECT_EQ(envideo_surface_swizzle(single.data(), linear.data(), &p), 0);
+
+    // Bands do not need to match the number of gob rows
+    p.num_threads = 7;
+    EXPECT_EQ(envideo_surface_swizzle(multi.data(), linear.data(), &p), 0);
+    EXPECT_EQ(single, multi);
+
+    p.num_threads = 1000;
+    std::ranges::fill(multi, 0);
+    EXPECT_EQ(envideo_surface_swizzle(multi.data(), linear.data(), &p), 0);
+    EXPECT_EQ(single, multi);
+}
+
+TEST(Swizzle, Invalid) {
+    std::vector<std::uint8_t> a(0x10000), b(0x10000);
+
+    EnvideoSwizzleParams p = {
+        .width         = 64,
+        .height        = 64,
+        .tiled_stride  = 128,
+        .linear_stride = 64,
+        .gob_height    = 2,
+    };
+    EXPECT_EQ(envideo_surface_swizzle(a.data(), b.data(), &p), 0);
+
+    EXPECT_NE(envideo_surface_swizzle  (nullptr,  b.data(), &p),     0);
+    EXPECT_NE(envideo_surface_swizzle  (a.data(), nullptr,  &p),     0);
+    EXPECT_NE(envideo_surface_swizzle  (a.data(), b.data(), nullptr), 0);
+    EXPECT_NE(envideo_surface_deswizzle(a.data(), b.data(), nullptr), 0);
+
+    auto q = p; q.gob_height   = 3;   EXPECT_NE(envideo_surface_swizzle(a.data(), b.data(), &q), 0);
+    q = p;      q.gob_height   = 64;  EXPECT_NE(envideo_surface_swizzle(a.data(), b.data(), &q), 0);
+    q = p;      q.tiled_stride = 100; EXPECT_NE(envideo_surface_swizzle(a.data(), b.data(), &q), 0);
+    q = p;      q.width        = 256; EXPECT_NE(envideo_surface_swizzle(a.data(), b.data(), &q), 0);
+    q = p;      q.height       = 0;   EXPECT_NE(envideo_surface_swizzle(a.data(), b.data(), &q), 0);
+
+    EXPECT_TRUE(envideo_swizzle_kernel_supported(EnvideoSwizzleKernel_Scalar));
+    EXPECT_TRUE(envideo_swizzle_kernel_supported(EnvideoSwizzleKernel_Auto));
+    for (auto k: {EnvideoSwizzleKernel_Sse4, EnvideoSwizzleKernel_Avx2, EnvideoSwizzleKernel_Neon}) {
+        if (!envideo_swizzle_kernel_supported(k)) {
+            q = p, q.kernel = k;
+            EXPECT_EQ(envideo_surface_swizzle(a.data(), b.data(), &q), ENVIDEO_RC_SYSTEM(ENOTSUP));
+        }
+    }
+}
+
+TEST(Swizzle, Subsampled) {
+    EnvideoSwizzleParams p = {
+        .width         = 200,
+        .height        = 301,
+        .tiled_stride  = 256,
+        .linear_stride = 211,
+        .gob_height    = 2,
+    };
+
+    auto tiled = random_bytes(tiled_size(p));
+
+    for (std::uint32_t pixel_size: { 1u, 2u, 4u }) {
+        for (std::uint32_t step: { 1u, 2u, 3u, 4u }) {
+            std::vector<std::uint8_t> linear(std::size_t(p.linear_stride) * p.height);
+            EXPECT_EQ(envideo_surface_deswizzle_subsampled(linear.data(), tiled.data(), &p, pixel_size, step, step), 0);
+
+            auto out_width = (p.width / pixel_size + step - 1) / step, out_height = (p.height + step - 1) / step;
+            for (std::uint32_t y = 0; y < out_height; ++y) {
+                for (std::uint32_t x = 0; x < out_width * pixel_size; ++x) {
+                    auto src_x = x / pixel_size * step * pixel_size + x % pixel_size;
+                    ASSERT_EQ(linear[y * p.linear_stride + x], tiled[tiled_offset(p, src_x, y * step)]);
+                }
+            }
+        }
+    }
+
+    std::vector<std::uint8_t> linear(std::size_t(p.linear_stride) * p.height);
+    EXPECT_NE(envideo_surface_deswizzle_subsampled(linear.data(), tiled.data(), &p, 3, 2, 2), 0);
+    EXPECT_NE(envideo_surface_deswizzle_subsampled(linear.data(), tiled.data(), &p, 1, 0, 2), 0);
+    EXPECT_NE(envideo_surface_deswizzle_subsampled(linear.data(), tiled.data(), nullptr, 1, 2, 2), 0);
+}
+
+// The copy engine must read back what the cpu wrote
+TEST(Swizzle, CopyEngine) {
+    EnvideoDevice  *dev;
+    EnvideoChannel *chan;
+    EnvideoMap     *cmdbuf_map, *tiled, *linear;
+    EnvideoCmdbuf  *cmdbuf;
+
+    std::uint32_t width = 1280, height = 720;
+
+    EnvideoSwizzleParams p = {
+        .width         = width,
+        .height        = height,
+        .tiled_stride  = width,
+        .linear_stride = width,
+        .gob_height    = 2,
+    };
+
+    ASSERT_EQ(envideo_device_create(&dev), 0);
+    ASSERT_EQ(envideo_channel_create(dev, &chan, EnvideoEngine_Copy), 0);
+
+    auto flags = static_cast<EnvideoMapFlags>(EnvideoMap_CpuCacheable | EnvideoMap_GpuCacheable |
+                                              EnvideoMap_LocationHost | EnvideoMap_UsageFramebuffer);
+    EXPECT_EQ(envideo_map_create(dev, &cmdbuf_map, 0x10000, 0x1000,
+        static_cast<EnvideoMapFlags>(EnvideoMap_CpuWriteCombine | EnvideoMap_GpuUncacheable |
+                                     EnvideoMap_LocationHost    | EnvideoMap_UsageCmdbuf)), 0);
+    EXPECT_EQ(envideo_map_create(dev, &tiled,  tiled_size(p),         0x1000, flags), 0);
+    EXPECT_EQ(envideo_map_create(dev, &linear, std::size_t(width) * height, 0x1000, flags), 0);
+    EXPECT_EQ(envideo_map_pin(cmdbuf_map, chan), 0);
+    EXPECT_EQ(envideo_map_pin(tiled,      chan), 0);
+    EXPECT_EQ(envideo_map_pin(linear,     chan), 0);
+    EXPECT_EQ(envideo_cmdbuf_create(chan, &cmdbuf), 0);
+    EXPECT_EQ(envideo_cmdbuf_add_memory(cmdbuf, cmdbuf_map, 0, envideo_map_get_size(cmdbuf_map)), 0);
+
+    auto src = random_bytes(std::size_t(width) * height);
+    EXPECT_EQ(envideo_surface_swizzle(envideo_map_get_cpu_addr(tiled), src.data(), &p), 0);
+    EXPECT_EQ(envideo_map_cache_op(tiled, 0, envideo_map_get_size(tiled), EnvideoCache_Writeback), 0);
+
+    EnvideoSurfaceInfo src_info = {
+        .map        = tiled,
+        .width      = width,
+        .height     = height,
+        .stride     = width,
+        .tiled      = true,
+        .gob_height = 2,
+    }, dst_info = {
+        .map        = linear,
+        .width      = width,
+        .height     = height,
+        .stride     = width,
+    };
+    EXPECT_EQ(envideo_surface_transfer(cmdbuf, &src_info, &dst_info), 0);
+    EXPECT_EQ(envideo_cmdbuf_begin(cmdbuf, EnvideoEngine_Host), 0);
+    EXPECT_EQ(envideo_cmdbuf_cache_op(cmdbuf, EnvideoCache_Writeback), 0);
+    EXPECT_EQ(envideo_cmdbuf_end(cmdbuf), 0);
+
+    EnvideoFence fence;
+    EXPECT_EQ(envideo_channel_submit(chan, cmdbuf, &fence), 0);
+    EXPECT_EQ(envideo_fence_wait(dev, fence, 5e6), 0);
+    EXPECT_EQ(envideo_map_cache_op(linear, 0, envideo_map_get_size(linear), EnvideoCache_Invalidate), 0);
+
+    EXPECT_EQ(std::memcmp(envideo_map_get_cpu_addr(linear), src.data(), src.size()), 0);
+
+    EXPECT_EQ(envideo_cmdbuf_destroy(cmdbuf), 0);
+    EXPECT_EQ(envideo_map_destroy(linear), 0);
+    EXPECT_EQ(envideo_map_destroy(tiled), 0);
+    EXPECT_EQ(envideo_map_destroy(cmdbuf_map), 0);
+    EXPECT_EQ(envideo_channel_destroy(chan), 0);
+    EXPECT_EQ(envideo_device_destroy(dev), 0);
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests
+TEST(Swizzle, DISABLED_Throughput) {
+    constexpr int iterations = 8;
+
+    EnvideoSwizzleParams p = {
+        .width         = 3840,
+        .height        = 2160,
+        .tiled_stride  = 3840,
+        .linear_stride = 3840,
+        .gob_height    = 2,
+    };
+
+    auto linear = random_bytes(std::size_t(p.linear_stride) * p.height);
+    std::vector<std::uint8_t> tiled(tiled_size(p));
+
+    auto measure = [&](auto &&fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            EXPECT_EQ(fn(), 0);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return double(iterations) * p.width * p.height / elapsed.count() / 1e9;
+    };
+
+    static const char *names[] = { "auto", "scalar", "sse4", "avx2", "neon" };
+    for (auto k: {EnvideoSwizzleKernel_Scalar, EnvideoSwizzleKernel_Sse4, EnvideoSwizzleKernel_Avx2, EnvideoSwizzleKernel_Neon}) {
+        if (!envideo_swizzle_kernel_supported(k))
+            continue;
+
+        for (std::uint32_t threads: {1u, 0u}) {
+            p.kernel = k, p.num_threads = threads;
+            auto sw = measure([&] { return envideo_surface_swizzle  (tiled.data(),  linear.data(), &p); });
+            auto ds = measure([&] { return envideo_surface_deswizzle(linear.data(), tiled.data(),  &p); });
+            std::printf("%-6s %-8s swizzle %6.2f GB/s, deswizzle %6.2f GB/s\n",
+                        names[k], threads ? "1 thread" : "auto", sw, ds);
+        }
+    }
+}